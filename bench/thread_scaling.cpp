@@ -0,0 +1,106 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <omp.h>
+
+#include <precision.hpp>
+#include <array2d.hpp>
+#include <openmp_kernels.hpp>
+
+// Times the cache-tiled OpenMP kernels over increasing thread counts.
+//
+//   thread_scaling [n] [sweeps]
+//
+// runs each kernel sweeps times on an n x n grid (default 4096 x 4096, 50
+// sweeps) for 1, 2, 4, ... threads up to OMP_NUM_THREADS, and prints the time
+// per sweep with the speedup and parallel efficiency against one thread. Set
+// OMP_PROC_BIND=close or spread and OMP_PLACES=cores for results that reflect
+// the NUMA placement of the arrays.
+
+struct Timings {
+  double jacobi;
+  double divergence;
+  double projection;
+};
+
+template<class F>
+double timePerSweep(const int sweeps, F sweep) {
+  // One untimed sweep so that every page is resident
+  sweep();
+  const auto start = std::chrono::steady_clock::now();
+  for(int k=0; k<sweeps; ++k) {
+    sweep();
+  }
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count()/sweeps;
+}
+
+Timings timeKernels(const int n, const int sweeps) {
+  // Allocated once the thread count is set, so that each thread first-touches
+  // the rows it will compute on
+  const real dx = 1.0f/n;
+  Array f(n+1, n+1, 1, "f", 1.0f);
+  Array b(n+1, n+1, 1, "b", 0.5f);
+  Array out(n+1, n+1, 1, "out");
+  Array vx(n, n, 1, "vx", 1.0f);
+  Array vy(n, n, 1, "vy", 1.0f);
+
+  Timings t;
+  t.jacobi = timePerSweep(sweeps, [&]() {
+    applyJacobiStep(out, f, -0.25f*dx*dx, dx*dx, dx*dx, b);
+    f.swap(out);
+  });
+  t.divergence = timePerSweep(sweeps, [&]() {
+    calcDivergence(out, vx, vy, dx, dx);
+  });
+  t.projection = timePerSweep(sweeps, [&]() {
+    applyProjectionX(vx, f, dx);
+    applyProjectionY(vy, f, dx);
+  });
+  return t;
+}
+
+void printRow(const std::string& kernel, const int threads, const double time, const double serialTime) {
+  const double speedup = serialTime/time;
+  std::cout << std::setw(12) << kernel
+            << std::setw(9) << threads
+            << std::setw(14) << time*1e3
+            << std::setw(10) << speedup
+            << std::setw(12) << 100.0*speedup/threads << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  const int n = argc > 1 ? std::stoi(argv[1]) : 4096;
+  const int sweeps = argc > 2 ? std::stoi(argv[2]) : 50;
+  const int maxThreads = omp_get_max_threads();
+
+  std::vector<int> threadCounts;
+  for(int threads=1; threads<maxThreads; threads*=2) {
+    threadCounts.push_back(threads);
+  }
+  threadCounts.push_back(maxThreads);
+
+  std::cout << "Grid " << n << " x " << n << ", " << sweeps << " sweeps, "
+            << sizeof(real)*8 << "-bit reals" << std::endl;
+  std::cout << std::setw(12) << "kernel"
+            << std::setw(9) << "threads"
+            << std::setw(14) << "ms/sweep"
+            << std::setw(10) << "speedup"
+            << std::setw(12) << "efficiency" << std::endl;
+
+  Timings serial{};
+  std::cout << std::fixed << std::setprecision(3);
+  for(const int threads : threadCounts) {
+    omp_set_num_threads(threads);
+    const Timings t = timeKernels(n, sweeps);
+    if(threads == 1) {
+      serial = t;
+    }
+    printRow("jacobi", threads, t.jacobi, serial.jacobi);
+    printRow("divergence", threads, t.divergence, serial.divergence);
+    printRow("projection", threads, t.projection, serial.projection);
+  }
+  return 0;
+}
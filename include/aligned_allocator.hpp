@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <utility>
+
+// Alignment of Array storage and of the interior of each padded row: a cache line, which is
+// also the width of the widest (AVX-512) vector loads
+const std::size_t SIMD_ALIGNMENT = 64;
+
+// Allocator for std::vector giving storage aligned to Alignment bytes
+template<class T, std::size_t Alignment = SIMD_ALIGNMENT>
+class AlignedAllocator {
+  public:
+    typedef T value_type;
+    template<class U> struct rebind {
+      typedef AlignedAllocator<U, Alignment> other;
+    };
+
+    AlignedAllocator() = default;
+    template<class U> AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+    T* allocate(const std::size_t n) {
+      return static_cast<T*>(::operator new(n*sizeof(T), std::align_val_t(Alignment)));
+    }
+
+    void deallocate(T* p, const std::size_t) {
+      ::operator delete(p, std::align_val_t(Alignment));
+    }
+
+    // Elements are default- rather than value-initialised, so a new vector of
+    // real is left untouched and its pages are placed by whichever thread
+    // first writes them (see Array::fill)
+    template<class U>
+    void construct(U* p) {
+      ::new(static_cast<void*>(p)) U;
+    }
+
+    template<class U, class... Args>
+    void construct(U* p, Args&&... args) {
+      ::new(static_cast<void*>(p)) U(std::forward<Args>(args)...);
+    }
+};
+
+template<class T, class U, std::size_t Alignment>
+bool operator==(const AlignedAllocator<T, Alignment>&, const AlignedAllocator<U, Alignment>&) {
+  return true;
+}
+
+template<class T, class U, std::size_t Alignment>
+bool operator!=(const AlignedAllocator<T, Alignment>&, const AlignedAllocator<U, Alignment>&) {
+  return false;
+}
@@ -6,29 +6,56 @@
 #include <H5Cpp.h>
 
 #include <precision.hpp>
+#include <layout.hpp>
 #include <constants.hpp>
+#include <aligned_allocator.hpp>
+
+typedef std::vector<real, AlignedAllocator<real>> ArrayData;
 
 class Array {
   public:
-    Array(const int nx, const int ny, const int ng = 0, const std::string& name = "", real initialVal = 0.0f);
+    // nMembers copies of the array are stored one after another along the
+    // non-contiguous axis, as an ensemble. Elements and host operations
+    // without a member refer to member 0. A row is a line of elements along
+    // the contiguous axis (see layout.hpp). Storage is aligned to
+    // SIMD_ALIGNMENT and, unless packed, rows are padded so that the first
+    // interior element of every row is aligned.
+    Array(const int nx, const int ny, const int ng = 0, const std::string& name = "", real initialVal = 0.0f, const int nMembers = 1, const bool packed = false);
     void fill(real val);
     int idx(const int i, const int j) const;
+    int idx(const int i, const int j, const int member) const;
     int size() const;
     real sum() const;
     real operator()(const int i, const int j) const;
     real& operator()(const int i, const int j);
+    real operator()(const int i, const int j, const int member) const;
+    real& operator()(const int i, const int j, const int member);
     Array& operator=(const Array& arr);
     void operator+=(const Array& arr);
     void saveTo(H5::H5File& file) const;
     void load(H5::H5File& file);
     void setName(const std::string& name);
+    const std::string& getName() const;
+    const H5::PredType& getH5Type() const;
+    const real* getData() const;
+    // Pointer to element (i, j), for kernels that stride through rows themselves
+    const real* ptr(const int i, const int j) const;
+    real* ptr(const int i, const int j);
+    // Offsets between neighbouring elements in i and in j
+    int strideI() const;
+    int strideJ() const;
+    // Number of rows over all members, and elements per row excluding padding
+    int rows() const;
+    int rowLength() const;
     void swap(Array& arr);
     void swapData(Array& arr);
     void print() const;
 
-    const int nx, ny, ng;
+    const int nx, ny, ng, nMembers;
+    const int rowOffset; // padding elements before each row's first ghost cell
+    const int rowStride; // elements from one row to the next, at least rowOffset + rowLength()
   protected:
-    std::vector<real> data;
+    ArrayData data;
     std::string name;
     bool hasName;
     H5::PredType h5ArrayType;
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+
+#include <precision.hpp>
+
+// Values match the BC_* constants in FAFS_PROGRAM. Halo sides are shared with
+// a neighbouring block whose cells are copied into the ghost cells, so
+// boundary conditions leave them unchanged.
+enum class BoundaryType { Dirichlet = 0, Neumann = 1, Periodic = 2, Halo = 3 };
+// Order of the per-side entries in boundary descriptors
+enum class BoundarySide { Lower = 0, Upper = 1, Left = 2, Right = 3 };
+
+const int N_BOUNDARY_SIDES = 4;
+
+// Whether each side of a block, in BoundarySide order, is on the boundary of
+// the domain rather than shared with a neighbouring block (see Decomposition)
+typedef std::array<bool, N_BOUNDARY_SIDES> PhysicalSides;
+const PhysicalSides ALL_SIDES_PHYSICAL{true, true, true, true};
+
+// Size and offset of block k of n items split into nBlocks as evenly as possible
+inline void splitEvenly(const int n, const int nBlocks, const int k, int& size, int& offset) {
+  size = n/nBlocks + (k < n%nBlocks ? 1 : 0);
+  offset = k*(n/nBlocks) + std::min(k, n%nBlocks);
+}
+
+struct BoundaryCondition {
+  BoundaryType type;
+  real value; // Dirichlet value, otherwise unused
+};
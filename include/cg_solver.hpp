@@ -1 +1,37 @@
 #pragma once
+
+#include <functional>
+
+#include <precision.hpp>
+#include <ocl_array.hpp>
+#include <solver_control.hpp>
+
+// Matrix-free linear operator, out = A(in). Operators may update the ghost
+// cells of in, e.g. to apply boundary conditions.
+typedef std::function<void(OpenCLArray& out, OpenCLArray& in)> LinearOperator;
+
+// Operator of the system solved by applyJacobiStep. applyBC, if given, is
+// applied to the input before the stencil.
+LinearOperator makeJacobiOperator(const real alpha, const real beta, const real gamma, std::function<void(OpenCLArray&)> applyBC = nullptr);
+
+// Preconditioned conjugate gradient solver for symmetric (semi-)definite
+// operators. Boundary values are taken from the ghost cells of the initial
+// guess; search directions keep zero ghost cells. Ensembles are not supported.
+class CGSolver {
+  public:
+    CGSolver(const int nx, const int ny, const int ng);
+    // out acts as the initial guess. The residual norm is needed by every
+    // iteration anyway, so it is checked every iteration regardless of
+    // control.checkInterval.
+    SolverStats solve(OpenCLArray& out, const LinearOperator& A, const OpenCLArray& b, const SolverControl& control, const LinearOperator& preconditioner = nullptr);
+    // Should match the queue of the arrays being solved for
+    void setQueue(const cl::CommandQueue& queue);
+    // Bytes of the workspace on the device
+    size_t deviceBytes() const;
+
+  protected:
+    OpenCLArray res;  // residual
+    OpenCLArray dir;  // search direction
+    OpenCLArray Adir; // operator applied to search direction
+    OpenCLArray z;    // preconditioned residual
+};
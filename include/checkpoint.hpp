@@ -0,0 +1,23 @@
+#pragma once
+
+#include <string>
+
+#include <precision.hpp>
+#include <constants.hpp>
+#include <variables.hpp>
+#include <ocl_array.hpp>
+
+// How far a run has got
+struct RunState {
+  real t;
+  int step;
+};
+
+// Write everything needed to continue a run. The file is written under a
+// temporary name and then renamed, so an interrupted write leaves the
+// previous checkpoint intact.
+void writeCheckpoint(const std::string& filename, Variables<OpenCLArray>& vars, const RunState& state, const Constants& c);
+Constants readCheckpointConstants(const std::string& filename);
+// Loads straight into the device buffers of vars, which must have been
+// constructed from the checkpoint's Constants
+RunState readCheckpoint(const std::string& filename, Variables<OpenCLArray>& vars);
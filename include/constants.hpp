@@ -1,6 +1,12 @@
 #pragma once
 
+#include <string>
+#include <H5Cpp.h>
+
 #include <precision.hpp>
+#include <solver_control.hpp>
+
+enum class SolverType { Jacobi, RedBlackSOR, Multigrid, CG };
 
 class Constants {
   public:
@@ -17,8 +23,39 @@ class Constants {
 
     real Re; // Reynolds number (in this non-dimensionalisation, equiv to 1/viscosity)
 
+    // Ensemble members are advanced together by every kernel launch. Only the
+    // lid velocity differs between them, being
+    // lidVelocity + member*lidVelocityStep; Re, dt and every other constant
+    // are shared, as the kernels take them as scalars. Sweeps over the lid
+    // velocity alone are supported, so members at different Re or dt must be
+    // run separately.
+    int nMembers;
+    real lidVelocity;
+    real lidVelocityStep;
+
     bool isAdvectionImplicit;
     bool isDiffusionImplicit;
 
+    SolverType pressureSolver; // Jacobi, RedBlackSOR, Multigrid or CG
+    SolverType diffusionSolver; // Jacobi, RedBlackSOR or CG
+    real relaxationFactor; // SOR over-relaxation, 1 for Gauss-Seidel
+    int jacobiSweepsPerLaunch; // temporal blocking depth of the pressure Jacobi solve
+    SolverControl pressureControl; // iterations are cycles for multigrid, inner solves if mixed precision
+    bool isPressureMixedPrecision; // refine the pressure solve in double, needs cl_khr_fp64
+    SolverControl refinementControl; // outer iterations of the mixed-precision pressure solve
+    SolverControl diffusionControl;
+
+    bool useTiledKernels; // use local-memory tiled stencil kernels (OpenCL only)
+    bool specialiseKernels; // compile the pressure and diffusion solves for this grid and these coefficients (OpenCL only)
+    bool isHalfStorage; // hold the velocity and pressure fields and their scratch in fp16 on the device (OpenCL with Jacobi solves only)
+    int outputInterval; // steps between snapshots, 0 for initial and final output only
+    std::string timeSeriesFile; // periodic snapshots are frames of this file, or separate files if empty
+    int checkpointInterval; // steps between checkpoints, 0 for none
+    real checkpointWallTime; // wall-clock seconds between checkpoints, 0 for none
+    std::string checkpointFile;
+
     void print() const;
+    // As attributes of the file's root group
+    void saveTo(H5::H5File& file) const;
+    void load(H5::H5File& file);
 };
@@ -0,0 +1,102 @@
+#pragma once
+
+#ifdef FAFS_USE_MPI
+
+#include <array>
+#include <vector>
+#include <mpi.h>
+
+#include <precision.hpp>
+#include <constants.hpp>
+#include <array2d.hpp>
+#include <boundary.hpp>
+#include <solver_control.hpp>
+#include <openmp_kernels.hpp>
+
+// MPI type of a type in memory
+template<class T> MPI_Datatype mpiType();
+template<> inline MPI_Datatype mpiType<float>() { return MPI_FLOAT; }
+template<> inline MPI_Datatype mpiType<double>() { return MPI_DOUBLE; }
+
+// Splits the nx x ny grid of velocity nodes into a 2D grid of blocks, one per
+// rank of a communicator. Each rank holds its block as arrays of the local
+// size, so that every kernel runs on it unchanged.
+// Cell-centred arrays have one more cell than nodes along each axis, so
+// neighbouring blocks share the column (row) of cells between their nodes.
+// Both compute it, from the same halo, and it is owned by the lower block.
+class Decomposition {
+  public:
+    // Collective over comm
+    Decomposition(MPI_Comm comm, const int nx, const int ny);
+    ~Decomposition();
+    Decomposition(const Decomposition&) = delete;
+    Decomposition& operator=(const Decomposition&) = delete;
+
+    // c with the grid size of this rank's block
+    Constants localConstants(const Constants& c) const;
+
+    // Rank of the neighbouring block di, dj blocks away in i and j (each -1,
+    // 0 or 1), or MPI_PROC_NULL at the boundary of the domain
+    int neighbour(const int di, const int dj) const;
+    const PhysicalSides& physicalSides() const;
+
+    // Cells of block, which is node- or cell-centred, that this rank owns
+    CellRange ownedRange(const Array& block) const;
+    // L2 and max norms over every rank, from the norms over owned cells
+    ResidualNorms allReduce(const ResidualNorms& local) const;
+    // Copies each rank's owned cells of block, and any ghost cells on the
+    // boundary of the domain, into whole on rank 0. whole is only used on
+    // rank 0 and is ignored (and may be null) elsewhere.
+    void gather(const Array& block, Array* whole) const;
+
+    MPI_Comm comm;
+    int rank;
+    int size;
+    int dims[2];
+    int coords[2];
+    int globalNx;
+    int globalNy;
+    // Node block [i0, i0+nx) x [j0, j0+ny) of the global grid
+    int nx;
+    int ny;
+    int i0;
+    int j0;
+
+  private:
+    PhysicalSides physical;
+};
+
+// Non-blocking exchange of the ghost cells of arrays of one shape between
+// neighbouring blocks, including the corners. Usage is
+//   halo.begin(a);  // post receives and send a's edge cells
+//   ...             // work that neither writes a's edges nor reads its ghosts
+//   halo.finish(a); // wait, then write a's ghost cells
+// Ghost cells on the boundary of the domain are left for boundary conditions.
+class HaloExchange {
+  public:
+    HaloExchange(const Decomposition& d, const int nx, const int ny, const int ng);
+    HaloExchange(const HaloExchange&) = delete;
+    HaloExchange& operator=(const HaloExchange&) = delete;
+
+    void begin(const Array& a);
+    void finish(Array& a);
+    // begin and finish
+    void exchange(Array& a);
+
+  private:
+    // The 8 neighbours, indexed by (di+1)*3 + (dj+1) with the centre unused
+    static const int N_DIRECTIONS = 9;
+
+    const Decomposition& d;
+    const int nx;
+    const int ny;
+    const int ng;
+    std::array<int, N_DIRECTIONS> ranks;
+    std::array<CellRange, N_DIRECTIONS> sendRanges;
+    std::array<CellRange, N_DIRECTIONS> recvRanges;
+    std::array<std::vector<real>, N_DIRECTIONS> sendBuffers;
+    std::array<std::vector<real>, N_DIRECTIONS> recvBuffers;
+    std::vector<MPI_Request> requests;
+};
+
+#endif
@@ -3,13 +3,41 @@
 #include <string>
 #include <H5Cpp.h>
 
+#include <precision.hpp>
+
+enum class FileMode {
+  ReadOnly,
+  Truncate, // created, discarding any existing contents
+  Append // opened read-write, created if missing
+};
+
 class HDFFile {
   public:
     HDFFile(const std::string& name, const bool readOnly = true);
+    HDFFile(const std::string& name, const FileMode mode);
     void open(const std::string& name, const bool readOnly = true);
+    void open(const std::string& name, const FileMode mode);
     void close();
     H5::H5File file;
   private:
     const std::string name;
     bool isOpen;
 };
+
+// Write an nx by ny array, stored contiguously in y, as a little-endian dataset
+void writeDataset(H5::H5File& file, const std::string& name, const real* data, const int nx, const int ny, const H5::PredType& type);
+// As above, with rows rowStride apart in memory, each starting rowOffset
+// elements in. Padding is not written.
+void writeDataset(H5::H5File& file, const std::string& name, const real* data, const int nx, const int ny, const H5::PredType& type, const int rowStride, const int rowOffset = 0);
+
+// Scalar attributes, for run metadata. bools are stored as ints.
+void writeAttribute(H5::H5Object& obj, const std::string& name, const int value);
+void writeAttribute(H5::H5Object& obj, const std::string& name, const bool value);
+void writeAttribute(H5::H5Object& obj, const std::string& name, const float value);
+void writeAttribute(H5::H5Object& obj, const std::string& name, const double value);
+void writeAttribute(H5::H5Object& obj, const std::string& name, const std::string& value);
+void readAttribute(const H5::H5Object& obj, const std::string& name, int& value);
+void readAttribute(const H5::H5Object& obj, const std::string& name, bool& value);
+void readAttribute(const H5::H5Object& obj, const std::string& name, float& value);
+void readAttribute(const H5::H5Object& obj, const std::string& name, double& value);
+void readAttribute(const H5::H5Object& obj, const std::string& name, std::string& value);
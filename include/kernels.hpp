@@ -16,14 +16,42 @@ typedef cl::KernelFunctor<cl::Buffer, cl::Buffer, real, int, int, int> advanceEu
 typedef cl::KernelFunctor<cl::Buffer, cl::Buffer, real, real, real, int, int, int> calcDiffusionKernel;
 typedef cl::KernelFunctor<cl::Buffer, cl::Buffer, cl::Buffer, cl::Buffer, real, real, int, int, int> calcAdvectionKernel;
 typedef cl::KernelFunctor<cl::Buffer, int, int, int> vonNeumannKernel;
+typedef cl::KernelFunctor<
+  cl::Buffer, cl::Buffer, cl::Buffer, int, int,
+  cl::Buffer, cl::Buffer, cl::Buffer, int, int,
+  cl::Buffer, cl::Buffer, cl::Buffer, int, int,
+  int> applyBoundaryConditions_k;
 typedef cl::KernelFunctor<cl::Buffer, cl::Buffer, real, real, real, cl::Buffer, int, int, int> applyJacobiKernel;
+typedef cl::KernelFunctor<cl::Buffer, cl::Buffer, real, real, real, cl::Buffer, int, cl::LocalSpaceArg, cl::LocalSpaceArg, cl::LocalSpaceArg, int, int, int> applyJacobiSweeps_k;
+typedef cl::KernelFunctor<cl::Buffer, cl::Buffer, real, real, real, cl::Buffer, real, int, int, int> applyWeightedJacobi_k;
+typedef cl::KernelFunctor<cl::Buffer, real, real, real, cl::Buffer, real, int, int, int, int> applyRedBlackSOR_k;
+typedef cl::KernelFunctor<cl::Buffer, cl::Buffer, int, int, int, int, int> transferCellCentred_k;
+typedef cl::KernelFunctor<cl::Buffer, cl::Buffer, real, real, real, int, int, int> applyJacobiOperator_k;
+typedef cl::KernelFunctor<cl::Buffer, cl::Buffer, cl::Buffer, cl::LocalSpaceArg, int, int, int, int> dotProduct_k;
+typedef cl::KernelFunctor<cl::Buffer, cl::Buffer, cl::LocalSpaceArg, cl::LocalSpaceArg, int, int, int, int> calcNorms_k;
+typedef cl::KernelFunctor<cl::Buffer, cl::Buffer, real, real, real, cl::Buffer, cl::LocalSpaceArg, cl::LocalSpaceArg, int, int, int, int> calcJacobiResidualNorms_k;
+typedef cl::KernelFunctor<cl::Buffer, cl::Buffer, real, real, int, int, int> axpby_k;
 typedef cl::KernelFunctor<cl::Buffer, cl::Buffer, cl::Buffer, real, real, int, int, int> calcDivergence_k;
 typedef cl::KernelFunctor<cl::Buffer, cl::Buffer, real, int, int, int> applyProjection_k;
 typedef cl::KernelFunctor<cl::Buffer, cl::Buffer, cl::Buffer, cl::Buffer, real, real, real, int, int, int> advect_k;
+typedef cl::KernelFunctor<cl::Buffer, cl::Buffer, cl::Buffer, cl::Buffer, real, real, real, int, int, int> advectVelocity_k;
+typedef cl::KernelFunctor<cl::Buffer, cl::Buffer, cl::Buffer, cl::Buffer, cl::Buffer, cl::Buffer, real, real, real, int, int, int> advectVelocityScalar_k;
+typedef cl::KernelFunctor<cl::Buffer, cl::Buffer, real, real, real, cl::Buffer, cl::LocalSpaceArg, int, int, int> applyJacobiTiled_k;
+typedef cl::KernelFunctor<cl::Buffer, cl::Buffer, real, real, real, cl::LocalSpaceArg, int, int, int> calcDiffusionTiled_k;
+typedef cl::KernelFunctor<cl::Buffer, cl::Buffer, cl::Buffer, real, real, cl::LocalSpaceArg, cl::LocalSpaceArg, int, int, int> calcDivergenceTiled_k;
+typedef cl::KernelFunctor<cl::Buffer, cl::Buffer, real, cl::LocalSpaceArg, int, int, int> applyProjectionTiled_k;
+typedef cl::KernelFunctor<cl::Buffer, cl::Buffer, cl::Buffer, int, int, int> interleave_k;
+typedef cl::KernelFunctor<cl::Buffer, cl::Buffer, real, real, real, int, int, int> advectVector_k;
+typedef cl::KernelFunctor<cl::Buffer, cl::Buffer, real, real, int, int, int> calcDivergenceVector_k;
+typedef cl::KernelFunctor<cl::Buffer, cl::Buffer, real, real, int, int, int> applyProjectionVector_k;
+typedef cl::KernelFunctor<cl::Buffer, cl::Buffer, cl::Buffer, cl::Buffer, cl::Buffer, int, int, int> applyBoundaryConditionsVector_k;
 
 class Kernels {
   public:
-    Kernels();
+    // options are passed to the compiler
+    explicit Kernels(const std::string& options = "");
+    // Smallest work-group size limit of any kernel of the program on device
+    size_t maxWorkGroupSize(const cl::Device& device);
   protected:
     cl::Program program; // This must be initialised before kernels
   public:
@@ -34,15 +62,122 @@ class Kernels {
     calcDiffusionKernel calcDiffusionTerm;
     calcAdvectionKernel calcAdvectionTerm;
     applyJacobiKernel applyJacobiStep;
+    applyWeightedJacobi_k applyWeightedJacobiStep;
+    applyRedBlackSOR_k applyRedBlackSORStep;
+    applyJacobiKernel calcJacobiResidual;
+    applyJacobiOperator_k applyJacobiOperator;
+    dotProduct_k dotProduct;
+    calcNorms_k calcNorms;
+    calcJacobiResidualNorms_k calcJacobiResidualNorms;
+    axpby_k axpby;
+    transferCellCentred_k restrictCellCentred;
+    transferCellCentred_k prolongateCellCentred;
     calcDivergence_k calcDivergence;
     applyProjection_k applyProjectionX;
     applyProjection_k applyProjectionY;
     advect_k advect;
+    advectVelocity_k advectVelocity;
+    advectVelocityScalar_k advectVelocityScalar;
+    applyJacobiTiled_k applyJacobiStepTiled;
+    calcDiffusionTiled_k calcDiffusionTermTiled;
+    calcDivergenceTiled_k calcDivergenceTiled;
+    applyProjectionTiled_k applyProjectionXTiled;
+    applyProjectionTiled_k applyProjectionYTiled;
+    applyJacobiSweeps_k applyJacobiSweeps;
+    applyBoundaryConditions_k applyBoundaryConditions;
+    interleave_k interleave;
+    interleave_k deinterleave;
+    advectVector_k advectVector;
+    calcDivergenceVector_k calcDivergenceVector;
+    applyProjectionVector_k applyProjectionVector;
+    applyBoundaryConditionsVector_k applyBoundaryConditionsVector;
 };
 
+typedef cl::KernelFunctor<cl::Buffer, cl::Buffer, int, int, int> convertPrecision_k;
+typedef cl::KernelFunctor<cl::Buffer, cl::Buffer, double, double, double, cl::Buffer, int, int, int, int> calcJacobiResidualDouble_k;
+
+// Kernels of FAFS_FP64_PROGRAM, which is only built when first needed
+class Fp64Kernels {
+  public:
+    Fp64Kernels();
+    // As Kernels::maxWorkGroupSize
+    size_t maxWorkGroupSize(const cl::Device& device);
+  protected:
+    cl::Program program; // This must be initialised before kernels
+  public:
+    convertPrecision_k toDouble;
+    convertPrecision_k toReal;
+    calcJacobiResidualDouble_k calcJacobiResidualDouble;
+    convertPrecision_k addCorrection; // x += correction
+};
+
+Fp64Kernels& fp64Kernels();
+
+typedef cl::KernelFunctor<cl::Buffer, cl::Buffer, cl::Buffer, int, int, int> applyBoundaryConditionsHalf_k;
+
+// Kernels of FAFS_HALF_PROGRAM for arrays with half storage, built when first
+// needed. Each takes the same arguments as its namesake in Kernels.
+class HalfKernels {
+  public:
+    HalfKernels();
+    // As Kernels::maxWorkGroupSize
+    size_t maxWorkGroupSize(const cl::Device& device);
+  protected:
+    cl::Program program; // This must be initialised before kernels
+  public:
+    convertPrecision_k toHalf;
+    convertPrecision_k fromHalf;
+    fillKernel fill;
+    advect_k advect; // out and f in half, velocities in real
+    applyJacobiKernel applyJacobiStep;
+    applyBoundaryConditionsHalf_k applyBoundaryConditions; // one array
+    vonNeumannKernel applyVonNeumannBC_x;
+    vonNeumannKernel applyVonNeumannBC_y;
+    calcJacobiResidualNorms_k calcJacobiResidualNorms;
+    advectVelocity_k advectVelocity;
+    calcDivergence_k calcDivergence;
+    applyProjection_k applyProjectionX;
+    applyProjection_k applyProjectionY;
+};
+
+HalfKernels& halfKernels();
+
+extern const std::string FAFS_COMMON;
 extern const std::string FAFS_PROGRAM;
+extern const std::string FAFS_FP64_PROGRAM;
+extern const std::string FAFS_HALF_PROGRAM;
+
+// Prefix a program with the definitions of real and real2, and FAFS_COMMON
+std::string programSource(const std::string& source);
+
+// Kernels of FAFS_PROGRAM, built when first needed. The default context must
+// not change afterwards.
+Kernels& kernels();
+
+// Size and coefficients of a linear system of the form solved by
+// applyJacobiStep
+struct LinearSystem {
+  int nx;
+  int ny;
+  int ng;
+  real alpha;
+  real beta;
+  real gamma;
+};
 
-extern Kernels g_kernels;
+// Registers a system whose kernels (applyJacobiStep, applyRedBlackSORStep,
+// applyJacobiOperator, calcJacobiResidualNorms and applyJacobiSweeps) are
+// compiled with its size and coefficients as constants. Each registered
+// system has its own build of FAFS_PROGRAM, made when first needed.
+void specialiseLinearSystem(const LinearSystem& system);
+// Unregisters every system, so all go back to kernels()
+void clearLinearSystemSpecialisations();
+// Kernels specialised for system if it was registered, otherwise kernels().
+// The specialised kernels must only be launched on that system.
+Kernels& linearSystemKernels(const LinearSystem& system);
+// Smallest Kernels::maxWorkGroupSize on device of kernels() and the build of
+// every registered system, building those not yet made
+size_t linearSystemsMaxWorkGroupSize(const cl::Device& device);
 
 template<class T>
 T createKernelFunctor(const cl::Program& program, const std::string& kernelName) {
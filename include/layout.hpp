@@ -0,0 +1,12 @@
+#pragma once
+
+// Memory layout of every array, shared by the host accessors, the kernel
+// program and HDF5 output. By default j is the contiguous axis; configure
+// with -DFAFS_I_CONTIGUOUS=ON to make i contiguous instead. Either way,
+// dimension 0 of every NDRange runs along the contiguous axis, so adjacent
+// work items touch adjacent memory.
+#ifdef FAFS_I_CONTIGUOUS
+const bool I_CONTIGUOUS = true;
+#else
+const bool I_CONTIGUOUS = false;
+#endif
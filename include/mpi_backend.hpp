@@ -0,0 +1,45 @@
+#pragma once
+
+#ifdef FAFS_USE_MPI
+
+#include <vector>
+
+#include <constants.hpp>
+#include <variables.hpp>
+#include <array2d.hpp>
+#include <openmp_backend.hpp>
+#include <decomposition.hpp>
+
+// Time step operations for Solver on one rank's block of a decomposed grid,
+// constructed with the block's constants (Decomposition::localConstants) and
+// the decomposition. Steps are those of OpenMPBackend, with halos exchanged
+// wherever a stencil reads across the edge of a block. Each Jacobi sweep
+// updates the cells that read no ghost cells while its halo is in flight, and
+// residual norms are reduced over every rank. Implicit advection traces back
+// at most ng cells, the width of the halo, so it throws on every rank if
+// max|v|*dt/dx (or dy) reaches ng along an axis split between blocks.
+class MPIBackend : public OpenMPBackend {
+  public:
+    MPIBackend(const Constants& c, const Decomposition& d);
+    void applyVelocityBC(Variables<Array>& vars);
+    void applyPressureBC(Array& p);
+    void advect(Variables<Array>& vars);
+    std::vector<SolverStats> diffuse(Variables<Array>& vars);
+    SolverStats solvePressure(Array& p, const Array& div);
+
+  protected:
+    // Jacobi sweep into out from in, whose ghost cells are exchanged during
+    // the sweep, then set by applyBC
+    template<class BCFn>
+    void jacobiSweep(Array& out, Array& in, HaloExchange& halo, const real alpha, const real beta, const real gamma, const Array& b, BCFn applyBC);
+    // Implicit diffusion of var, with Dirichlet boundaries set by applyBC
+    template<class BCFn>
+    SolverStats solveDiffusion(Array& var, HaloExchange& halo, const real alpha, const real beta, const real gamma, BCFn applyBC);
+
+    const Decomposition& d;
+    HaloExchange vxHalo;
+    HaloExchange vyHalo;
+    HaloExchange cellHalo;
+};
+
+#endif
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <precision.hpp>
+#include <ocl_array.hpp>
+#include <solver_control.hpp>
+
+// Jacobi solver with von Neumann boundaries that splits the grid into slabs
+// along the non-contiguous axis, one per device of the default context
+// (see setDefaultDevices), so that each slab's ghost lines are contiguous in
+// memory. Every slab has its own compute queue, and a transfer queue on the
+// same device that copies its neighbours' edge lines into its ghost lines.
+// Each sweep updates the cells that read no ghost cells while the halos are
+// copied, then the edges of the slab. Queues are synchronised with
+// device-side events; the host only blocks to read back residuals.
+class MultiDeviceJacobiSolver {
+  public:
+    MultiDeviceJacobiSolver(const std::vector<cl::Device>& devices, const int nx, const int ny, const int ng, const int nMembers = 1);
+    int nSlabs() const;
+    // Bytes of every slab's arrays, over all devices
+    size_t deviceBytes() const;
+    // As runJacobiIteration, with out as the initial guess. out and b are
+    // copied to the slabs after all work on their queues, and the ghost cells
+    // of out are left for the caller's boundary conditions.
+    SolverStats solve(OpenCLArray& out, const real alpha, const real beta, const real gamma, const OpenCLArray& b, const SolverControl& control);
+
+  protected:
+    struct Slab {
+      Slab(const cl::Device& device, const int nx, const int ny, const int ng, const int nMembers, const int k0);
+
+      cl::CommandQueue queue;
+      cl::CommandQueue haloQueue;
+      int k0; // first line of the whole grid
+      int n;  // lines
+      OpenCLArray x;
+      OpenCLArray temp;
+      OpenCLArray b;
+    };
+
+    // begin copies the edge lines of each slab's x into its neighbours' ghost
+    // lines once all work enqueued so far on both is done. Work enqueued in
+    // between must neither write the edge lines nor read the ghost lines.
+    // finish makes later work on each slab wait for the copies that read or
+    // write its x.
+    void beginHaloExchange();
+    void finishHaloExchange();
+    void sweep(const real alpha, const real beta, const real gamma);
+    ResidualNorms calcResidualNorms(const real alpha, const real beta, const real gamma);
+
+    const int nx;
+    const int ny;
+    const int ng;
+    const int nMembers;
+    std::vector<std::unique_ptr<Slab>> slabs;
+    std::vector<std::vector<cl::Event>> haloCopies; // per slab
+};
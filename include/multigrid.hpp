@@ -0,0 +1,58 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <precision.hpp>
+#include <ocl_array.hpp>
+#include <solver_control.hpp>
+
+enum class MultigridCycle { V, F };
+enum class MultigridSmoother { WeightedJacobi, RedBlackGaussSeidel };
+
+class MultigridLevel {
+  public:
+    MultigridLevel(const int nx, const int ny, const int ng, const real dx, const real dy, const bool isFinest, const bool needsTemp, const int nMembers = 1);
+
+    // Solution and right hand side, owned on coarse levels only. The finest
+    // level works directly on the arrays passed to MultigridSolver::solve.
+    std::unique_ptr<OpenCLArray> u, b;
+    OpenCLArray res;
+    std::unique_ptr<OpenCLArray> temp; // Jacobi smoother scratch only
+
+    const real dx, dy;
+    // Jacobi coefficients for the Poisson operator on this level
+    const real alpha, beta, gamma;
+};
+
+// Geometric multigrid solver for the cell-centred Poisson equation
+// $\nabla^2 u = b$ with von Neumann boundary conditions
+class MultigridSolver {
+  public:
+    // Solves for all nMembers members of an ensemble at once. Convergence is
+    // judged on the residual norms of the whole ensemble.
+    MultigridSolver(const int nx, const int ny, const int ng, const real dx, const real dy, const MultigridCycle cycle = MultigridCycle::V, const MultigridSmoother smoother = MultigridSmoother::RedBlackGaussSeidel, const int nMembers = 1);
+    // out acts as the initial guess
+    void solve(OpenCLArray& out, const OpenCLArray& b, const int nCycles = 4);
+    // Iteration counts in control are in cycles
+    SolverStats solve(OpenCLArray& out, const OpenCLArray& b, const SolverControl& control);
+    int nLevels() const;
+    // Bytes of every level's arrays on the device
+    size_t deviceBytes() const;
+
+    int nPreSmooth;
+    int nPostSmooth;
+    int nCoarseSmooth;
+    real omega; // smoother relaxation factor
+
+  protected:
+    void vCycle(OpenCLArray& u, const OpenCLArray& b, const int level);
+    void fCycle(OpenCLArray& u, const OpenCLArray& b, const int level);
+    void smooth(OpenCLArray& u, const OpenCLArray& b, const int level, const int iterations);
+    void restrictResidual(OpenCLArray& u, const OpenCLArray& b, const int level);
+    void prolongateCorrection(OpenCLArray& u, const int level);
+
+    const MultigridCycle cycle;
+    const MultigridSmoother smoother;
+    std::vector<std::unique_ptr<MultigridLevel>> levels;
+};
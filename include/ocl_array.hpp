@@ -1,19 +1,49 @@
 #pragma once
 
+#include <array>
+
 #include <ocl_utility.hpp>
 #include <array2d.hpp>
 #include <precision.hpp>
 #include <kernels.hpp>
+#include <boundary.hpp>
+#include <constants.hpp>
+#include <variables.hpp>
+
+// Work group edge length used by the tiled kernels
+const int TILE_SIZE = 16;
+
+// Format of an array's device buffer. The host copy is always real. Half
+// arrays hold fp16 on the device and convert to real on every read, halving
+// the bytes moved by bandwidth-bound kernels at the cost of about three
+// significant digits. They are accepted only by fill, swapData, the boundary
+// conditions, advectImplicit, advectVelocityImplicit, applyJacobiStep,
+// calcJacobiResidualNorms, calcDivergence and the projections, which is
+// enough for the solver's Jacobi solves (Constants::isHalfStorage).
+enum class Storage {
+  Real,
+  Half
+};
 
 class OpenCLArray: public Array {
   public:
-    OpenCLArray(const int nx, const int ny, const int ng = 0, const std::string& name = "", real initialVal = 0.0f, bool initDevice = true);
+    // Ranges span every member in their third dimension, so each launch
+    // advances the whole ensemble. Host storage is packed to match the kernels.
+    OpenCLArray(const int nx, const int ny, const int ng = 0, const std::string& name = "", real initialVal = 0.0f, const int nMembers = 1, const Storage storage = Storage::Real, bool initDevice = true);
     void initOnDevice(bool readOnly = false);
-    std::vector<real>::iterator begin();
-    std::vector<real>::iterator end();
+    ArrayData::iterator begin();
+    ArrayData::iterator end();
     const cl::Buffer& getDeviceData() const;
     cl::Buffer& getDeviceData();
+    // The device data in real: the buffer itself, or for half storage a copy
+    // converted on the array's queue
+    cl::Buffer getRealDeviceData() const;
+    Storage getStorage() const;
+    // Throws if the array is not stored in real
+    void requireRealStorage(const std::string& operation) const;
+    // Ranges enqueue on the array's queue
     const cl::EnqueueArgs makeRange(int x0, int x1, int y0, int y1) const;
+    const cl::EnqueueArgs makeTiledRange(int x0, int y0, int x1, int y1, int tileSize) const;
     const cl::EnqueueArgs makeColumnRange(int col, bool includeGhost=false) const;
     const cl::EnqueueArgs makeRowRange(int row, bool includeGhost=false) const;
     void swapData(OpenCLArray& arr);
@@ -23,19 +53,86 @@ class OpenCLArray: public Array {
     void setLowerBoundary(real val);
     void setLeftBoundary(real val);
     void setRightBoundary(real val);
+    // Boundary descriptors, applied to every side in one launch by
+    // applyBoundaryConditions. All sides default to Dirichlet 0. Types are
+    // shared by all members, values are set for all members unless given one.
+    void setBoundaryCondition(BoundarySide side, BoundaryType type, real value = 0.0f);
+    void setBoundaryConditions(BoundaryType type, real value = 0.0f);
+    void setBoundaryValue(BoundarySide side, int member, real value);
+    void copyBoundaryConditions(const OpenCLArray& arr);
+    const BoundaryCondition& getBoundaryCondition(BoundarySide side) const;
+    real getBoundaryValue(BoundarySide side, int member) const;
+    const cl::Buffer& getBoundaryTypes() const;
+    const cl::Buffer& getBoundaryValues() const;
+    void applyBoundaryConditions();
     void saveTo(H5::H5File& file) ;
+    // Loads into host memory and uploads to the device
+    void load(H5::H5File& file);
 
     void toDevice();
     void toHost();
 
+    // All work on the array is enqueued on its queue, the default queue
+    // unless set. Changing queue rebuilds the ranges below.
+    void setQueue(const cl::CommandQueue& newQueue);
+    const cl::CommandQueue& getQueue() const;
+    // Device scratch of at least size bytes for the partial results of a
+    // reduction over the array, made on first use and again after setQueue.
+    // Reductions are enqueued on the array's queue, so each finishes reading
+    // its results before the next overwrites them.
+    const cl::Buffer& getReductionBuffer(size_t size) const;
+    // Bytes of every device buffer the array holds
+    size_t deviceBytes() const;
+
+  protected:
+    cl::CommandQueue queue; // must be initialised before the ranges
+
+  public:
     cl::EnqueueArgs interior;
     cl::EnqueueArgs entire;
     cl::EnqueueArgs lowerBound;
     cl::EnqueueArgs upperBound;
     cl::EnqueueArgs leftBound;
     cl::EnqueueArgs rightBound;
+    cl::EnqueueArgs redBlackInterior; // interior with every other cell in j
+    cl::EnqueueArgs tiledInterior; // interior rounded up to whole TILE_SIZE^2 work groups
 
   protected:
-    cl::Buffer d_data; // data on device
+    void boundaryConditionsToDevice();
+    void fillRange(const cl::EnqueueArgs& range, real val);
+
+    Storage storage;
+    cl::Buffer d_data; // data on device, in storage format
+    std::array<BoundaryCondition, N_BOUNDARY_SIDES> boundaryConditions;
+    std::vector<real> boundaryValues; // N_BOUNDARY_SIDES per member
+    cl::Buffer d_boundaryTypes; // boundary descriptors on device
+    cl::Buffer d_boundaryValues;
+    mutable cl::Buffer d_reduction;
     bool isDeviceDirty;
 };
+
+// Fields of the solver are held in half if c.isHalfStorage
+template<>
+OpenCLArray makeField<OpenCLArray>(const Constants& c, const int nx, const int ny, const std::string& name);
+
+Storage fieldStorage(const Constants& c);
+
+// Size of buffer, 0 if it was never made
+size_t bufferBytes(const cl::Buffer& buffer);
+
+// Dimension 0 of every range runs along the contiguous axis
+cl::NDRange layoutRange(const int i, const int j, const int member);
+// Range over cells [x0, x1) x [y0, y1) of every member of an array with ng
+// ghost cells, enqueued on queue with the tuned local size for its global
+// size (see tuneWorkGroupSizes), or the given one
+cl::EnqueueArgs makeArrayRange(const cl::CommandQueue& queue, int x0, int y0, int x1, int y1, int ng, int nMembers);
+cl::EnqueueArgs makeArrayRange(const cl::CommandQueue& queue, int x0, int y0, int x1, int y1, int ng, int nMembers, const cl::NDRange& local);
+// Number of ghost cells around an nx by ny interior
+int ghostRingSize(int nx, int ny, int ng);
+
+// Apply the boundary descriptors of every side of up to three arrays, which
+// may differ in size but not in ng or nMembers, in a single launch on the
+// first array's queue. Half arrays are applied separately on their own queues.
+void applyBoundaryConditions(OpenCLArray& a);
+void applyBoundaryConditions(OpenCLArray& a, OpenCLArray& b);
+void applyBoundaryConditions(OpenCLArray& a, OpenCLArray& b, OpenCLArray& c);
@@ -4,8 +4,26 @@
 #define CL_HPP_TARGET_OPENCL_VERSION 200
 
 #include <string>
+#include <vector>
 #include <CL/opencl.hpp>
 
 cl::Program buildProgramFromFile(const std::string& filename);
-cl::Program buildProgramFromString(const std::string& source);
+// Programs are built for every device of the default context. Binaries are
+// cached on disk, keyed on a hash of the source, options and each device's
+// name and driver, and later builds of the same program load them instead of
+// compiling.
+cl::Program buildProgramFromString(const std::string& source, const std::string& options = "");
+// Directory of the program binary cache, created when first written to.
+// Defaults to kernel_cache in the working directory; empty disables the cache.
+void setProgramCacheDirectory(const std::string& directory);
 int setDefaultPlatform(const std::string& targetName);
+// Make the default context span n devices of the default platform or, if it
+// has fewer, n sub-devices of its first device partitioned equally by compute
+// units (device fission). The first becomes the default device. Must be
+// called before the default context is first used, including by kernels().
+std::vector<cl::Device> setDefaultDevices(const int n);
+// Make queue wait, on the device, for all work enqueued so far on each of
+// others. The host does not block.
+void waitForQueues(const cl::CommandQueue& queue, const std::vector<cl::CommandQueue>& others);
+// Make every queue wait for all work enqueued so far on all of them
+void joinQueues(const std::vector<cl::CommandQueue>& queues);
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <constants.hpp>
+#include <variables.hpp>
+#include <ocl_array.hpp>
+#include <multigrid.hpp>
+#include <cg_solver.hpp>
+#include <refinement.hpp>
+#include <multi_device.hpp>
+
+// Registers the implicit diffusion and pressure systems of c for
+// specialised kernels (see specialiseLinearSystem), as OpenCLBackend does
+// when c.specialiseKernels is set
+void specialiseSolves(const Constants& c);
+
+// Time step operations for Solver on OpenCLArrays. The default platform must
+// be set before construction.
+// vx and vy are independent between advection and projection, so each has
+// its own in-order queue and their work can overlap. Everything else runs on
+// the default queue. Queues are synchronised with device-side events; the
+// host only blocks to read back residuals and in finish().
+// If the default context spans several devices (setDefaultDevices), Jacobi
+// pressure solves are split across them and everything else runs on the
+// default device.
+// With c.isHalfStorage the fields, divergence and scratch arrays are held in
+// half, which needs implicit advection, Jacobi solves and a single device.
+class OpenCLBackend {
+  public:
+    typedef OpenCLArray ArrayType;
+
+    explicit OpenCLBackend(const Constants& c);
+    void initialise(Variables<OpenCLArray>& vars);
+    void applyVelocityBC(Variables<OpenCLArray>& vars);
+    void applyPressureBC(OpenCLArray& p);
+    void advect(Variables<OpenCLArray>& vars);
+    std::vector<SolverStats> diffuse(Variables<OpenCLArray>& vars);
+    void calcDivergence(OpenCLArray& div, Variables<OpenCLArray>& vars);
+    SolverStats solvePressure(OpenCLArray& p, const OpenCLArray& div);
+    void project(Variables<OpenCLArray>& vars);
+    void finish();
+    // Bytes of the scratch arrays and solver workspaces on the device, not
+    // counting the fields passed in
+    size_t deviceBytes() const;
+
+  protected:
+    const Constants c;
+    cl::CommandQueue mainQueue;
+    cl::CommandQueue vxQueue;
+    cl::CommandQueue vyQueue;
+
+    // Working arrays located at boundaries, two per velocity component
+    OpenCLArray boundTemp1;
+    OpenCLArray boundTemp2;
+    OpenCLArray boundTemp3;
+    OpenCLArray boundTemp4;
+    // Working array located at cell centres
+    OpenCLArray cellTemp;
+
+    // Solvers hold their own device workspaces, so only those c selects are
+    // made; the rest are null
+    std::unique_ptr<MultigridSolver> pressureSolver;
+    std::unique_ptr<CGSolver> pressureCGSolver;
+    std::unique_ptr<IterativeRefinement> pressureRefinement;
+    std::unique_ptr<MultiDeviceJacobiSolver> pressureSlabSolver; // Jacobi on several devices
+    std::unique_ptr<CGSolver> vxCGSolver;
+    std::unique_ptr<CGSolver> vyCGSolver;
+};
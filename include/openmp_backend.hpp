@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+
+#include <constants.hpp>
+#include <variables.hpp>
+#include <array2d.hpp>
+#include <boundary.hpp>
+
+// Time step operations for Solver on Arrays, with the same discretisation as
+// OpenCLBackend. Every system is solved by Jacobi iteration, whatever solver
+// the constants ask for. Ensembles are not supported.
+class OpenMPBackend {
+  public:
+    typedef Array ArrayType;
+
+    explicit OpenMPBackend(const Constants& c);
+    void initialise(Variables<Array>& vars);
+    void applyVelocityBC(Variables<Array>& vars);
+    void applyPressureBC(Array& p);
+    void advect(Variables<Array>& vars);
+    std::vector<SolverStats> diffuse(Variables<Array>& vars);
+    void calcDivergence(Array& div, Variables<Array>& vars);
+    SolverStats solvePressure(Array& p, const Array& div);
+    void project(Variables<Array>& vars);
+    void finish();
+
+  protected:
+    void applyVxBC(Array& vx);
+    void applyVyBC(Array& vy);
+
+    const Constants c;
+
+    // Working arrays located at boundaries
+    Array boundTemp1;
+    Array boundTemp2;
+    // Working array located at cell centres
+    Array cellTemp;
+    // Sides whose ghost cells take boundary conditions
+    PhysicalSides physical;
+};
@@ -1,6 +0,0 @@
-#pragma once
-
-#include <variables.hpp>
-
-int runCPU();
-void setInitialConditions(Variables<Array>& vars);
@@ -2,8 +2,20 @@
 
 #include <H5Cpp.h>
 
-// Need to also change the typedef in FAFS_PROGRAM in src/kernels.cpp!
-// Need to also change H5 array type in Array constructor!
+// Working precision of both the host code and the kernel program. Configure
+// with -DFAFS_DOUBLE_PRECISION=ON, which needs cl_khr_fp64 on the device.
+#ifdef FAFS_DOUBLE_PRECISION
+typedef double real;
+#else
 typedef float real;
+#endif
 
-//typedef double real;
+// OpenCL C name of a type, used to define real in kernel programs
+template<class T> const char* clTypeName();
+template<> inline const char* clTypeName<float>() { return "float"; }
+template<> inline const char* clTypeName<double>() { return "double"; }
+
+// HDF5 type of a type in memory
+template<class T> const H5::PredType& h5NativeType();
+template<> inline const H5::PredType& h5NativeType<float>() { return H5::PredType::NATIVE_FLOAT; }
+template<> inline const H5::PredType& h5NativeType<double>() { return H5::PredType::NATIVE_DOUBLE; }
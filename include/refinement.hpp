@@ -0,0 +1,33 @@
+#pragma once
+
+#include <functional>
+
+#include <precision.hpp>
+#include <ocl_array.hpp>
+#include <solver_control.hpp>
+
+// Mixed-precision iterative refinement of the system solved by
+// applyJacobiStep. The solution is accumulated, and its residual computed, in
+// double, while each correction is solved for in working precision, giving
+// double precision accuracy for little more than the working precision cost.
+// Needs cl_khr_fp64.
+class IterativeRefinement {
+  public:
+    // Approximately solves A e = r in working precision, starting from e = 0,
+    // with homogeneous boundary conditions of the same kind as the outer solve
+    typedef std::function<void(OpenCLArray& e, const OpenCLArray& r)> InnerSolve;
+
+    IterativeRefinement(const int nx, const int ny, const int ng, const int nMembers = 1);
+    // out acts as the initial guess, and its ghost cells are left untouched.
+    // Boundaries are von Neumann if isVonNeumann, otherwise the ghost cells of
+    // the initial guess are held fixed. Residuals are those of the double
+    // solution, rounded to working precision.
+    SolverStats solve(OpenCLArray& out, const OpenCLArray& b, const double alpha, const double beta, const double gamma, const bool isVonNeumann, const InnerSolve& inner, const SolverControl& control);
+    // Bytes of the workspace on the device
+    size_t deviceBytes() const;
+
+  protected:
+    cl::Buffer x; // solution in double
+    OpenCLArray res;
+    OpenCLArray correction;
+};
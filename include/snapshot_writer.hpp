@@ -0,0 +1,80 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <H5Cpp.h>
+
+#include <precision.hpp>
+#include <ocl_array.hpp>
+#include <time_series.hpp>
+
+// Host memory allocated by the OpenCL runtime, typically page-locked, and kept
+// mapped so that device readbacks into it can run asynchronously
+class StagingBuffer {
+  public:
+    explicit StagingBuffer(const size_t count);
+    ~StagingBuffer();
+    real* data();
+    size_t size() const;
+
+  protected:
+    cl::Buffer buffer;
+    real* hostPtr;
+    const size_t count;
+};
+
+// An array on its way to disk
+struct SnapshotField {
+  std::string name;
+  int nx, ny; // including ghost cells, with every member in nx
+  H5::PredType type;
+  std::unique_ptr<StagingBuffer> staging;
+  cl::Event readback;
+};
+
+struct Snapshot {
+  std::string filename;
+  TimeSeriesWriter* series; // appended to instead of writing filename, if set
+  real t;
+  int step;
+  std::vector<SnapshotField> fields;
+};
+
+// Writes snapshots of device arrays to HDF5 files, or frames of a time
+// series, on a background thread.
+// Readbacks are enqueued without blocking on each array's queue, and the host
+// only waits when maxPending snapshots are already in flight. HDF5 is not
+// thread-safe in general, so other HDF5 output should wait for flush().
+class SnapshotWriter {
+  public:
+    explicit SnapshotWriter(const int maxPending = 2);
+    ~SnapshotWriter();
+    void write(const std::string& filename, const std::vector<const OpenCLArray*>& arrays);
+    // Append a frame to series, which must outlive the writer and is only
+    // touched by the writer thread until flush()
+    void append(TimeSeriesWriter& series, const real t, const int step, const std::vector<const OpenCLArray*>& arrays);
+    // Wait until every snapshot written so far is on disk
+    void flush();
+
+  protected:
+    void enqueue(Snapshot snapshot, const std::vector<const OpenCLArray*>& arrays);
+    void run();
+    std::unique_ptr<StagingBuffer> acquireStaging(const size_t count);
+    void rethrowError();
+
+    const int maxPending;
+    int nInFlight; // queued or being written
+    bool stopping;
+    std::deque<Snapshot> pending;
+    std::vector<std::unique_ptr<StagingBuffer>> freeStaging; // recycled once written
+    std::exception_ptr error; // from the writer thread, rethrown on the caller's
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::thread worker;
+};
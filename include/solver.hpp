@@ -0,0 +1,94 @@
+#pragma once
+
+#include <iostream>
+#include <utility>
+#include <vector>
+
+#include <precision.hpp>
+#include <constants.hpp>
+#include <variables.hpp>
+#include <solver_control.hpp>
+
+// Runs the time step of the operator-splitting scheme on a backend, which
+// supplies the array type and every operation of the step:
+//
+//   typedef ... ArrayType;
+//   Backend(const Constants& c, ...);  // any further arguments are passed through
+//   void initialise(Variables<ArrayType>& vars);  // zero fields, set up boundaries
+//   void applyVelocityBC(Variables<ArrayType>& vars);
+//   void applyPressureBC(ArrayType& p);
+//   void advect(Variables<ArrayType>& vars);
+//   std::vector<SolverStats> diffuse(Variables<ArrayType>& vars);  // empty if explicit
+//   void calcDivergence(ArrayType& div, Variables<ArrayType>& vars);
+//   SolverStats solvePressure(ArrayType& p, const ArrayType& div);  // from p = 0
+//   void project(Variables<ArrayType>& vars);
+//   void finish();  // block until all work is complete
+//
+// OpenMPBackend and OpenCLBackend implement it for Array and OpenCLArray, and
+// MPIBackend for a block of a grid decomposed across MPI ranks.
+template<class Backend>
+class Solver {
+  public:
+    typedef typename Backend::ArrayType ArrayType;
+
+    template<class... BackendArgs>
+    explicit Solver(const Constants& c, BackendArgs&&... backendArgs):
+      backend(c, std::forward<BackendArgs>(backendArgs)...),
+      vars(c),
+      divw(makeField<ArrayType>(c, c.nx+1, c.ny+1, "divw")),
+      pressure(makeField<ArrayType>(c, c.nx+1, c.ny+1, "cellTemp1"))
+    {
+      backend.initialise(vars);
+    }
+
+    // Apply every boundary condition, once the initial fields are in place
+    void applyBoundaryConditions() {
+      backend.applyVelocityBC(vars);
+      backend.applyPressureBC(vars.p);
+    }
+
+    // Advance by one time step, printing solver statistics for time t
+    void step(const real t) {
+      // ADVECTION
+      backend.advect(vars);
+      backend.applyVelocityBC(vars);
+
+      // DIFFUSION
+      const std::vector<SolverStats> diffusionStats = backend.diffuse(vars);
+      if(!diffusionStats.empty()) {
+        std::cout << "t = " << t << ", vx diffusion: " << diffusionStats[0] << std::endl;
+        std::cout << "t = " << t << ", vy diffusion: " << diffusionStats[1] << std::endl;
+      }
+      backend.applyVelocityBC(vars);
+
+      // PROJECTION
+      backend.calcDivergence(divw, vars);
+      // Solve Poisson eq for pressure $\nabla^2 p = - \nabla \cdot v$
+      const SolverStats pStats = backend.solvePressure(pressure, divw);
+      std::cout << "t = " << t << ", pressure: " << pStats << std::endl;
+      vars.p.swapData(pressure);
+      backend.applyPressureBC(vars.p);
+      // Project onto incompressible velocity space
+      backend.project(vars);
+      backend.applyVelocityBC(vars);
+    }
+
+    void finish() {
+      backend.finish();
+    }
+
+    Variables<ArrayType>& variables() {
+      return vars;
+    }
+
+    // Divergence of the velocity before the last projection
+    ArrayType& divergence() {
+      return divw;
+    }
+
+  protected:
+    Backend backend;
+    Variables<ArrayType> vars;
+    ArrayType divw;
+    ArrayType pressure; // solved for, then swapped into vars.p
+};
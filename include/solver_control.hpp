@@ -0,0 +1,88 @@
+#pragma once
+
+#include <algorithm>
+#include <ostream>
+#include <vector>
+
+#include <precision.hpp>
+
+struct ResidualNorms {
+  real l2;
+  real max;
+};
+
+// Result of an iterative solve
+struct SolverStats {
+  int iterations;
+  ResidualNorms residual;
+};
+
+std::ostream& operator<<(std::ostream& os, const SolverStats& stats);
+
+// Stopping criteria for iterative solves. The residual is only checked every
+// checkInterval iterations to limit host-device synchronisation.
+class SolverControl {
+  public:
+    explicit SolverControl(const int maxIterations, const int checkInterval = 10, const real relTolerance = 1e-4f, const real absTolerance = 0.0f);
+
+    // Tolerances apply to the L2 norm. relTolerance is relative to the
+    // residual of the initial guess.
+    bool isConverged(const ResidualNorms& residual, const ResidualNorms& initial) const;
+
+    int maxIterations;
+    int checkInterval;
+    real relTolerance;
+    real absTolerance;
+};
+
+// Calls iterate(n) to advance a solve by n iterations until control is
+// satisfied. calcResidual() returns the residual norms of the current solution.
+template<class IterateFn, class ResidualFn>
+SolverStats iterateUntilConverged(const SolverControl& control, IterateFn iterate, ResidualFn calcResidual) {
+  const ResidualNorms initial = calcResidual();
+  SolverStats stats{0, initial};
+  while(stats.iterations < control.maxIterations && !control.isConverged(stats.residual, initial)) {
+    const int n = std::min(control.checkInterval, control.maxIterations - stats.iterations);
+    iterate(n);
+    stats.iterations += n;
+    stats.residual = calcResidual();
+  }
+  return stats;
+}
+
+// As iterateUntilConverged for several independent solves, advanced together
+// so that work enqueued on separate queues can overlap. iterate(k, n) advances
+// solve k by n iterations. calcResiduals() returns the residual norms of every
+// solve and should only block the host once for all of them.
+template<class IterateFn, class ResidualsFn>
+std::vector<SolverStats> iterateTogetherUntilConverged(const SolverControl& control, IterateFn iterate, ResidualsFn calcResiduals) {
+  const std::vector<ResidualNorms> initial = calcResiduals();
+  std::vector<SolverStats> stats;
+  for(const ResidualNorms& residual : initial) {
+    stats.push_back({0, residual});
+  }
+
+  std::vector<bool> active(stats.size());
+  bool anyActive = true;
+  while(anyActive) {
+    anyActive = false;
+    for(size_t k=0; k<stats.size(); ++k) {
+      active[k] = stats[k].iterations < control.maxIterations && !control.isConverged(stats[k].residual, initial[k]);
+      if(active[k]) {
+        const int n = std::min(control.checkInterval, control.maxIterations - stats[k].iterations);
+        iterate(k, n);
+        stats[k].iterations += n;
+        anyActive = true;
+      }
+    }
+    if(anyActive) {
+      const std::vector<ResidualNorms> residuals = calcResiduals();
+      for(size_t k=0; k<stats.size(); ++k) {
+        if(active[k]) {
+          stats[k].residual = residuals[k];
+        }
+      }
+    }
+  }
+  return stats;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include <H5Cpp.h>
+
+#include <precision.hpp>
+#include <array2d.hpp>
+#include <hdffile.hpp>
+
+// Appends frames of named fields to a single HDF5 file. Each field is stored
+// as an extensible (frame, nx, ny) dataset, chunked one frame at a time and
+// compressed with the shuffle and deflate filters. The 1D datasets "time" and
+// "step" record the simulation time and step of every frame.
+class TimeSeriesWriter {
+  public:
+    // With FileMode::Append, frames already in an existing file are kept
+    explicit TimeSeriesWriter(const std::string& filename, const FileMode mode = FileMode::Append, const int deflateLevel = 4);
+    // Start a new frame, fields written until the next call belong to it
+    void beginFrame(const real t, const int step);
+    // nx and ny include ghost cells, and must match earlier frames of the field
+    void write(const std::string& name, const real* data, const int nx, const int ny, const H5::PredType& type);
+    void write(const Array& arr);
+    void append(const real t, const int step, const std::vector<const Array*>& arrays);
+    // Drop every frame after the last one at or before step, such as those
+    // written after the checkpoint a run is restarting from
+    void discardFramesAfter(const int step);
+    int nFrames() const;
+    void flush();
+    void close();
+
+  protected:
+    H5::DataSet& series(const std::string& name, const int nx, const int ny, const H5::PredType& type);
+
+    HDFFile file;
+    const int deflateLevel;
+    int frames;
+    H5::DataSet times, steps;
+    std::map<std::string, H5::DataSet> fields;
+};
@@ -1,7 +1,51 @@
 #pragma once
 
+#include <functional>
+#include <vector>
+
+#include <solver_control.hpp>
+#include <vector_ocl_array.hpp>
+
+// Select the local-memory tiled variants of the stencil kernels
+void setUseTiledKernels(const bool useTiled);
+bool useTiledKernels();
+
 // User functions
+void applyJacobiStep(OpenCLArray& out, const OpenCLArray& in, const real alpha, const real beta, const real gamma, const OpenCLArray& b);
+// Over range, a range of out, only. Arrays must be stored in real.
+void applyJacobiStep(OpenCLArray& out, const OpenCLArray& in, const real alpha, const real beta, const real gamma, const OpenCLArray& b, const cl::EnqueueArgs& range);
 void runJacobiIteration(OpenCLArray& out, OpenCLArray& initialGuess, OpenCLArray& temp, const real alpha, const real beta, const real gamma, const OpenCLArray& b, const int iterations = 20);
+SolverStats runJacobiIteration(OpenCLArray& out, OpenCLArray& initialGuess, OpenCLArray& temp, const real alpha, const real beta, const real gamma, const OpenCLArray& b, const SolverControl& control);
+// sweeps Jacobi steps with von Neumann boundaries in one launch. Ghost cells of out are left untouched.
+void applyJacobiSweeps(OpenCLArray& out, const OpenCLArray& in, const real alpha, const real beta, const real gamma, const OpenCLArray& b, const int sweeps);
+// Jacobi with von Neumann boundaries, sweepsPerLaunch steps per kernel launch
+// (one for half arrays). out is the initial guess.
+SolverStats runBlockedJacobiIteration(OpenCLArray& out, OpenCLArray& temp, const real alpha, const real beta, const real gamma, const OpenCLArray& b, const int sweepsPerLaunch, const SolverControl& control);
+void applyRedBlackSORStep(OpenCLArray& out, const real alpha, const real beta, const real gamma, const OpenCLArray& b, const real omega, const int colour);
+// In-place red-black SOR, omega = 1 gives Gauss-Seidel. applyBC, if given, is applied before every sweep.
+void runSORIteration(OpenCLArray& out, const real alpha, const real beta, const real gamma, const OpenCLArray& b, const real omega, const int iterations = 20, const std::function<void(OpenCLArray&)>& applyBC = nullptr);
+SolverStats runSORIteration(OpenCLArray& out, const real alpha, const real beta, const real gamma, const OpenCLArray& b, const real omega, const SolverControl& control, const std::function<void(OpenCLArray&)>& applyBC = nullptr);
+// Residual norms reduced on the device into a's reduction buffer and read
+// back without blocking the host until get() is called
+class PendingNorms {
+  public:
+    explicit PendingNorms(const OpenCLArray& a);
+    PendingNorms(PendingNorms&&) = default;
+    PendingNorms(const PendingNorms&) = delete;
+    ResidualNorms get();
+
+  protected:
+    std::vector<real> partial;
+    cl::Event event;
+};
+
+// Residual norms over the interior, computed on the device
+PendingNorms enqueueJacobiResidualNorms(const OpenCLArray& in, const real alpha, const real beta, const real gamma, const OpenCLArray& b);
+ResidualNorms calcJacobiResidualNorms(const OpenCLArray& in, const real alpha, const real beta, const real gamma, const OpenCLArray& b);
+ResidualNorms calcNorms(const OpenCLArray& a);
+void applyJacobiOperator(OpenCLArray& out, const OpenCLArray& in, const real alpha, const real beta, const real gamma);
+real dotProduct(const OpenCLArray& a, const OpenCLArray& b);
+void axpby(OpenCLArray& out, const OpenCLArray& x, const real a, const real b);
 void calcDiffusionTerm(OpenCLArray& out, const OpenCLArray& f, const real dx, const real dy, const real Re);
 void calcAdvectionTerm(OpenCLArray& out, const OpenCLArray& f, const OpenCLArray& vx, const OpenCLArray& vy, const real dx, const real dy);
 void advanceEuler(OpenCLArray& out, const OpenCLArray& ddt, const real dt);
@@ -16,3 +60,12 @@ void applyProjectionX(OpenCLArray& out, OpenCLArray& f, const real dx);
 void applyProjectionY(OpenCLArray& out, OpenCLArray& f, const real dy);
 
 void advectImplicit(OpenCLArray& out, OpenCLArray& f, OpenCLArray& vx, OpenCLArray& vy, const real dx, const real dy, const real dt);
+// Advect both velocity components, and optionally a scalar on the same grid, from one back-trace
+void advectVelocityImplicit(OpenCLArray& outx, OpenCLArray& outy, OpenCLArray& vx, OpenCLArray& vy, const real dx, const real dy, const real dt);
+void advectVelocityImplicit(OpenCLArray& outx, OpenCLArray& outy, OpenCLArray& outf, OpenCLArray& vx, OpenCLArray& vy, OpenCLArray& f, const real dx, const real dy, const real dt);
+
+// Interleaved velocity, on the same grids as the split versions above
+void advectVelocityImplicit(VectorOpenCLArray& out, VectorOpenCLArray& v, const real dx, const real dy, const real dt);
+void calcDivergence(OpenCLArray& out, VectorOpenCLArray& v, const real dx, const real dy);
+// applyProjectionX and applyProjectionY in one launch
+void applyProjection(VectorOpenCLArray& v, OpenCLArray& f, const real dx, const real dy);
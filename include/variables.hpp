@@ -1,18 +1,27 @@
 #pragma once
 
 #include <memory>
+#include <string>
 
 #include <precision.hpp>
+#include <constants.hpp>
 #include <array2d.hpp>
 
+// A field of the solver's grid, nx x ny with c's ghost cells and members, zeroed.
+// Array types may specialise this to take further settings from c.
+template <class T>
+T makeField(const Constants& c, const int nx, const int ny, const std::string& name) {
+  return T(nx, ny, c.ng, name, 0.0f, c.nMembers);
+}
+
 template <class T>
 class Variables {
   public:
     T vx, vy, p;
 
   Variables<T>(const Constants& c):
-    vx(c.nx, c.ny, c.ng, "vx"),
-    vy(c.nx, c.ny, c.ng, "vy"),
-    p(c.nx+1, c.ny+1, c.ng, "pressure")
+    vx(makeField<T>(c, c.nx, c.ny, "vx")),
+    vy(makeField<T>(c, c.nx, c.ny, "vy")),
+    p(makeField<T>(c, c.nx+1, c.ny+1, "pressure"))
   {}
 };
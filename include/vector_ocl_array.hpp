@@ -0,0 +1,56 @@
+#pragma once
+
+#include <array>
+#include <string>
+
+#include <ocl_array.hpp>
+
+// A pair of fields sharing a grid, such as the two velocity components,
+// interleaved on the device as real2. Each cell's components sit in one cache
+// line, so kernels gathering both (advection back-traces above all) fetch half
+// the lines they would from two OpenCLArrays. The layout, ghost cells and
+// members match OpenCLArray. Data lives only on the device: pack from and
+// unpack to a pair of OpenCLArrays to initialise, save or diffuse it.
+class VectorOpenCLArray {
+  public:
+    VectorOpenCLArray(const int nx, const int ny, const int ng = 0, const std::string& name = "", const int nMembers = 1);
+
+    // Copy every cell, ghosts included, from or to the component arrays, which
+    // must match in size, ng and nMembers. Enqueued on this array's queue.
+    void pack(const OpenCLArray& x, const OpenCLArray& y);
+    void unpack(OpenCLArray& x, OpenCLArray& y) const;
+
+    // Each component keeps its own boundary descriptors, copied from a pair of
+    // OpenCLArrays. Both default to Dirichlet 0.
+    void copyBoundaryConditions(const OpenCLArray& x, const OpenCLArray& y);
+    void applyBoundaryConditions();
+
+    const cl::Buffer& getDeviceData() const;
+    cl::Buffer& getDeviceData();
+    const std::string& getName() const;
+    void swapData(VectorOpenCLArray& arr);
+
+    // As for OpenCLArray, changing queue rebuilds the ranges below
+    void setQueue(const cl::CommandQueue& newQueue);
+    const cl::CommandQueue& getQueue() const;
+
+    const int nx;
+    const int ny;
+    const int ng;
+    const int nMembers;
+
+  protected:
+    cl::CommandQueue queue; // must be initialised before the ranges
+
+  public:
+    cl::EnqueueArgs interior;
+    cl::EnqueueArgs entire; // every cell including ghosts
+
+  protected:
+    void requireSameShape(const OpenCLArray& arr, const std::string& operation) const;
+
+    std::string name;
+    cl::Buffer d_data; // real2 per cell
+    std::array<cl::Buffer, 2> d_boundaryTypes; // descriptors of x then y
+    std::array<cl::Buffer, 2> d_boundaryValues;
+};
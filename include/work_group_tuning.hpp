@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+
+#include <ocl_utility.hpp>
+#include <constants.hpp>
+
+// Local work-group sizes of the ranges of OpenCLArray (interior, entire,
+// redBlackInterior and the boundary rows and columns), looked up by the
+// global size of the range when it is made. Every kernel launched on a range
+// shares its local size, so each is tuned for the total time of the kernels
+// launched on that range. Local sizes divide the global size exactly, as the
+// kernels do not check bounds.
+
+// Local size for a range of the given global size on queue's device: the
+// tuned size if there is one for that device, otherwise cl::NullRange
+cl::NDRange tunedLocalRange(const cl::CommandQueue& queue, const cl::NDRange& global);
+
+// Loads the local sizes in path if they were tuned on the default device,
+// then times each candidate size on the ranges of arrays of c's grid that
+// path lacks and rewrites path with the fastest. Arrays made afterwards use
+// the loaded and tuned sizes. Candidates are repeated the given number of
+// times on the default device. Sizes are capped by every program c's solver
+// may launch, so with c.specialiseKernels its linear systems are registered
+// (specialiseSolves) and their builds made here.
+void tuneWorkGroupSizes(const std::string& path, const Constants& c, const int repeats = 10);
+
+// Back to the driver's choice for every range
+void clearWorkGroupSizes();
@@ -1,29 +1,59 @@
+#include <algorithm>
 #include <iostream>
 #include <H5Cpp.h>
 
 #include <array2d.hpp>
 #include <constants.hpp>
+#include <hdffile.hpp>
 
-Array::Array(const int nx_in, const int ny_in, const int ng_in, const std::string& name_in, real initialVal):
+const int REALS_PER_BLOCK = SIMD_ALIGNMENT/sizeof(real);
+
+// Row length rounded up to a whole number of aligned blocks
+int paddedRowLength(const int n) {
+  return (n + REALS_PER_BLOCK-1)/REALS_PER_BLOCK*REALS_PER_BLOCK;
+}
+
+Array::Array(const int nx_in, const int ny_in, const int ng_in, const std::string& name_in, real initialVal, const int nMembers_in, const bool packed):
   nx{nx_in},
   ny{ny_in},
   ng{ng_in},
+  nMembers{nMembers_in},
+  rowOffset{packed ? 0 : (REALS_PER_BLOCK - ng%REALS_PER_BLOCK)%REALS_PER_BLOCK},
+  rowStride{packed ? rowLength() : paddedRowLength(rowOffset + rowLength())},
   data(size()),
-  h5ArrayType(H5::PredType::NATIVE_FLOAT)
+  h5ArrayType(h5NativeType<real>())
 {
   setName(name_in);
   fill(initialVal);
 }
 
+// Interior rows are shared between threads with the same static schedule
+// over the same bounds as forEachTile, so filling a new Array first-touches
+// each page on the NUMA node of the thread that will compute on it. The ghost
+// rows are filled afterwards, so they don't claim the pages they share with
+// interior rows.
 void Array::fill(real val) {
-  for (int i=0; i<size(); ++i) {
-    data[i] = val;
+  const int interiorRows = I_CONTIGUOUS ? ny : nx;
+  const int memberRows = interiorRows + 2*ng;
+#pragma omp parallel
+  for (int m=0; m<nMembers; ++m) {
+    real* first = data.data() + (m*memberRows + ng)*rowStride;
+#pragma omp for schedule(static) nowait
+    for (int n=0; n<interiorRows; ++n) {
+      std::fill_n(first + n*rowStride, rowStride, val);
+    }
+  }
+  for (int m=0; m<nMembers; ++m) {
+    for (int g=0; g<ng; ++g) {
+      std::fill_n(data.begin() + (m*memberRows + g)*rowStride, rowStride, val);
+      std::fill_n(data.begin() + (m*memberRows + ng + interiorRows + g)*rowStride, rowStride, val);
+    }
   }
 }
 
 int Array::size() const {
-  // 1 set of ghost cells at each boundary
-  return (nx+2*ng)*(ny+2*ng);
+  // 1 set of ghost cells at each boundary, for every member
+  return rows()*rowStride;
 }
 
 real Array::sum() const {
@@ -38,7 +68,30 @@ real Array::sum() const {
 }
 
 int Array::idx(const int i, const int j) const {
-  return (i+ng)*(ny+2*ng) + (j+ng);
+  return rowOffset + (i+ng)*strideI() + (j+ng)*strideJ();
+}
+
+int Array::idx(const int i, const int j, const int member) const {
+  if(I_CONTIGUOUS) {
+    return idx(i, j + member*(ny+2*ng));
+  }
+  return idx(i + member*(nx+2*ng), j);
+}
+
+int Array::strideI() const {
+  return I_CONTIGUOUS ? 1 : rowStride;
+}
+
+int Array::strideJ() const {
+  return I_CONTIGUOUS ? rowStride : 1;
+}
+
+int Array::rows() const {
+  return nMembers*(I_CONTIGUOUS ? ny + 2*ng : nx + 2*ng);
+}
+
+int Array::rowLength() const {
+  return I_CONTIGUOUS ? nx + 2*ng : ny + 2*ng;
 }
 
 real Array::operator()(const int i, const int j) const {
@@ -49,6 +102,14 @@ real& Array::operator()(const int i, const int j) {
   return data[idx(i,j)];
 }
 
+real Array::operator()(const int i, const int j, const int member) const {
+  return data[idx(i,j,member)];
+}
+
+real& Array::operator()(const int i, const int j, const int member) {
+  return data[idx(i,j,member)];
+}
+
 Array& Array::operator=(const Array& arr) {
   for (int i=0; i<nx; ++i) {
     for (int j=0; j<ny; ++j) {
@@ -70,14 +131,7 @@ void Array::saveTo(H5::H5File& file) const {
   if (!hasName) {
     throw std::runtime_error("Cannot save unnamed Array");
   }
-  hsize_t dims[2];
-  dims[0] = nx + 2*ng;
-  dims[1] = ny + 2*ng;
-  H5::DataSpace dataspace(2, dims);
-  H5::FloatType datatype(h5ArrayType);
-  datatype.setOrder(H5T_ORDER_LE);
-  H5::DataSet ds = file.createDataSet(name.c_str(), datatype, dataspace);
-  ds.write(data.data(), h5ArrayType);
+  writeDataset(file, name, data.data(), rows(), rowLength(), h5ArrayType, rowStride, rowOffset);
 }
 
 void Array::load(H5::H5File& file) {
@@ -88,12 +142,42 @@ void Array::load(H5::H5File& file) {
   H5::DataSpace filespace = ds.getSpace();
   int ndims = filespace.getSimpleExtentNdims();
   hsize_t dims[2];
+  if(ndims != 2) {
+    throw std::runtime_error("Cannot load " + name + ": Dataset is not 2D");
+  }
   filespace.getSimpleExtentDims(dims);
+  if(dims[0] != hsize_t(rows()) || dims[1] != hsize_t(rowLength())) {
+    throw std::runtime_error("Cannot load " + name + ": Size differs from Array");
+  }
 
-  H5::DataSpace memspace (ndims, dims);
+  // Padding around each row is left untouched
+  hsize_t memDims[2] = {dims[0], hsize_t(rowStride)};
+  hsize_t start[2] = {0, hsize_t(rowOffset)};
+  H5::DataSpace memspace(ndims, memDims);
+  memspace.selectHyperslab(H5S_SELECT_SET, dims, start);
   ds.read(data.data(), h5ArrayType, memspace, filespace);
 }
 
+const std::string& Array::getName() const {
+  return name;
+}
+
+const H5::PredType& Array::getH5Type() const {
+  return h5ArrayType;
+}
+
+const real* Array::getData() const {
+  return data.data();
+}
+
+const real* Array::ptr(const int i, const int j) const {
+  return data.data() + idx(i, j);
+}
+
+real* Array::ptr(const int i, const int j) {
+  return data.data() + idx(i, j);
+}
+
 void Array::setName(const std::string& name) {
   this->name = name;
   hasName = name != "";
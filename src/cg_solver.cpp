@@ -1,31 +1,76 @@
+#include <cmath>
+#include <stdexcept>
+
 #include <cg_solver.hpp>
-#include <array2d.hpp>
-
-//void CGSolver::solve(Array& out, kernelFn A, const Array& b) {
-  //auto sqrKernel = [&](const Array& f, const int i, const int j) {
-    //return f(i,j)*f(i,j);
-  //}
-  //// out also acts as initial guess
-  //res.applyKernel([&](Array& f, const int i, const int j) {
-      //f(i,j) = b(i,j) - A(out,i,j);
-  //});
-  //d = res; // copy to initial d
-  //for(int i=0; i<nIterations; ++i) {
-    //res.applyKernel(sqr, res2); 
-    //resTres = res2.sum(); // find residual norm
-    //d.applyKernel(A, p);
-
-    //p.applyKernel(
-    //dTp = 
-    //dTp = sum(d*p);
-    //alpha = resTres/pTp;
-    //x += alpha*d; // Calc new pos
-    //res += -alpha*p; // calc new residual
-    //resTresPrev = resTres; // save old resNorm for beta calculation
-
-    //res.applyKernel(sqr, res2); 
-    //resTres = res2.sum(); // find residual norm
-    //beta = resTres/resTresOld;
-    //d = res + beta * d;
-  //}
-//}
+#include <user_kernels.hpp>
+
+LinearOperator makeJacobiOperator(const real alpha, const real beta, const real gamma, std::function<void(OpenCLArray&)> applyBC) {
+  return [=](OpenCLArray& out, OpenCLArray& in) {
+    if(applyBC) {
+      applyBC(in);
+    }
+    applyJacobiOperator(out, in, alpha, beta, gamma);
+  };
+}
+
+CGSolver::CGSolver(const int nx, const int ny, const int ng):
+  res(nx, ny, ng),
+  dir(nx, ny, ng),
+  Adir(nx, ny, ng),
+  z(nx, ny, ng)
+{}
+
+size_t CGSolver::deviceBytes() const {
+  return res.deviceBytes() + dir.deviceBytes() + Adir.deviceBytes() + z.deviceBytes();
+}
+
+void CGSolver::setQueue(const cl::CommandQueue& queue) {
+  for(OpenCLArray* arr : {&res, &dir, &Adir, &z}) {
+    arr->setQueue(queue);
+  }
+}
+
+SolverStats CGSolver::solve(OpenCLArray& out, const LinearOperator& A, const OpenCLArray& b, const SolverControl& control, const LinearOperator& preconditioner) {
+  if(out.nMembers != 1) {
+    // Step lengths come from dot products, which are summed over all members
+    throw std::runtime_error("CG cannot solve for an ensemble");
+  }
+  // Without a preconditioner z is just the residual
+  OpenCLArray& precRes = preconditioner ? z : res;
+
+  // res = b - A(out)
+  A(Adir, out);
+  axpby(res, b, 1.0f, 0.0f);
+  axpby(res, Adir, -1.0f, 1.0f);
+
+  if(preconditioner) {
+    preconditioner(z, res);
+  }
+  axpby(dir, precRes, 1.0f, 0.0f);
+
+  real resTres = dotProduct(res, res);
+  real resTz = preconditioner ? dotProduct(res, z) : resTres;
+  const ResidualNorms initial{std::sqrt(resTres), 0.0f};
+
+  int iteration = 0;
+  while(iteration < control.maxIterations && !control.isConverged({std::sqrt(resTres), 0.0f}, initial)) {
+    A(Adir, dir);
+    real alpha = resTz/dotProduct(dir, Adir);
+    axpby(out, dir, alpha, 1.0f); // Calc new pos
+    axpby(res, Adir, -alpha, 1.0f); // Calc new residual
+
+    resTres = dotProduct(res, res);
+    real resTzOld = resTz;
+    if(preconditioner) {
+      preconditioner(z, res);
+      resTz = dotProduct(res, z);
+    } else {
+      resTz = resTres;
+    }
+    real beta = resTz/resTzOld;
+    axpby(dir, precRes, 1.0f, beta);
+    ++iteration;
+  }
+
+  return {iteration, calcNorms(res)};
+}
@@ -0,0 +1,41 @@
+#include <cstdio>
+#include <stdexcept>
+
+#include <checkpoint.hpp>
+#include <hdffile.hpp>
+
+void writeCheckpoint(const std::string& filename, Variables<OpenCLArray>& vars, const RunState& state, const Constants& c) {
+  const std::string tempFilename = filename + ".tmp";
+  HDFFile file(tempFilename, false);
+  c.saveTo(file.file);
+  writeAttribute(file.file, "t", state.t);
+  writeAttribute(file.file, "step", state.step);
+  vars.vx.saveTo(file.file);
+  vars.vy.saveTo(file.file);
+  vars.p.saveTo(file.file);
+  file.close();
+
+  if(std::rename(tempFilename.c_str(), filename.c_str()) != 0) {
+    throw std::runtime_error("Cannot write checkpoint " + filename + ": Rename failed");
+  }
+}
+
+Constants readCheckpointConstants(const std::string& filename) {
+  Constants c;
+  HDFFile file(filename);
+  c.load(file.file);
+  file.close();
+  return c;
+}
+
+RunState readCheckpoint(const std::string& filename, Variables<OpenCLArray>& vars) {
+  RunState state;
+  HDFFile file(filename);
+  readAttribute(file.file, "t", state.t);
+  readAttribute(file.file, "step", state.step);
+  vars.vx.load(file.file);
+  vars.vy.load(file.file);
+  vars.p.load(file.file);
+  file.close();
+  return state;
+}
@@ -1,6 +1,7 @@
 #include <iostream>
 
 #include <constants.hpp>
+#include <hdffile.hpp>
 
 Constants::Constants():
   nx{128},
@@ -9,8 +10,27 @@ Constants::Constants():
   dt{0.01},
   totalTime{1},
   Re{100},
+  nMembers{1},
+  lidVelocity{1},
+  lidVelocityStep{0},
   isAdvectionImplicit{true},
-  isDiffusionImplicit{true}
+  isDiffusionImplicit{true},
+  pressureSolver{SolverType::Multigrid},
+  diffusionSolver{SolverType::RedBlackSOR},
+  relaxationFactor{1.0},
+  jacobiSweepsPerLaunch{4},
+  pressureControl{20, 1, 1e-4},
+  isPressureMixedPrecision{false},
+  refinementControl{10, 1, 1e-8},
+  diffusionControl{100, 5, 1e-4},
+  useTiledKernels{false},
+  specialiseKernels{false},
+  isHalfStorage{false},
+  outputInterval{0},
+  timeSeriesFile{"timeseries.hdf5"},
+  checkpointInterval{0},
+  checkpointWallTime{0},
+  checkpointFile{"checkpoint.hdf5"}
 {
   dx = 1.0/(nx+1);
   dy = 1.0/(ny+1);
@@ -25,4 +45,93 @@ void Constants::print() const {
   std::cout << "Re: " << Re << std::endl;
   std::cout << "nu: " << 1.0f/Re << std::endl;
   std::cout << "Numerical nu: " << dx*dy/dt << std::endl;
+  std::cout << "Ensemble members: " << nMembers << std::endl;
+  if(nMembers > 1) {
+    std::cout << "Lid velocities: " << lidVelocity << " to " << lidVelocity + (nMembers-1)*lidVelocityStep << ", Re and dt shared" << std::endl;
+  }
+  std::cout << "Precision: " << clTypeName<real>() << (isPressureMixedPrecision ? ", pressure refined in double" : "") << std::endl;
+  std::cout << "Tiled kernels: " << (useTiledKernels ? "on" : "off") << std::endl;
+  std::cout << "Specialised kernels: " << (specialiseKernels ? "on" : "off") << std::endl;
+  std::cout << "Field storage: " << (isHalfStorage ? "half" : clTypeName<real>()) << std::endl;
+}
+
+void saveControl(H5::H5File& file, const std::string& prefix, const SolverControl& control) {
+  writeAttribute(file, prefix + "MaxIterations", control.maxIterations);
+  writeAttribute(file, prefix + "CheckInterval", control.checkInterval);
+  writeAttribute(file, prefix + "RelTolerance", control.relTolerance);
+  writeAttribute(file, prefix + "AbsTolerance", control.absTolerance);
+}
+
+void loadControl(H5::H5File& file, const std::string& prefix, SolverControl& control) {
+  readAttribute(file, prefix + "MaxIterations", control.maxIterations);
+  readAttribute(file, prefix + "CheckInterval", control.checkInterval);
+  readAttribute(file, prefix + "RelTolerance", control.relTolerance);
+  readAttribute(file, prefix + "AbsTolerance", control.absTolerance);
+}
+
+void Constants::saveTo(H5::H5File& file) const {
+  writeAttribute(file, "nx", nx);
+  writeAttribute(file, "ny", ny);
+  writeAttribute(file, "ng", ng);
+  writeAttribute(file, "dx", dx);
+  writeAttribute(file, "dy", dy);
+  writeAttribute(file, "dt", dt);
+  writeAttribute(file, "totalTime", totalTime);
+  writeAttribute(file, "Re", Re);
+  writeAttribute(file, "nMembers", nMembers);
+  writeAttribute(file, "lidVelocity", lidVelocity);
+  writeAttribute(file, "lidVelocityStep", lidVelocityStep);
+  writeAttribute(file, "isAdvectionImplicit", isAdvectionImplicit);
+  writeAttribute(file, "isDiffusionImplicit", isDiffusionImplicit);
+  writeAttribute(file, "pressureSolver", static_cast<int>(pressureSolver));
+  writeAttribute(file, "diffusionSolver", static_cast<int>(diffusionSolver));
+  writeAttribute(file, "relaxationFactor", relaxationFactor);
+  writeAttribute(file, "jacobiSweepsPerLaunch", jacobiSweepsPerLaunch);
+  saveControl(file, "pressure", pressureControl);
+  writeAttribute(file, "isPressureMixedPrecision", isPressureMixedPrecision);
+  saveControl(file, "refinement", refinementControl);
+  saveControl(file, "diffusion", diffusionControl);
+  writeAttribute(file, "useTiledKernels", useTiledKernels);
+  writeAttribute(file, "specialiseKernels", specialiseKernels);
+  writeAttribute(file, "isHalfStorage", isHalfStorage);
+  writeAttribute(file, "outputInterval", outputInterval);
+  writeAttribute(file, "timeSeriesFile", timeSeriesFile);
+  writeAttribute(file, "checkpointInterval", checkpointInterval);
+  writeAttribute(file, "checkpointWallTime", checkpointWallTime);
+  writeAttribute(file, "checkpointFile", checkpointFile);
+}
+
+void Constants::load(H5::H5File& file) {
+  int solver;
+  readAttribute(file, "nx", nx);
+  readAttribute(file, "ny", ny);
+  readAttribute(file, "ng", ng);
+  readAttribute(file, "dx", dx);
+  readAttribute(file, "dy", dy);
+  readAttribute(file, "dt", dt);
+  readAttribute(file, "totalTime", totalTime);
+  readAttribute(file, "Re", Re);
+  readAttribute(file, "nMembers", nMembers);
+  readAttribute(file, "lidVelocity", lidVelocity);
+  readAttribute(file, "lidVelocityStep", lidVelocityStep);
+  readAttribute(file, "isAdvectionImplicit", isAdvectionImplicit);
+  readAttribute(file, "isDiffusionImplicit", isDiffusionImplicit);
+  readAttribute(file, "pressureSolver", solver);
+  pressureSolver = static_cast<SolverType>(solver);
+  readAttribute(file, "diffusionSolver", solver);
+  diffusionSolver = static_cast<SolverType>(solver);
+  readAttribute(file, "relaxationFactor", relaxationFactor);
+  readAttribute(file, "jacobiSweepsPerLaunch", jacobiSweepsPerLaunch);
+  loadControl(file, "pressure", pressureControl);
+  readAttribute(file, "isPressureMixedPrecision", isPressureMixedPrecision);
+  loadControl(file, "refinement", refinementControl);
+  loadControl(file, "diffusion", diffusionControl);
+  readAttribute(file, "useTiledKernels", useTiledKernels);
+  readAttribute(file, "specialiseKernels", specialiseKernels);
+  readAttribute(file, "isHalfStorage", isHalfStorage);
+  readAttribute(file, "outputInterval", outputInterval);
+  readAttribute(file, "timeSeriesFile", timeSeriesFile);
+  readAttribute(file, "checkpointInterval", checkpointInterval);
+  readAttribute(file, "checkpointWallTime", checkpointWallTime);
+  readAttribute(file, "checkpointFile", checkpointFile);
 }
@@ -0,0 +1,226 @@
+#ifdef FAFS_USE_MPI
+
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+#include <decomposition.hpp>
+
+Decomposition::Decomposition(MPI_Comm comm_in, const int nx_in, const int ny_in):
+  globalNx{nx_in},
+  globalNy{ny_in}
+{
+  int worldSize;
+  MPI_Comm_size(comm_in, &worldSize);
+  dims[0] = 0;
+  dims[1] = 0;
+  MPI_Dims_create(worldSize, 2, dims);
+  const int periods[2] = {0, 0};
+  MPI_Cart_create(comm_in, 2, dims, periods, 0, &comm);
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &size);
+  MPI_Cart_coords(comm, rank, 2, coords);
+
+  splitEvenly(globalNx, dims[0], coords[0], nx, i0);
+  splitEvenly(globalNy, dims[1], coords[1], ny, j0);
+  // Stencils reach one cell past the edge of a block, so every block needs
+  // at least two nodes along each axis for its halo to come from one neighbour
+  if(globalNx/dims[0] < 2 || globalNy/dims[1] < 2) {
+    throw std::runtime_error("Cannot split a " + std::to_string(globalNx) + "x" + std::to_string(globalNy) +
+        " grid into " + std::to_string(dims[0]) + "x" + std::to_string(dims[1]) + " blocks");
+  }
+
+  physical[int(BoundarySide::Lower)] = neighbour(0, -1) == MPI_PROC_NULL;
+  physical[int(BoundarySide::Upper)] = neighbour(0, 1) == MPI_PROC_NULL;
+  physical[int(BoundarySide::Left)] = neighbour(-1, 0) == MPI_PROC_NULL;
+  physical[int(BoundarySide::Right)] = neighbour(1, 0) == MPI_PROC_NULL;
+}
+
+Decomposition::~Decomposition() {
+  MPI_Comm_free(&comm);
+}
+
+Constants Decomposition::localConstants(const Constants& c) const {
+  if(c.nx != globalNx || c.ny != globalNy) {
+    throw std::runtime_error("Constants do not match the decomposed grid");
+  }
+  Constants local = c;
+  local.nx = nx;
+  local.ny = ny;
+  return local;
+}
+
+int Decomposition::neighbour(const int di, const int dj) const {
+  const int c[2] = {coords[0] + di, coords[1] + dj};
+  if(c[0] < 0 || c[0] >= dims[0] || c[1] < 0 || c[1] >= dims[1]) {
+    return MPI_PROC_NULL;
+  }
+  int r;
+  MPI_Cart_rank(comm, c, &r);
+  return r;
+}
+
+const PhysicalSides& Decomposition::physicalSides() const {
+  return physical;
+}
+
+CellRange Decomposition::ownedRange(const Array& block) const {
+  // 1 for cell-centred arrays, whose first cell is the last of the block below
+  const int overlapI = block.nx - nx;
+  const int overlapJ = block.ny - ny;
+  return {
+    physical[int(BoundarySide::Left)] ? 0 : overlapI,
+    physical[int(BoundarySide::Lower)] ? 0 : overlapJ,
+    block.nx,
+    block.ny
+  };
+}
+
+ResidualNorms Decomposition::allReduce(const ResidualNorms& local) const {
+  double sumSquares = double(local.l2)*local.l2;
+  real mx = local.max;
+  MPI_Allreduce(MPI_IN_PLACE, &sumSquares, 1, MPI_DOUBLE, MPI_SUM, comm);
+  MPI_Allreduce(MPI_IN_PLACE, &mx, 1, mpiType<real>(), MPI_MAX, comm);
+  return {real(std::sqrt(sumSquares)), mx};
+}
+
+void Decomposition::gather(const Array& block, Array* whole) const {
+  CellRange range = ownedRange(block);
+  const int ng = block.ng;
+  if(physical[int(BoundarySide::Left)]) range.i0 -= ng;
+  if(physical[int(BoundarySide::Right)]) range.i1 += ng;
+  if(physical[int(BoundarySide::Lower)]) range.j0 -= ng;
+  if(physical[int(BoundarySide::Upper)]) range.j1 += ng;
+
+  // Offset of the range in the whole array, then the range's size
+  int header[4] = {i0 + range.i0, j0 + range.j0, range.i1 - range.i0, range.j1 - range.j0};
+  std::vector<real> buffer;
+  buffer.reserve(header[2]*header[3]);
+  for(int i=range.i0; i<range.i1; ++i) {
+    for(int j=range.j0; j<range.j1; ++j) {
+      buffer.push_back(block(i, j));
+    }
+  }
+
+  const int tag = 0;
+  if(rank != 0) {
+    MPI_Send(header, 4, MPI_INT, 0, tag, comm);
+    MPI_Send(buffer.data(), int(buffer.size()), mpiType<real>(), 0, tag, comm);
+    return;
+  }
+  for(int r=0; r<size; ++r) {
+    if(r != 0) {
+      MPI_Recv(header, 4, MPI_INT, r, tag, comm, MPI_STATUS_IGNORE);
+      buffer.resize(header[2]*header[3]);
+      MPI_Recv(buffer.data(), int(buffer.size()), mpiType<real>(), r, tag, comm, MPI_STATUS_IGNORE);
+    }
+    int k = 0;
+    for(int i=0; i<header[2]; ++i) {
+      for(int j=0; j<header[3]; ++j) {
+        (*whole)(header[0] + i, header[1] + j) = buffer[k++];
+      }
+    }
+  }
+}
+
+// Range along one axis of an array of n cells with ng ghosts, for the
+// neighbour in direction d: edge cells sent to it, or ghost cells received
+// from it. overlap cells at each end are shared with the neighbour, so are
+// skipped when sending.
+void haloSpan(const int d, const int n, const int ng, const int overlap, const bool isSend, int& k0, int& k1) {
+  if(d == 0) {
+    k0 = 0;
+    k1 = n;
+  } else if(d < 0) {
+    k0 = isSend ? overlap : -ng;
+    k1 = k0 + ng;
+  } else {
+    k0 = isSend ? n - overlap - ng : n;
+    k1 = k0 + ng;
+  }
+}
+
+void pack(const Array& a, const CellRange& range, std::vector<real>& buffer) {
+  int k = 0;
+  for(int i=range.i0; i<range.i1; ++i) {
+    for(int j=range.j0; j<range.j1; ++j) {
+      buffer[k++] = a(i, j);
+    }
+  }
+}
+
+void unpack(const std::vector<real>& buffer, const CellRange& range, Array& a) {
+  int k = 0;
+  for(int i=range.i0; i<range.i1; ++i) {
+    for(int j=range.j0; j<range.j1; ++j) {
+      a(i, j) = buffer[k++];
+    }
+  }
+}
+
+HaloExchange::HaloExchange(const Decomposition& d, const int nx, const int ny, const int ng):
+  d(d),
+  nx{nx},
+  ny{ny},
+  ng{ng}
+{
+  const int overlapI = nx - d.nx;
+  const int overlapJ = ny - d.ny;
+  for(int di=-1; di<=1; ++di) {
+    for(int dj=-1; dj<=1; ++dj) {
+      const int k = (di+1)*3 + (dj+1);
+      ranks[k] = di == 0 && dj == 0 ? MPI_PROC_NULL : d.neighbour(di, dj);
+      CellRange& send = sendRanges[k];
+      CellRange& recv = recvRanges[k];
+      haloSpan(di, nx, ng, overlapI, true, send.i0, send.i1);
+      haloSpan(dj, ny, ng, overlapJ, true, send.j0, send.j1);
+      haloSpan(di, nx, ng, overlapI, false, recv.i0, recv.i1);
+      haloSpan(dj, ny, ng, overlapJ, false, recv.j0, recv.j1);
+      if(ranks[k] != MPI_PROC_NULL) {
+        sendBuffers[k].resize((send.i1 - send.i0)*(send.j1 - send.j0));
+        recvBuffers[k].resize((recv.i1 - recv.i0)*(recv.j1 - recv.j0));
+      }
+    }
+  }
+}
+
+void HaloExchange::begin(const Array& a) {
+  if(a.nx != nx || a.ny != ny || a.ng != ng) {
+    throw std::runtime_error("Cannot exchange the halo of " + a.getName() + ": Size differs from the exchange");
+  }
+  if(!requests.empty()) {
+    throw std::runtime_error("Cannot exchange the halo of " + a.getName() + ": An exchange is in progress");
+  }
+  // Messages are tagged with the direction they travel in, so the message
+  // from the neighbour in direction k is tagged with the opposite direction
+  for(int k=0; k<N_DIRECTIONS; ++k) {
+    if(ranks[k] != MPI_PROC_NULL) {
+      requests.emplace_back();
+      MPI_Irecv(recvBuffers[k].data(), int(recvBuffers[k].size()), mpiType<real>(), ranks[k], N_DIRECTIONS-1-k, d.comm, &requests.back());
+    }
+  }
+  for(int k=0; k<N_DIRECTIONS; ++k) {
+    if(ranks[k] != MPI_PROC_NULL) {
+      pack(a, sendRanges[k], sendBuffers[k]);
+      requests.emplace_back();
+      MPI_Isend(sendBuffers[k].data(), int(sendBuffers[k].size()), mpiType<real>(), ranks[k], k, d.comm, &requests.back());
+    }
+  }
+}
+
+void HaloExchange::finish(Array& a) {
+  MPI_Waitall(int(requests.size()), requests.data(), MPI_STATUSES_IGNORE);
+  requests.clear();
+  for(int k=0; k<N_DIRECTIONS; ++k) {
+    if(ranks[k] != MPI_PROC_NULL) {
+      unpack(recvBuffers[k], recvRanges[k], a);
+    }
+  }
+}
+
+void HaloExchange::exchange(Array& a) {
+  begin(a);
+  finish(a);
+}
+
+#endif
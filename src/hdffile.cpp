@@ -1,3 +1,4 @@
+#include <fstream>
 #include <stdexcept>
 #include <hdffile.hpp>
 
@@ -8,12 +9,25 @@ HDFFile::HDFFile(const std::string& name_in, const bool readOnly):
   open(name_in, readOnly);
 }
 
+HDFFile::HDFFile(const std::string& name_in, const FileMode mode):
+  name{name_in},
+  isOpen{false}
+{
+  open(name_in, mode);
+}
+
 void HDFFile::open(const std::string& name, const bool readOnly) {
+  open(name, readOnly ? FileMode::ReadOnly : FileMode::Truncate);
+}
+
+void HDFFile::open(const std::string& name, const FileMode mode) {
   if(isOpen) {
     throw std::runtime_error("Cannot open " + name + ": File not closed!");
   }
-  if(readOnly) {
+  if(mode == FileMode::ReadOnly) {
     file = H5::H5File(name.c_str(), H5F_ACC_RDONLY);
+  } else if(mode == FileMode::Append && std::ifstream(name).good()) {
+    file = H5::H5File(name.c_str(), H5F_ACC_RDWR);
   } else {
     file = H5::H5File(name.c_str(), H5F_ACC_TRUNC);
   }
@@ -26,3 +40,71 @@ void HDFFile::close() {
     isOpen = false;
   }
 }
+
+void writeDataset(H5::H5File& file, const std::string& name, const real* data, const int nx, const int ny, const H5::PredType& type) {
+  writeDataset(file, name, data, nx, ny, type, ny);
+}
+
+void writeDataset(H5::H5File& file, const std::string& name, const real* data, const int nx, const int ny, const H5::PredType& type, const int rowStride, const int rowOffset) {
+  hsize_t dims[2];
+  dims[0] = nx;
+  dims[1] = ny;
+  H5::DataSpace dataspace(2, dims);
+  H5::FloatType datatype(type);
+  datatype.setOrder(H5T_ORDER_LE);
+  H5::DataSet ds = file.createDataSet(name.c_str(), datatype, dataspace);
+
+  hsize_t memDims[2] = {dims[0], hsize_t(rowStride)};
+  hsize_t start[2] = {0, hsize_t(rowOffset)};
+  H5::DataSpace memspace(2, memDims);
+  memspace.selectHyperslab(H5S_SELECT_SET, dims, start);
+  ds.write(data, type, memspace, dataspace);
+}
+
+void writeAttribute(H5::H5Object& obj, const std::string& name, const int value) {
+  H5::Attribute attr = obj.createAttribute(name.c_str(), H5::PredType::STD_I32LE, H5::DataSpace(H5S_SCALAR));
+  attr.write(H5::PredType::NATIVE_INT, &value);
+}
+
+void writeAttribute(H5::H5Object& obj, const std::string& name, const bool value) {
+  writeAttribute(obj, name, static_cast<int>(value));
+}
+
+void writeAttribute(H5::H5Object& obj, const std::string& name, const float value) {
+  H5::Attribute attr = obj.createAttribute(name.c_str(), H5::PredType::IEEE_F32LE, H5::DataSpace(H5S_SCALAR));
+  attr.write(H5::PredType::NATIVE_FLOAT, &value);
+}
+
+void writeAttribute(H5::H5Object& obj, const std::string& name, const double value) {
+  H5::Attribute attr = obj.createAttribute(name.c_str(), H5::PredType::IEEE_F64LE, H5::DataSpace(H5S_SCALAR));
+  attr.write(H5::PredType::NATIVE_DOUBLE, &value);
+}
+
+void writeAttribute(H5::H5Object& obj, const std::string& name, const std::string& value) {
+  H5::StrType type(H5::PredType::C_S1, H5T_VARIABLE);
+  H5::Attribute attr = obj.createAttribute(name.c_str(), type, H5::DataSpace(H5S_SCALAR));
+  attr.write(type, value);
+}
+
+void readAttribute(const H5::H5Object& obj, const std::string& name, int& value) {
+  obj.openAttribute(name.c_str()).read(H5::PredType::NATIVE_INT, &value);
+}
+
+void readAttribute(const H5::H5Object& obj, const std::string& name, bool& value) {
+  int stored;
+  readAttribute(obj, name, stored);
+  value = stored != 0;
+}
+
+void readAttribute(const H5::H5Object& obj, const std::string& name, float& value) {
+  obj.openAttribute(name.c_str()).read(H5::PredType::NATIVE_FLOAT, &value);
+}
+
+void readAttribute(const H5::H5Object& obj, const std::string& name, double& value) {
+  obj.openAttribute(name.c_str()).read(H5::PredType::NATIVE_DOUBLE, &value);
+}
+
+void readAttribute(const H5::H5Object& obj, const std::string& name, std::string& value) {
+  H5::Attribute attr = obj.openAttribute(name.c_str());
+  attr.read(attr.getStrType(), value);
+}
@@ -1,7 +1,27 @@
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <tuple>
+
 #include <kernels.hpp>
+#include <layout.hpp>
+
+std::string programSource(const std::string& source) {
+  std::string header;
+  if(sizeof(real) == sizeof(double)) {
+    header += "#pragma OPENCL EXTENSION cl_khr_fp64 : enable\n";
+  }
+  if(I_CONTIGUOUS) {
+    header += "#define FAFS_I_CONTIGUOUS\n";
+  }
+  header += std::string("typedef ") + clTypeName<real>() + " real;\n";
+  header += std::string("typedef ") + clTypeName<real>() + "2 real2;\n";
+  return header + FAFS_COMMON + source;
+}
 
-Kernels::Kernels():
-  program{buildProgramFromString(FAFS_PROGRAM)},
+Kernels::Kernels(const std::string& options):
+  program{buildProgramFromString(programSource(FAFS_PROGRAM), options)},
   fill{createKernelFunctor<fillKernel>(program, "fill")},
   applyVonNeumannBC_x{createKernelFunctor<vonNeumannKernel>(program, "applyVonNeumannBC_x")},
   applyVonNeumannBC_y{createKernelFunctor<vonNeumannKernel>(program, "applyVonNeumannBC_y")},
@@ -9,23 +29,185 @@ Kernels::Kernels():
   calcDiffusionTerm{createKernelFunctor<calcDiffusionKernel>(program, "calcDiffusionTerm")},
   calcAdvectionTerm{createKernelFunctor<calcAdvectionKernel>(program, "calcAdvectionTerm")},
   applyJacobiStep{createKernelFunctor<applyJacobiKernel>(program, "applyJacobiStep")},
+  applyWeightedJacobiStep{createKernelFunctor<applyWeightedJacobi_k>(program, "applyWeightedJacobiStep")},
+  applyRedBlackSORStep{createKernelFunctor<applyRedBlackSOR_k>(program, "applyRedBlackSORStep")},
+  calcJacobiResidual{createKernelFunctor<applyJacobiKernel>(program, "calcJacobiResidual")},
+  applyJacobiOperator{createKernelFunctor<applyJacobiOperator_k>(program, "applyJacobiOperator")},
+  dotProduct{createKernelFunctor<dotProduct_k>(program, "dotProduct")},
+  calcNorms{createKernelFunctor<calcNorms_k>(program, "calcNorms")},
+  calcJacobiResidualNorms{createKernelFunctor<calcJacobiResidualNorms_k>(program, "calcJacobiResidualNorms")},
+  axpby{createKernelFunctor<axpby_k>(program, "axpby")},
+  restrictCellCentred{createKernelFunctor<transferCellCentred_k>(program, "restrictCellCentred")},
+  prolongateCellCentred{createKernelFunctor<transferCellCentred_k>(program, "prolongateCellCentred")},
   calcDivergence{createKernelFunctor<calcDivergence_k>(program, "calcDivergence")},
   applyProjectionX{createKernelFunctor<applyProjection_k>(program, "applyProjectionX")},
   applyProjectionY{createKernelFunctor<applyProjection_k>(program, "applyProjectionY")},
-  advect{createKernelFunctor<advect_k>(program, "advect")}
+  advect{createKernelFunctor<advect_k>(program, "advect")},
+  advectVelocity{createKernelFunctor<advectVelocity_k>(program, "advectVelocity")},
+  advectVelocityScalar{createKernelFunctor<advectVelocityScalar_k>(program, "advectVelocityScalar")},
+  applyJacobiStepTiled{createKernelFunctor<applyJacobiTiled_k>(program, "applyJacobiStepTiled")},
+  calcDiffusionTermTiled{createKernelFunctor<calcDiffusionTiled_k>(program, "calcDiffusionTermTiled")},
+  calcDivergenceTiled{createKernelFunctor<calcDivergenceTiled_k>(program, "calcDivergenceTiled")},
+  applyProjectionXTiled{createKernelFunctor<applyProjectionTiled_k>(program, "applyProjectionXTiled")},
+  applyProjectionYTiled{createKernelFunctor<applyProjectionTiled_k>(program, "applyProjectionYTiled")},
+  applyJacobiSweeps{createKernelFunctor<applyJacobiSweeps_k>(program, "applyJacobiSweeps")},
+  applyBoundaryConditions{createKernelFunctor<applyBoundaryConditions_k>(program, "applyBoundaryConditions")},
+  interleave{createKernelFunctor<interleave_k>(program, "interleave")},
+  deinterleave{createKernelFunctor<interleave_k>(program, "deinterleave")},
+  advectVector{createKernelFunctor<advectVector_k>(program, "advectVector")},
+  calcDivergenceVector{createKernelFunctor<calcDivergenceVector_k>(program, "calcDivergenceVector")},
+  applyProjectionVector{createKernelFunctor<applyProjectionVector_k>(program, "applyProjectionVector")},
+  applyBoundaryConditionsVector{createKernelFunctor<applyBoundaryConditionsVector_k>(program, "applyBoundaryConditionsVector")}
 {}
 
-const std::string FAFS_PROGRAM{R"CLC(
-typedef float real;
+// Helpers shared by every program. real is defined ahead of them by
+// programSource.
+const std::string FAFS_COMMON{R"CLC(
+// Members of an ensemble are stored one after another along the
+// non-contiguous axis. NDRange dimension 0 runs along the contiguous axis, so
+// kernels take i from DIM_I and j from DIM_J.
+#ifdef FAFS_I_CONTIGUOUS
+#define DIM_I 0
+#define DIM_J 1
+int memberIndex(int member, int i, int j, int nx, int ny, int ng) {
+  return (member*(ny+2*ng) + j+ng)*(nx+2*ng) + (i+ng);
+}
+#else
+#define DIM_I 1
+#define DIM_J 0
+int memberIndex(int member, int i, int j, int nx, int ny, int ng) {
+  return (member*(nx+2*ng) + i+ng)*(ny+2*ng) + (j+ng);
+}
+#endif
 
+// Index into the member given by the third dimension of the NDRange
 int index(int i, int j, int nx, int ny, int ng) {
-  return (i+ng)*(ny+2*ng) + (j+ng);
+  return memberIndex(get_global_id(2), i, j, nx, ny, ng);
 }
 
 int gid(int i, int ng) {
   return get_global_id(i) - ng;
 }
 
+// The nth interior cell over every member, counting along the contiguous
+// axis first so that consecutive n are adjacent in memory
+void interiorCell(int n, int nx, int ny, int *member, int *i, int *j) {
+  *member = n/(nx*ny);
+#ifdef FAFS_I_CONTIGUOUS
+  *i = n%nx;
+  *j = n%(nx*ny)/nx;
+#else
+  *i = n%(nx*ny)/ny;
+  *j = n%ny;
+#endif
+}
+
+// Boundary descriptors
+// Each array carries a type per side, ordered lower, upper, left, right, and a
+// value per side for each member. Ghost values are resolved directly from interior cells, left/right
+// first, so every ghost cell can be set independently in one pass and corners
+// take the left/right condition. Halo ghosts resolve to themselves, so are
+// left unchanged.
+#define BC_DIRICHLET 0
+#define BC_NEUMANN 1
+#define BC_PERIODIC 2
+#define BC_HALO 3
+
+// Maps k to the kth ghost cell: the lower then upper ghost rows including
+// corners, then the left and right ghost columns. Returns false past the end.
+bool ghostRingCell(int k, int nx, int ny, int ng, int *i, int *j) {
+  int rowLength = nx + 2*ng;
+  int rowCells = ng*rowLength;
+  if(k < 2*rowCells) {
+    int row = k/rowLength;
+    *i = k%rowLength - ng;
+    *j = row < ng ? row - ng : ny + row - ng;
+    return true;
+  }
+  k -= 2*rowCells;
+  if(k < 2*ng*ny) {
+    int col = k/ny;
+    *j = k%ny;
+    *i = col < ng ? col - ng : nx + col - ng;
+    return true;
+  }
+  return false;
+}
+
+// Resolves a ghost index along one axis. Returns false if the cell takes the
+// Dirichlet value.
+bool resolveGhost(int *i, int n, int lowerType, int upperType) {
+  if(*i < 0) {
+    if(lowerType == BC_DIRICHLET) return false;
+    if(lowerType == BC_HALO) return true;
+    *i = lowerType == BC_PERIODIC ? *i + n : 0;
+  } else if(*i >= n) {
+    if(upperType == BC_DIRICHLET) return false;
+    if(upperType == BC_HALO) return true;
+    *i = upperType == BC_PERIODIC ? *i - n : n-1;
+  }
+  return true;
+}
+
+// Bilinear interpolation stencil at the departure point of a back-trace
+typedef struct {
+  int x1y1, x1y2, x2y1, x2y2;
+  real x1Weight, x2Weight, y1Weight, y2Weight;
+} BilinearStencil;
+
+BilinearStencil backTrace(int i, int j, real vxij, real vyij, real dx, real dy, real dt, int nx, int ny, int ng) {
+  real x = (real)i - dt*vxij/dx;
+  real y = (real)j - dt*vyij/dy;
+  // clamp to int indices and ensure inside domain
+  int rigIdx = nx-1+ng;
+  int lefIdx = -ng;
+  int topIdx = ny-1+ng;
+  int botIdx = -ng;
+  int x2 = clamp((int)floor(x)+1,lefIdx, rigIdx);
+  int x1 = clamp((int)floor(x)  ,lefIdx, rigIdx);
+  int y2 = clamp((int)floor(y)+1,botIdx, topIdx);
+  int y1 = clamp((int)floor(y)  ,botIdx, topIdx);
+  x = clamp(x, (real)lefIdx, (real)rigIdx);
+  y = clamp(y, (real)botIdx, (real)topIdx);
+
+  BilinearStencil s;
+  s.x1y1 = index(x1, y1, nx, ny, ng);
+  s.x1y2 = index(x1, y2, nx, ny, ng);
+  s.x2y1 = index(x2, y1, nx, ny, ng);
+  s.x2y2 = index(x2, y2, nx, ny, ng);
+  // Weights collapse onto x1 (y1) where the point is clamped to the edge
+  s.x1Weight = x1!=x2 ? (x2-x)/(x2-x1) : 1.0f;
+  s.x2Weight = x1!=x2 ? (x-x1)/(x2-x1) : 0.0f;
+  s.y1Weight = y1!=y2 ? (y2-y)/(y2-y1) : 1.0f;
+  s.y2Weight = y1!=y2 ? (y-y1)/(y2-y1) : 0.0f;
+  return s;
+}
+
+// Reduce per work-item sums and maxima to one of each per work group, written
+// to out[group] and out[group + number of groups]
+void reduceNorms(__global real *out, __local real *sums, __local real *maxs, real sum, real mx) {
+  int lid = get_local_id(0);
+
+  sums[lid] = sum;
+  maxs[lid] = mx;
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  for(int offset=get_local_size(0)/2; offset>0; offset/=2) {
+    if(lid < offset) {
+      sums[lid] += sums[lid+offset];
+      maxs[lid] = fmax(maxs[lid], maxs[lid+offset]);
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+
+  if(lid == 0) {
+    out[get_group_id(0)] = sums[0];
+    out[get_group_id(0) + get_num_groups(0)] = maxs[0];
+  }
+}
+)CLC"};
+
+const std::string FAFS_PROGRAM{R"CLC(
 __kernel void fill(
   __global real *out,
   __private const real val,
@@ -34,8 +216,8 @@ __kernel void fill(
   __private const int ng
 )
 {
-  int i = gid(0, ng);
-  int j = gid(1, ng);
+  int i = gid(DIM_I, ng);
+  int j = gid(DIM_J, ng);
   int idx = index(i, j, nx, ny, ng);
   out[idx] = val;
 }
@@ -48,7 +230,7 @@ __kernel void applyVonNeumannBC_y(
   __private const int ng
 )
 {
-  int i = gid(0, ng);
+  int i = gid(DIM_I, ng);
 
   // Set lower boundary
   int i_boundary = index(i, -1, nx, ny, ng);
@@ -68,7 +250,7 @@ __kernel void applyVonNeumannBC_x(
   __private const int ng
 )
 {
-  int j = gid(1, ng);
+  int j = gid(DIM_J, ng);
 
   // Set lower boundary
   int i_boundary = index(-1, j, nx, ny, ng);
@@ -90,8 +272,8 @@ __kernel void advanceEuler(
   __private const int ng
 )
 {
-  int i = gid(0, ng);
-  int j = gid(1, ng);
+  int i = gid(DIM_I, ng);
+  int j = gid(DIM_J, ng);
   int idx = index(i, j, nx, ny, ng);
   out[idx] += ddt[idx]*dt;
 }
@@ -120,8 +302,8 @@ __kernel void calcAdvectionTerm(
   __private const int ng
 )
 {
-  int i = gid(0, ng);
-  int j = gid(1, ng);
+  int i = gid(DIM_I, ng);
+  int j = gid(DIM_J, ng);
   int idx = index(i, j, nx, ny, ng);
   out[idx] = -(vx[idx] * ddx(f, dx, i, j, nx, ny, ng) + vy[idx] * ddy(f, dy, i, j, nx, ny, ng));
 }
@@ -137,8 +319,8 @@ __kernel void calcDiffusionTerm(
   __private const int ng
 )
 {
-  int i = gid(0, ng);
-  int j = gid(1, ng);
+  int i = gid(DIM_I, ng);
+  int j = gid(DIM_J, ng);
   int ij = index(i, j, nx, ny, ng);
   int ipj = index(i+1, j, nx, ny, ng);
   int imj = index(i-1, j, nx, ny, ng);
@@ -147,6 +329,26 @@ __kernel void calcDiffusionTerm(
   out[ij] = 1.0/Re*((f[ijp] - 2.0*f[ij] + f[ijm])/(dy*dy) + (f[ipj] - 2.0*f[ij] + f[imj])/(dx*dx));
 }
 
+// The size and coefficients of the system solved by applyJacobiStep are read
+// through these by the kernels for it. They are the kernel's arguments unless
+// the program is built for one system (see specialiseLinearSystem), when they
+// are constants that fold into the index arithmetic.
+#ifdef FAFS_SYSTEM_NX
+#define SYSTEM_NX FAFS_SYSTEM_NX
+#define SYSTEM_NY FAFS_SYSTEM_NY
+#define SYSTEM_NG FAFS_SYSTEM_NG
+#define SYSTEM_ALPHA FAFS_SYSTEM_ALPHA
+#define SYSTEM_BETA FAFS_SYSTEM_BETA
+#define SYSTEM_GAMMA FAFS_SYSTEM_GAMMA
+#else
+#define SYSTEM_NX nx
+#define SYSTEM_NY ny
+#define SYSTEM_NG ng
+#define SYSTEM_ALPHA alpha
+#define SYSTEM_BETA beta
+#define SYSTEM_GAMMA gamma
+#endif
+
 __kernel void applyJacobiStep(
   __global real *out,
   __global const real *in,
@@ -159,8 +361,90 @@ __kernel void applyJacobiStep(
   __private const int ng
 )
 {
-  int i = gid(0, ng);
-  int j = gid(1, ng);
+  int i = gid(DIM_I, SYSTEM_NG);
+  int j = gid(DIM_J, SYSTEM_NG);
+
+  int ij = index(i, j, SYSTEM_NX, SYSTEM_NY, SYSTEM_NG);
+  int ipj = index(i+1, j, SYSTEM_NX, SYSTEM_NY, SYSTEM_NG);
+  int imj = index(i-1, j, SYSTEM_NX, SYSTEM_NY, SYSTEM_NG);
+  int ijp = index(i, j+1, SYSTEM_NX, SYSTEM_NY, SYSTEM_NG);
+  int ijm = index(i, j-1, SYSTEM_NX, SYSTEM_NY, SYSTEM_NG);
+
+  out[ij] = SYSTEM_ALPHA*(b[ij] - (in[ipj] + in[imj])/SYSTEM_BETA - (in[ijp] + in[ijm])/SYSTEM_GAMMA);
+}
+
+__kernel void applyWeightedJacobiStep(
+  __global real *out,
+  __global const real *in,
+  __private const real alpha,
+  __private const real beta,
+  __private const real gamma,
+  __global const real *b,
+  __private const real omega,
+  __private const int nx,
+  __private const int ny,
+  __private const int ng
+)
+{
+  int i = gid(DIM_I, ng);
+  int j = gid(DIM_J, ng);
+
+  int ij = index(i, j, nx, ny, ng);
+  int ipj = index(i+1, j, nx, ny, ng);
+  int imj = index(i-1, j, nx, ny, ng);
+  int ijp = index(i, j+1, nx, ny, ng);
+  int ijm = index(i, j-1, nx, ny, ng);
+
+  real jacobi = alpha*(b[ij] - (in[ipj] + in[imj])/beta - (in[ijp] + in[ijm])/gamma);
+  out[ij] = (1.0f-omega)*in[ij] + omega*jacobi;
+}
+
+// In-place over-relaxed Gauss-Seidel update of the cells with (i+j)%2 == colour
+// for the system solved by applyJacobiStep. Launched over half the interior in j.
+__kernel void applyRedBlackSORStep(
+  __global real *out,
+  __private const real alpha,
+  __private const real beta,
+  __private const real gamma,
+  __global const real *b,
+  __private const real omega,
+  __private const int colour,
+  __private const int nx,
+  __private const int ny,
+  __private const int ng
+)
+{
+  int i = gid(DIM_I, SYSTEM_NG);
+  int j = 2*gid(DIM_J, SYSTEM_NG) + ((i+colour) & 1);
+  if(j >= SYSTEM_NY) {
+    return;
+  }
+
+  int ij = index(i, j, SYSTEM_NX, SYSTEM_NY, SYSTEM_NG);
+  int ipj = index(i+1, j, SYSTEM_NX, SYSTEM_NY, SYSTEM_NG);
+  int imj = index(i-1, j, SYSTEM_NX, SYSTEM_NY, SYSTEM_NG);
+  int ijp = index(i, j+1, SYSTEM_NX, SYSTEM_NY, SYSTEM_NG);
+  int ijm = index(i, j-1, SYSTEM_NX, SYSTEM_NY, SYSTEM_NG);
+
+  real jacobi = SYSTEM_ALPHA*(b[ij] - (out[ipj] + out[imj])/SYSTEM_BETA - (out[ijp] + out[ijm])/SYSTEM_GAMMA);
+  out[ij] = (1.0f-omega)*out[ij] + omega*jacobi;
+}
+
+// Residual b - Ax of the system solved by applyJacobiStep
+__kernel void calcJacobiResidual(
+  __global real *out,
+  __global const real *in,
+  __private const real alpha,
+  __private const real beta,
+  __private const real gamma,
+  __global const real *b,
+  __private const int nx,
+  __private const int ny,
+  __private const int ng
+)
+{
+  int i = gid(DIM_I, ng);
+  int j = gid(DIM_J, ng);
 
   int ij = index(i, j, nx, ny, ng);
   int ipj = index(i+1, j, nx, ny, ng);
@@ -168,7 +452,211 @@ __kernel void applyJacobiStep(
   int ijp = index(i, j+1, nx, ny, ng);
   int ijm = index(i, j-1, nx, ny, ng);
 
-  out[ij] = alpha*(b[ij] - (in[ipj] + in[imj])/beta - (in[ijp] + in[ijm])/gamma);
+  out[ij] = b[ij] - in[ij]/alpha - (in[ipj] + in[imj])/beta - (in[ijp] + in[ijm])/gamma;
+}
+
+// Operator A of the system solved by applyJacobiStep
+__kernel void applyJacobiOperator(
+  __global real *out,
+  __global const real *in,
+  __private const real alpha,
+  __private const real beta,
+  __private const real gamma,
+  __private const int nx,
+  __private const int ny,
+  __private const int ng
+)
+{
+  int i = gid(DIM_I, SYSTEM_NG);
+  int j = gid(DIM_J, SYSTEM_NG);
+
+  int ij = index(i, j, SYSTEM_NX, SYSTEM_NY, SYSTEM_NG);
+  int ipj = index(i+1, j, SYSTEM_NX, SYSTEM_NY, SYSTEM_NG);
+  int imj = index(i-1, j, SYSTEM_NX, SYSTEM_NY, SYSTEM_NG);
+  int ijp = index(i, j+1, SYSTEM_NX, SYSTEM_NY, SYSTEM_NG);
+  int ijm = index(i, j-1, SYSTEM_NX, SYSTEM_NY, SYSTEM_NG);
+
+  out[ij] = in[ij]/SYSTEM_ALPHA + (in[ipj] + in[imj])/SYSTEM_BETA + (in[ijp] + in[ijm])/SYSTEM_GAMMA;
+}
+
+// Sum a*b over the interior of every member. Each work group writes one
+// partial sum to out, the local size must be a power of two.
+__kernel void dotProduct(
+  __global real *out,
+  __global const real *a,
+  __global const real *b,
+  __local real *scratch,
+  __private const int nx,
+  __private const int ny,
+  __private const int ng,
+  __private const int nMembers
+)
+{
+  int lid = get_local_id(0);
+
+  real sum = 0.0f;
+  for(int n=get_global_id(0); n<nMembers*nx*ny; n+=get_global_size(0)) {
+    int m, i, j;
+    interiorCell(n, nx, ny, &m, &i, &j);
+    int idx = memberIndex(m, i, j, nx, ny, ng);
+    sum += a[idx]*b[idx];
+  }
+  scratch[lid] = sum;
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  for(int offset=get_local_size(0)/2; offset>0; offset/=2) {
+    if(lid < offset) {
+      scratch[lid] += scratch[lid+offset];
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+
+  if(lid == 0) {
+    out[get_group_id(0)] = scratch[0];
+  }
+}
+
+// Partial sums of squares and maxima of |a| over the interior of every member
+__kernel void calcNorms(
+  __global real *out,
+  __global const real *a,
+  __local real *sums,
+  __local real *maxs,
+  __private const int nx,
+  __private const int ny,
+  __private const int ng,
+  __private const int nMembers
+)
+{
+  real sum = 0.0f;
+  real mx = 0.0f;
+  for(int n=get_global_id(0); n<nMembers*nx*ny; n+=get_global_size(0)) {
+    int m, i, j;
+    interiorCell(n, nx, ny, &m, &i, &j);
+    real val = a[memberIndex(m, i, j, nx, ny, ng)];
+    sum += val*val;
+    mx = fmax(mx, fabs(val));
+  }
+  reduceNorms(out, sums, maxs, sum, mx);
+}
+
+// Norms of the residual b - Ax of the system solved by applyJacobiStep over
+// every member, without storing the residual
+__kernel void calcJacobiResidualNorms(
+  __global real *out,
+  __global const real *in,
+  __private const real alpha,
+  __private const real beta,
+  __private const real gamma,
+  __global const real *b,
+  __local real *sums,
+  __local real *maxs,
+  __private const int nx,
+  __private const int ny,
+  __private const int ng,
+  __private const int nMembers
+)
+{
+  real sum = 0.0f;
+  real mx = 0.0f;
+  for(int n=get_global_id(0); n<nMembers*SYSTEM_NX*SYSTEM_NY; n+=get_global_size(0)) {
+    int m, i, j;
+    interiorCell(n, SYSTEM_NX, SYSTEM_NY, &m, &i, &j);
+
+    int ij = memberIndex(m, i, j, SYSTEM_NX, SYSTEM_NY, SYSTEM_NG);
+    int ipj = memberIndex(m, i+1, j, SYSTEM_NX, SYSTEM_NY, SYSTEM_NG);
+    int imj = memberIndex(m, i-1, j, SYSTEM_NX, SYSTEM_NY, SYSTEM_NG);
+    int ijp = memberIndex(m, i, j+1, SYSTEM_NX, SYSTEM_NY, SYSTEM_NG);
+    int ijm = memberIndex(m, i, j-1, SYSTEM_NX, SYSTEM_NY, SYSTEM_NG);
+
+    real res = b[ij] - in[ij]/SYSTEM_ALPHA - (in[ipj] + in[imj])/SYSTEM_BETA - (in[ijp] + in[ijm])/SYSTEM_GAMMA;
+    sum += res*res;
+    mx = fmax(mx, fabs(res));
+  }
+  reduceNorms(out, sums, maxs, sum, mx);
+}
+
+// out = a*x + b*out
+__kernel void axpby(
+  __global real *out,
+  __global const real *x,
+  __private const real a,
+  __private const real b,
+  __private const int nx,
+  __private const int ny,
+  __private const int ng
+)
+{
+  int i = gid(DIM_I, ng);
+  int j = gid(DIM_J, ng);
+  int idx = index(i, j, nx, ny, ng);
+  out[idx] = a*x[idx] + b*out[idx];
+}
+
+// Area-weighted average of a fine cell-centred array onto a coarse one
+// spanning the same domain. The coarse cells needn't be exactly twice the
+// size of the fine ones, so odd grids coarsen too.
+__kernel void restrictCellCentred(
+  __global real *out,
+  __global const real *f,
+  __private const int nxf,
+  __private const int nyf,
+  __private const int nx,
+  __private const int ny,
+  __private const int ng
+)
+{
+  int i = gid(DIM_I, ng);
+  int j = gid(DIM_J, ng);
+
+  // coarse cell width in units of fine cells
+  real sx = (real)nxf/nx;
+  real sy = (real)nyf/ny;
+
+  real xlo = i*sx;
+  real xhi = (i+1)*sx;
+  real ylo = j*sy;
+  real yhi = (j+1)*sy;
+
+  real sum = 0.0f;
+  for(int fi=(int)floor(xlo); fi<min((int)ceil(xhi), nxf+ng); ++fi) {
+    real wx = fmin(xhi, (real)(fi+1)) - fmax(xlo, (real)fi);
+    for(int fj=(int)floor(ylo); fj<min((int)ceil(yhi), nyf+ng); ++fj) {
+      real wy = fmin(yhi, (real)(fj+1)) - fmax(ylo, (real)fj);
+      sum += wx*wy*f[index(fi, fj, nxf, nyf, ng)];
+    }
+  }
+
+  out[index(i, j, nx, ny, ng)] = sum/(sx*sy);
+}
+
+// Bilinearly interpolate a coarse cell-centred correction onto a fine grid
+// and add it to out. Ghost cells of the coarse array must be up to date.
+__kernel void prolongateCellCentred(
+  __global real *out,
+  __global const real *f,
+  __private const int nxc,
+  __private const int nyc,
+  __private const int nx,
+  __private const int ny,
+  __private const int ng
+)
+{
+  int i = gid(DIM_I, ng);
+  int j = gid(DIM_J, ng);
+
+  // fine cell centre in coarse index space
+  real x = (i+0.5f)*nxc/(real)nx - 0.5f;
+  real y = (j+0.5f)*nyc/(real)ny - 0.5f;
+  int x1 = (int)floor(x);
+  int y1 = (int)floor(y);
+  real x2Weight = x - x1;
+  real y2Weight = y - y1;
+
+  real fy1 = (1.0f-x2Weight)*f[index(x1, y1,   nxc, nyc, ng)] + x2Weight*f[index(x1+1, y1,   nxc, nyc, ng)];
+  real fy2 = (1.0f-x2Weight)*f[index(x1, y1+1, nxc, nyc, ng)] + x2Weight*f[index(x1+1, y1+1, nxc, nyc, ng)];
+
+  out[index(i, j, nx, ny, ng)] += (1.0f-y2Weight)*fy1 + y2Weight*fy2;
 }
 
 __kernel void calcDivergence(
@@ -183,8 +671,8 @@ __kernel void calcDivergence(
 )
 {
   // cell-centred global indices
-  int i = gid(0, ng);
-  int j = gid(1, ng);
+  int i = gid(DIM_I, ng);
+  int j = gid(DIM_J, ng);
 
   // node-centred array indices
   int vij   = index(i,   j,   nx-1, ny-1, ng);
@@ -215,8 +703,8 @@ __kernel void applyProjectionX(
   __private const int ng
 )
 {
-  int i = gid(0, ng);
-  int j = gid(1, ng);
+  int i = gid(DIM_I, ng);
+  int j = gid(DIM_J, ng);
 
   int ij = index(i, j, nx, ny, ng);
 
@@ -242,8 +730,8 @@ __kernel void applyProjectionY(
   __private const int ng
 )
 {
-  int i = gid(0, ng);
-  int j = gid(1, ng);
+  int i = gid(DIM_I, ng);
+  int j = gid(DIM_J, ng);
 
   int ij = index(i, j, nx, ny, ng);
 
@@ -260,6 +748,12 @@ __kernel void applyProjectionY(
   out[ij] = out[ij] - dfdy;
 }
 
+real interpolate(BilinearStencil s, __global const real *f) {
+  real fy1 = s.x1Weight*f[s.x1y1] + s.x2Weight*f[s.x2y1];
+  real fy2 = s.x1Weight*f[s.x1y2] + s.x2Weight*f[s.x2y2];
+  return s.y1Weight*fy1 + s.y2Weight*fy2;
+}
+
 __kernel void advect(
   __global real *out,
   __global const real *f,
@@ -272,51 +766,1018 @@ __kernel void advect(
   __private const int ny,
   __private const int ng
 ) {
-  int i = gid(0, ng);
-  int j = gid(1, ng);
+  int i = gid(DIM_I, ng);
+  int j = gid(DIM_J, ng);
 
   int ij = index(i, j, nx, ny, ng);
 
-  real x = (real)i - dt*vx[ij]/dx;
-  real y = (real)j - dt*vy[ij]/dy;
-  // clamp to int indices and ensure inside domain
-  int rigIdx = nx-1+ng;
-  int lefIdx = -ng;
-  int topIdx = ny-1+ng;
-  int botIdx = -ng;
-  int x2 = clamp((int)floor(x+1),lefIdx, rigIdx);
-  int x1 = clamp((int)floor(x)  ,lefIdx, rigIdx);
-  int y2 = clamp((int)floor(y+1),botIdx, topIdx);
-  int y1 = clamp((int)floor(y)  ,botIdx, topIdx);
-  x = clamp(x, (real)lefIdx, (real)rigIdx);
-  y = clamp(y, (real)botIdx, (real)topIdx);
-  // bilinearly interpolate
-  real fy1, fy2;
-  int x1y1 = index(x1, y1, nx, ny, ng);
-  int x1y2 = index(x1, y2, nx, ny, ng);
-  if(x1!=x2) {
-    real x1Weight = (x2-x)/(x2-x1);
-    real x2Weight = (x-x1)/(x2-x1);
-
-    int x2y1 = index(x2, y1, nx, ny, ng);
-    int x2y2 = index(x2, y2, nx, ny, ng);
-
-    fy1 = x1Weight*f[x1y1] + x2Weight*f[x2y1];
-    fy2 = x1Weight*f[x1y2] + x2Weight*f[x2y2];
-  } else {
-    fy1 = f[x1y1];
-    fy2 = f[x1y2];
-  }
-  real fAv;
-  if(y1!=y2) {
-    real y1Weight = (y2-y)/(y2-y1);
-    real y2Weight = (y-y1)/(y2-y1);
-    fAv = y1Weight*fy1 + y2Weight*fy2;
-  } else {
-    fAv = fy1;
-  }
-  out[ij] = fAv;
+  BilinearStencil s = backTrace(i, j, vx[ij], vy[ij], dx, dy, dt, nx, ny, ng);
+  out[ij] = interpolate(s, f);
 }
-)CLC"};
 
-Kernels g_kernels; // wuh oh, is that a global variable? it is, deal with it
+// Advects both velocity components from a single back-trace
+__kernel void advectVelocity(
+  __global real *outx,
+  __global real *outy,
+  __global const real *vx,
+  __global const real *vy,
+  __private const real dx,
+  __private const real dy,
+  __private const real dt,
+  __private const int nx,
+  __private const int ny,
+  __private const int ng
+) {
+  int i = gid(DIM_I, ng);
+  int j = gid(DIM_J, ng);
+
+  int ij = index(i, j, nx, ny, ng);
+
+  BilinearStencil s = backTrace(i, j, vx[ij], vy[ij], dx, dy, dt, nx, ny, ng);
+  outx[ij] = interpolate(s, vx);
+  outy[ij] = interpolate(s, vy);
+}
+
+// As advectVelocity, also carrying a passive scalar located with the velocity
+__kernel void advectVelocityScalar(
+  __global real *outx,
+  __global real *outy,
+  __global real *outf,
+  __global const real *vx,
+  __global const real *vy,
+  __global const real *f,
+  __private const real dx,
+  __private const real dy,
+  __private const real dt,
+  __private const int nx,
+  __private const int ny,
+  __private const int ng
+) {
+  int i = gid(DIM_I, ng);
+  int j = gid(DIM_J, ng);
+
+  int ij = index(i, j, nx, ny, ng);
+
+  BilinearStencil s = backTrace(i, j, vx[ij], vy[ij], dx, dy, dt, nx, ny, ng);
+  outx[ij] = interpolate(s, vx);
+  outy[ij] = interpolate(s, vy);
+  outf[ij] = interpolate(s, f);
+}
+
+// Interleaved vector fields
+// VectorOpenCLArray stores the two components of each cell side by side as a
+// real2, so both are fetched together: each gather point costs one cache line
+// instead of one per component.
+__kernel void interleave(
+  __global real2 *out,
+  __global const real *fx,
+  __global const real *fy,
+  __private const int nx,
+  __private const int ny,
+  __private const int ng
+)
+{
+  int i = gid(DIM_I, ng);
+  int j = gid(DIM_J, ng);
+  int ij = index(i, j, nx, ny, ng);
+  out[ij] = (real2)(fx[ij], fy[ij]);
+}
+
+__kernel void deinterleave(
+  __global real *fx,
+  __global real *fy,
+  __global const real2 *in,
+  __private const int nx,
+  __private const int ny,
+  __private const int ng
+)
+{
+  int i = gid(DIM_I, ng);
+  int j = gid(DIM_J, ng);
+  int ij = index(i, j, nx, ny, ng);
+  real2 f = in[ij];
+  fx[ij] = f.x;
+  fy[ij] = f.y;
+}
+
+real2 interpolateVector(BilinearStencil s, __global const real2 *f) {
+  real2 fy1 = s.x1Weight*f[s.x1y1] + s.x2Weight*f[s.x2y1];
+  real2 fy2 = s.x1Weight*f[s.x1y2] + s.x2Weight*f[s.x2y2];
+  return s.y1Weight*fy1 + s.y2Weight*fy2;
+}
+
+// As advectVelocity, on an interleaved velocity
+__kernel void advectVector(
+  __global real2 *out,
+  __global const real2 *v,
+  __private const real dx,
+  __private const real dy,
+  __private const real dt,
+  __private const int nx,
+  __private const int ny,
+  __private const int ng
+) {
+  int i = gid(DIM_I, ng);
+  int j = gid(DIM_J, ng);
+
+  int ij = index(i, j, nx, ny, ng);
+
+  real2 vij = v[ij];
+  BilinearStencil s = backTrace(i, j, vij.x, vij.y, dx, dy, dt, nx, ny, ng);
+  out[ij] = interpolateVector(s, v);
+}
+
+// As calcDivergence, on an interleaved velocity
+__kernel void calcDivergenceVector(
+  __global real *out,
+  __global const real2 *v,
+  __private const real dx,
+  __private const real dy,
+  __private const int nx,
+  __private const int ny,
+  __private const int ng
+)
+{
+  // cell-centred global indices
+  int i = gid(DIM_I, ng);
+  int j = gid(DIM_J, ng);
+
+  // node-centred velocities
+  real2 vij   = v[index(i,   j,   nx-1, ny-1, ng)];
+  real2 vijm  = v[index(i,   j-1, nx-1, ny-1, ng)];
+  real2 vimj  = v[index(i-1, j,   nx-1, ny-1, ng)];
+  real2 vimjm = v[index(i-1, j-1, nx-1, ny-1, ng)];
+
+  real dvxj  = (vij.x  - vimj.x )/dx; // ddx at upper boundary
+  real dvxjm = (vijm.x - vimjm.x)/dx; // ddx at lower boundary
+  real dvxdx = 0.5*(dvxj + dvxjm); // ddx at cell centre
+
+  real dvyi  = (vij.y  - vijm.y )/dy; // ddy at right boundary
+  real dvyim = (vimj.y - vimjm.y)/dy; // ddy at left boundary
+  real dvydy = 0.5*(dvyi + dvyim); // ddy at cell centre
+
+  out[index(i, j, nx, ny, ng)] = dvydy + dvxdx;
+}
+
+// applyProjectionX and applyProjectionY together, on an interleaved velocity,
+// reading the four cell-centred values of f once for both components
+__kernel void applyProjectionVector(
+  __global real2 *out,
+  __global const real *f,
+  __private const real dx,
+  __private const real dy,
+  __private const int nx,
+  __private const int ny,
+  __private const int ng
+)
+{
+  int i = gid(DIM_I, ng);
+  int j = gid(DIM_J, ng);
+
+  int ij = index(i, j, nx, ny, ng);
+
+  // Cell-centred values
+  real fij   = f[index(i,   j,   nx+1, ny+1, ng)];
+  real fijp  = f[index(i,   j+1, nx+1, ny+1, ng)];
+  real fipj  = f[index(i+1, j,   nx+1, ny+1, ng)];
+  real fipjp = f[index(i+1, j+1, nx+1, ny+1, ng)];
+
+  real dfdxjp = (fipjp - fijp)/dx; // ddx at upper boundary
+  real dfdxj  = (fipj  - fij )/dx; // ddx at lower boundary
+  real dfdx = 0.5*(dfdxj + dfdxjp); // ddx at node
+
+  real dfdyip = (fipjp - fipj)/dy; // ddy at right boundary
+  real dfdyi  = (fijp  - fij )/dy; // ddy at left boundary
+  real dfdy = 0.5*(dfdyi + dfdyip); // ddy at node
+
+  out[ij] = out[ij] - (real2)(dfdx, dfdy);
+}
+
+// Ghost value of ghost cell (i, j) for one component of an interleaved field
+real ghostComponent(__global const real2 *f, int component, __global const int *types, __global const real *values, int i, int j, int nx, int ny, int ng) {
+  int si = i;
+  if(!resolveGhost(&si, nx, types[2], types[3])) {
+    return i < 0 ? values[2] : values[3];
+  }
+  int sj = j;
+  if(!resolveGhost(&sj, ny, types[0], types[1])) {
+    return j < 0 ? values[0] : values[1];
+  }
+  real2 s = f[index(si, sj, nx, ny, ng)];
+  return component == 0 ? s.x : s.y;
+}
+
+// Applies each component's boundary descriptors to an interleaved field,
+// launched over its ghost ring and every member
+__kernel void applyBoundaryConditionsVector(
+  __global real2 *f,
+  __global const int *typesX,
+  __global const real *valuesX,
+  __global const int *typesY,
+  __global const real *valuesY,
+  __private const int nx,
+  __private const int ny,
+  __private const int ng
+)
+{
+  int i, j;
+  if(!ghostRingCell(get_global_id(0), nx, ny, ng, &i, &j)) {
+    return;
+  }
+  int member = get_global_id(2);
+  real x = ghostComponent(f, 0, typesX, valuesX + member*4, i, j, nx, ny, ng);
+  real y = ghostComponent(f, 1, typesY, valuesY + member*4, i, j, nx, ny, ng);
+  f[index(i, j, nx, ny, ng)] = (real2)(x, y);
+}
+
+// Tiled kernels
+// Each work group stages the part of its inputs it needs, including a halo,
+// in local memory. They must be launched with an explicit local size over a
+// global range rounded up to whole work groups (OpenCLArray::tiledInterior),
+// so work items outside the interior return after loading.
+
+// Tiles are stored with j contiguous, tile[ti*ty + tj], whatever the global
+// layout, but are staged in global memory order: the work item with flat
+// local id n loads the nth tile cell counted along the contiguous axis.
+int localId() {
+  return get_local_id(1)*get_local_size(0) + get_local_id(0);
+}
+
+void tileCell(int n, int tx, int ty, int *ti, int *tj) {
+#ifdef FAFS_I_CONTIGUOUS
+  *ti = n%tx;
+  *tj = n/tx;
+#else
+  *ti = n/ty;
+  *tj = n%ty;
+#endif
+}
+
+// Load cells [i0, i0+tx) x [j0, j0+ty) of f into tile, clamped to the
+// allocated (ghost-padded) extent of f. Contains a barrier.
+void loadTile(__local real *tile, __global const real *f, int i0, int j0, int tx, int ty, int nx, int ny, int ng) {
+  int nThreads = get_local_size(0)*get_local_size(1);
+  for(int n=localId(); n<tx*ty; n+=nThreads) {
+    int ti, tj;
+    tileCell(n, tx, ty, &ti, &tj);
+    int i = clamp(i0 + ti, -ng, nx-1+ng);
+    int j = clamp(j0 + tj, -ng, ny-1+ng);
+    tile[ti*ty + tj] = f[index(i, j, nx, ny, ng)];
+  }
+  barrier(CLK_LOCAL_MEM_FENCE);
+}
+
+// First interior index covered by this work group
+int groupOrigin(int dim) {
+  return get_group_id(dim)*get_local_size(dim);
+}
+
+__kernel void applyJacobiStepTiled(
+  __global real *out,
+  __global const real *in,
+  __private const real alpha,
+  __private const real beta,
+  __private const real gamma,
+  __global const real *b,
+  __local real *tile,
+  __private const int nx,
+  __private const int ny,
+  __private const int ng
+)
+{
+  int i0 = groupOrigin(DIM_I) - 1;
+  int j0 = groupOrigin(DIM_J) - 1;
+  int ty = get_local_size(DIM_J) + 2;
+  loadTile(tile, in, i0, j0, get_local_size(DIM_I) + 2, ty, nx, ny, ng);
+
+  int i = gid(DIM_I, ng);
+  int j = gid(DIM_J, ng);
+  if(i >= nx || j >= ny) {
+    return;
+  }
+
+  int ti = i - i0;
+  int tj = j - j0;
+  real inpj = tile[(ti+1)*ty + tj];
+  real inmj = tile[(ti-1)*ty + tj];
+  real injp = tile[ti*ty + tj+1];
+  real injm = tile[ti*ty + tj-1];
+
+  int ij = index(i, j, nx, ny, ng);
+  out[ij] = alpha*(b[ij] - (inpj + inmj)/beta - (injp + injm)/gamma);
+}
+
+__kernel void calcDiffusionTermTiled(
+  __global real *out,
+  __global const real *f,
+  __private const real dx,
+  __private const real dy,
+  __private const real Re,
+  __local real *tile,
+  __private const int nx,
+  __private const int ny,
+  __private const int ng
+)
+{
+  int i0 = groupOrigin(DIM_I) - 1;
+  int j0 = groupOrigin(DIM_J) - 1;
+  int ty = get_local_size(DIM_J) + 2;
+  loadTile(tile, f, i0, j0, get_local_size(DIM_I) + 2, ty, nx, ny, ng);
+
+  int i = gid(DIM_I, ng);
+  int j = gid(DIM_J, ng);
+  if(i >= nx || j >= ny) {
+    return;
+  }
+
+  int ti = i - i0;
+  int tj = j - j0;
+  real fij = tile[ti*ty + tj];
+  real fipj = tile[(ti+1)*ty + tj];
+  real fimj = tile[(ti-1)*ty + tj];
+  real fijp = tile[ti*ty + tj+1];
+  real fijm = tile[ti*ty + tj-1];
+
+  out[index(i, j, nx, ny, ng)] = 1.0/Re*((fijp - 2.0*fij + fijm)/(dy*dy) + (fipj - 2.0*fij + fimj)/(dx*dx));
+}
+
+__kernel void calcDivergenceTiled(
+  __global real *out,
+  __global const real *fx,
+  __global const real *fy,
+  __private const real dx,
+  __private const real dy,
+  __local real *tileX,
+  __local real *tileY,
+  __private const int nx,
+  __private const int ny,
+  __private const int ng
+)
+{
+  // Node-centred inputs are needed at i-1..i, j-1..j
+  int i0 = groupOrigin(DIM_I) - 1;
+  int j0 = groupOrigin(DIM_J) - 1;
+  int tx = get_local_size(DIM_I) + 1;
+  int ty = get_local_size(DIM_J) + 1;
+  loadTile(tileX, fx, i0, j0, tx, ty, nx-1, ny-1, ng);
+  loadTile(tileY, fy, i0, j0, tx, ty, nx-1, ny-1, ng);
+
+  int i = gid(DIM_I, ng);
+  int j = gid(DIM_J, ng);
+  if(i >= nx || j >= ny) {
+    return;
+  }
+
+  int vij   = (i-i0)*ty + (j-j0);
+  int vijm  = vij - 1;
+  int vimj  = vij - ty;
+  int vimjm = vij - ty - 1;
+
+  real dvxj  = (tileX[vij ] - tileX[vimj ])/dx; // ddx at upper boundary
+  real dvxjm = (tileX[vijm] - tileX[vimjm])/dx; // ddx at lower boundary
+  real dvxdx = 0.5*(dvxj + dvxjm); // ddx at cell centre
+
+  real dvyi  = (tileY[vij ] - tileY[vijm ])/dy; // ddy at right boundary
+  real dvyim = (tileY[vimj] - tileY[vimjm])/dy; // ddy at left boundary
+  real dvydy = 0.5*(dvyi + dvyim); // ddy at cell centre
+
+  out[index(i, j, nx, ny, ng)] = dvydy + dvxdx;
+}
+
+__kernel void applyProjectionXTiled(
+  __global real *out,
+  __global const real *f,
+  __private const real dx,
+  __local real *tile,
+  __private const int nx,
+  __private const int ny,
+  __private const int ng
+)
+{
+  // Cell-centred input is needed at i..i+1, j..j+1
+  int i0 = groupOrigin(DIM_I);
+  int j0 = groupOrigin(DIM_J);
+  int ty = get_local_size(DIM_J) + 1;
+  loadTile(tile, f, i0, j0, get_local_size(DIM_I) + 1, ty, nx+1, ny+1, ng);
+
+  int i = gid(DIM_I, ng);
+  int j = gid(DIM_J, ng);
+  if(i >= nx || j >= ny) {
+    return;
+  }
+
+  int cij   = (i-i0)*ty + (j-j0);
+  int cijp  = cij + 1;
+  int cipj  = cij + ty;
+  int cipjp = cij + ty + 1;
+
+  real dfdxjp = (tile[cipjp] - tile[cijp])/dx; // ddx at upper boundary
+  real dfdxj  = (tile[cipj ] - tile[cij ])/dx; // ddx at lower boundary
+  real dfdx = 0.5*(dfdxj + dfdxjp); // ddx at node
+
+  int ij = index(i, j, nx, ny, ng);
+  out[ij] = out[ij] - dfdx;
+}
+
+__kernel void applyProjectionYTiled(
+  __global real *out,
+  __global const real *f,
+  __private const real dy,
+  __local real *tile,
+  __private const int nx,
+  __private const int ny,
+  __private const int ng
+)
+{
+  // Cell-centred input is needed at i..i+1, j..j+1
+  int i0 = groupOrigin(DIM_I);
+  int j0 = groupOrigin(DIM_J);
+  int ty = get_local_size(DIM_J) + 1;
+  loadTile(tile, f, i0, j0, get_local_size(DIM_I) + 1, ty, nx+1, ny+1, ng);
+
+  int i = gid(DIM_I, ng);
+  int j = gid(DIM_J, ng);
+  if(i >= nx || j >= ny) {
+    return;
+  }
+
+  int cij   = (i-i0)*ty + (j-j0);
+  int cijp  = cij + 1;
+  int cipj  = cij + ty;
+  int cipjp = cij + ty + 1;
+
+  real dfdyip = (tile[cipjp] - tile[cipj])/dy; // ddy at right boundary
+  real dfdyi  = (tile[cijp ] - tile[cij ])/dy; // ddy at left boundary
+  real dfdy = 0.5*(dfdyi + dfdyip); // ddy at node
+
+  int ij = index(i, j, nx, ny, ng);
+  out[ij] = out[ij] - dfdy;
+}
+
+// Temporally blocked Jacobi
+// Runs sweeps Jacobi steps on a tile widened by a halo of sweeps cells, with
+// von Neumann boundaries (ghost = nearest interior cell) applied before every
+// step. Each tile cell is updated as the stencil at its position clamped to
+// the interior, so cells outside the domain hold their boundary value without
+// a second pass. The valid part of the tile shrinks by one cell per step,
+// leaving exactly the work group's own cells after the last. Ghost cells of
+// out are not written. Launched over OpenCLArray::tiledInterior.
+__kernel void applyJacobiSweeps(
+  __global real *out,
+  __global const real *in,
+  __private const real alpha,
+  __private const real beta,
+  __private const real gamma,
+  __global const real *b,
+  __private const int sweeps,
+  __local real *tileA,
+  __local real *tileB,
+  __local real *tileRHS,
+  __private const int nx,
+  __private const int ny,
+  __private const int ng
+)
+{
+  int i0 = groupOrigin(DIM_I) - sweeps;
+  int j0 = groupOrigin(DIM_J) - sweeps;
+  int tx = get_local_size(DIM_I) + 2*sweeps;
+  int ty = get_local_size(DIM_J) + 2*sweeps;
+  int nThreads = get_local_size(0)*get_local_size(1);
+  int first = localId();
+
+  // Stage the clamped (i.e. von Neumann) solution and the rhs at each
+  // cell's clamped position
+  for(int n=first; n<tx*ty; n+=nThreads) {
+    int ti, tj;
+    tileCell(n, tx, ty, &ti, &tj);
+    int ij = index(clamp(i0 + ti, 0, SYSTEM_NX-1), clamp(j0 + tj, 0, SYSTEM_NY-1), SYSTEM_NX, SYSTEM_NY, SYSTEM_NG);
+    tileA[ti*ty + tj] = in[ij];
+    tileRHS[ti*ty + tj] = b[ij];
+  }
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  for(int s=0; s<sweeps; ++s) {
+    for(int n=first; n<tx*ty; n+=nThreads) {
+      int ci = clamp(i0 + n/ty, 0, SYSTEM_NX-1) - i0;
+      int cj = clamp(j0 + n%ty, 0, SYSTEM_NY-1) - j0;
+      // Cells whose stencil leaves the tile are outside the valid region
+      if(ci > 0 && ci < tx-1 && cj > 0 && cj < ty-1) {
+        int c = ci*ty + cj;
+        tileB[n] = SYSTEM_ALPHA*(tileRHS[n] - (tileA[c+ty] + tileA[c-ty])/SYSTEM_BETA - (tileA[c+1] + tileA[c-1])/SYSTEM_GAMMA);
+      }
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+    __local real *tmp = tileA;
+    tileA = tileB;
+    tileB = tmp;
+  }
+
+  int i = gid(DIM_I, SYSTEM_NG);
+  int j = gid(DIM_J, SYSTEM_NG);
+  if(i >= SYSTEM_NX || j >= SYSTEM_NY) {
+    return;
+  }
+
+  out[index(i, j, SYSTEM_NX, SYSTEM_NY, SYSTEM_NG)] = tileA[(i-i0)*ty + (j-j0)];
+}
+
+void applyBoundaryCell(__global real *f, __global const int *types, __global const real *values, int k, int nx, int ny, int ng) {
+  int i, j;
+  if(nx == 0 || !ghostRingCell(k, nx, ny, ng, &i, &j)) {
+    return;
+  }
+  int ij = index(i, j, nx, ny, ng);
+  values += get_global_id(2)*4;
+
+  int si = i;
+  if(!resolveGhost(&si, nx, types[2], types[3])) {
+    f[ij] = i < 0 ? values[2] : values[3];
+    return;
+  }
+  int sj = j;
+  if(!resolveGhost(&sj, ny, types[0], types[1])) {
+    f[ij] = j < 0 ? values[0] : values[1];
+    return;
+  }
+  f[ij] = f[index(si, sj, nx, ny, ng)];
+}
+
+// Applies the boundary conditions of up to three arrays of any size, launched
+// over the longest ghost ring and every member. Unused slots have nx = 0.
+__kernel void applyBoundaryConditions(
+  __global real *f0, __global const int *types0, __global const real *values0, __private const int nx0, __private const int ny0,
+  __global real *f1, __global const int *types1, __global const real *values1, __private const int nx1, __private const int ny1,
+  __global real *f2, __global const int *types2, __global const real *values2, __private const int nx2, __private const int ny2,
+  __private const int ng
+)
+{
+  int k = get_global_id(0);
+  applyBoundaryCell(f0, types0, values0, k, nx0, ny0, ng);
+  applyBoundaryCell(f1, types1, values1, k, nx1, ny1, ng);
+  applyBoundaryCell(f2, types2, values2, k, nx2, ny2, ng);
+}
+)CLC"};
+
+// Kernels for mixed-precision iterative refinement. Kept apart from
+// FAFS_PROGRAM as they need cl_khr_fp64 whatever the working precision.
+const std::string FAFS_FP64_PROGRAM{R"CLC(
+__kernel void toDouble(
+  __global double *out,
+  __global const real *in,
+  __private const int nx,
+  __private const int ny,
+  __private const int ng
+)
+{
+  int idx = index(gid(DIM_I, ng), gid(DIM_J, ng), nx, ny, ng);
+  out[idx] = in[idx];
+}
+
+__kernel void toReal(
+  __global real *out,
+  __global const double *in,
+  __private const int nx,
+  __private const int ny,
+  __private const int ng
+)
+{
+  int idx = index(gid(DIM_I, ng), gid(DIM_J, ng), nx, ny, ng);
+  out[idx] = in[idx];
+}
+
+// Residual b - Ax of the system solved by applyJacobiStep, computed in double
+// from a double solution. With isVonNeumann, neighbours are clamped to the
+// interior rather than read from the ghost cells of x.
+__kernel void calcJacobiResidualDouble(
+  __global real *out,
+  __global const double *x,
+  __private const double alpha,
+  __private const double beta,
+  __private const double gamma,
+  __global const real *b,
+  __private const int isVonNeumann,
+  __private const int nx,
+  __private const int ny,
+  __private const int ng
+)
+{
+  int i = gid(DIM_I, ng);
+  int j = gid(DIM_J, ng);
+  int lo = isVonNeumann ? 0 : -1;
+
+  int ij = index(i, j, nx, ny, ng);
+  int ipj = index(min(i+1, nx-1-lo), j, nx, ny, ng);
+  int imj = index(max(i-1, lo), j, nx, ny, ng);
+  int ijp = index(i, min(j+1, ny-1-lo), nx, ny, ng);
+  int ijm = index(i, max(j-1, lo), nx, ny, ng);
+
+  double res = (double)b[ij] - x[ij]/alpha - (x[ipj] + x[imj])/beta - (x[ijp] + x[ijm])/gamma;
+  out[ij] = res;
+}
+
+__kernel void addCorrection(
+  __global double *x,
+  __global const real *correction,
+  __private const int nx,
+  __private const int ny,
+  __private const int ng
+)
+{
+  int idx = index(gid(DIM_I, ng), gid(DIM_J, ng), nx, ny, ng);
+  x[idx] += correction[idx];
+}
+)CLC"};
+
+// Kernels for arrays stored in half precision. Values are widened to real by
+// vload_half on every read and rounded by vstore_half on every write, so only
+// storage needs fp16, not cl_khr_fp16 arithmetic.
+const std::string FAFS_HALF_PROGRAM{R"CLC(
+__kernel void toHalf(
+  __global half *out,
+  __global const real *in,
+  __private const int nx,
+  __private const int ny,
+  __private const int ng
+)
+{
+  int idx = index(gid(DIM_I, ng), gid(DIM_J, ng), nx, ny, ng);
+  vstore_half(in[idx], idx, out);
+}
+
+__kernel void fromHalf(
+  __global real *out,
+  __global const half *in,
+  __private const int nx,
+  __private const int ny,
+  __private const int ng
+)
+{
+  int idx = index(gid(DIM_I, ng), gid(DIM_J, ng), nx, ny, ng);
+  out[idx] = vload_half(idx, in);
+}
+
+__kernel void fillHalf(
+  __global half *out,
+  __private const real val,
+  __private const int nx,
+  __private const int ny,
+  __private const int ng
+)
+{
+  vstore_half(val, index(gid(DIM_I, ng), gid(DIM_J, ng), nx, ny, ng), out);
+}
+
+real interpolateHalf(BilinearStencil s, __global const half *f) {
+  real fy1 = s.x1Weight*vload_half(s.x1y1, f) + s.x2Weight*vload_half(s.x2y1, f);
+  real fy2 = s.x1Weight*vload_half(s.x1y2, f) + s.x2Weight*vload_half(s.x2y2, f);
+  return s.y1Weight*fy1 + s.y2Weight*fy2;
+}
+
+// Advects a half scalar by velocities held in real
+__kernel void advectHalf(
+  __global half *out,
+  __global const half *f,
+  __global const real *vx,
+  __global const real *vy,
+  __private const real dx,
+  __private const real dy,
+  __private const real dt,
+  __private const int nx,
+  __private const int ny,
+  __private const int ng
+) {
+  int i = gid(DIM_I, ng);
+  int j = gid(DIM_J, ng);
+
+  int ij = index(i, j, nx, ny, ng);
+
+  BilinearStencil s = backTrace(i, j, vx[ij], vy[ij], dx, dy, dt, nx, ny, ng);
+  vstore_half(interpolateHalf(s, f), ij, out);
+}
+
+__kernel void applyJacobiStepHalf(
+  __global half *out,
+  __global const half *in,
+  __private const real alpha,
+  __private const real beta,
+  __private const real gamma,
+  __global const half *b,
+  __private const int nx,
+  __private const int ny,
+  __private const int ng
+)
+{
+  int i = gid(DIM_I, ng);
+  int j = gid(DIM_J, ng);
+
+  int ij = index(i, j, nx, ny, ng);
+  real ipj = vload_half(index(i+1, j, nx, ny, ng), in);
+  real imj = vload_half(index(i-1, j, nx, ny, ng), in);
+  real ijp = vload_half(index(i, j+1, nx, ny, ng), in);
+  real ijm = vload_half(index(i, j-1, nx, ny, ng), in);
+
+  vstore_half(alpha*(vload_half(ij, b) - (ipj + imj)/beta - (ijp + ijm)/gamma), ij, out);
+}
+
+// As applyBoundaryConditions in FAFS_PROGRAM, for a single array
+__kernel void applyBoundaryConditionsHalf(
+  __global half *f,
+  __global const int *types,
+  __global const real *values,
+  __private const int nx,
+  __private const int ny,
+  __private const int ng
+)
+{
+  int i, j;
+  if(!ghostRingCell(get_global_id(0), nx, ny, ng, &i, &j)) {
+    return;
+  }
+  int ij = index(i, j, nx, ny, ng);
+  values += get_global_id(2)*4;
+
+  int si = i;
+  if(!resolveGhost(&si, nx, types[2], types[3])) {
+    vstore_half(i < 0 ? values[2] : values[3], ij, f);
+    return;
+  }
+  int sj = j;
+  if(!resolveGhost(&sj, ny, types[0], types[1])) {
+    vstore_half(j < 0 ? values[0] : values[1], ij, f);
+    return;
+  }
+  vstore_half(vload_half(index(si, sj, nx, ny, ng), f), ij, f);
+}
+
+// As applyVonNeumannBC_y and applyVonNeumannBC_x in FAFS_PROGRAM
+__kernel void applyVonNeumannBCHalf_y(
+  __global half *out,
+  __private const int nx,
+  __private const int ny,
+  __private const int ng
+)
+{
+  int i = gid(DIM_I, ng);
+  vstore_half(vload_half(index(i, 0, nx, ny, ng), out), index(i, -1, nx, ny, ng), out);
+  vstore_half(vload_half(index(i, ny-1, nx, ny, ng), out), index(i, ny, nx, ny, ng), out);
+}
+
+__kernel void applyVonNeumannBCHalf_x(
+  __global half *out,
+  __private const int nx,
+  __private const int ny,
+  __private const int ng
+)
+{
+  int j = gid(DIM_J, ng);
+  vstore_half(vload_half(index(0, j, nx, ny, ng), out), index(-1, j, nx, ny, ng), out);
+  vstore_half(vload_half(index(nx-1, j, nx, ny, ng), out), index(nx, j, nx, ny, ng), out);
+}
+
+__kernel void calcJacobiResidualNormsHalf(
+  __global real *out,
+  __global const half *in,
+  __private const real alpha,
+  __private const real beta,
+  __private const real gamma,
+  __global const half *b,
+  __local real *sums,
+  __local real *maxs,
+  __private const int nx,
+  __private const int ny,
+  __private const int ng,
+  __private const int nMembers
+)
+{
+  real sum = 0.0f;
+  real mx = 0.0f;
+  for(int n=get_global_id(0); n<nMembers*nx*ny; n+=get_global_size(0)) {
+    int m, i, j;
+    interiorCell(n, nx, ny, &m, &i, &j);
+
+    int ij = memberIndex(m, i, j, nx, ny, ng);
+    real ipj = vload_half(memberIndex(m, i+1, j, nx, ny, ng), in);
+    real imj = vload_half(memberIndex(m, i-1, j, nx, ny, ng), in);
+    real ijp = vload_half(memberIndex(m, i, j+1, nx, ny, ng), in);
+    real ijm = vload_half(memberIndex(m, i, j-1, nx, ny, ng), in);
+
+    real res = vload_half(ij, b) - vload_half(ij, in)/alpha - (ipj + imj)/beta - (ijp + ijm)/gamma;
+    sum += res*res;
+    mx = fmax(mx, fabs(res));
+  }
+  reduceNorms(out, sums, maxs, sum, mx);
+}
+
+// Advects both half velocity components from a single back-trace
+__kernel void advectVelocityHalf(
+  __global half *outx,
+  __global half *outy,
+  __global const half *vx,
+  __global const half *vy,
+  __private const real dx,
+  __private const real dy,
+  __private const real dt,
+  __private const int nx,
+  __private const int ny,
+  __private const int ng
+) {
+  int i = gid(DIM_I, ng);
+  int j = gid(DIM_J, ng);
+
+  int ij = index(i, j, nx, ny, ng);
+
+  BilinearStencil s = backTrace(i, j, vload_half(ij, vx), vload_half(ij, vy), dx, dy, dt, nx, ny, ng);
+  vstore_half(interpolateHalf(s, vx), ij, outx);
+  vstore_half(interpolateHalf(s, vy), ij, outy);
+}
+
+// As calcDivergence in FAFS_PROGRAM, of half velocities into a half array
+__kernel void calcDivergenceHalf(
+  __global half *out,
+  __global const half *fx,
+  __global const half *fy,
+  __private const real dx,
+  __private const real dy,
+  __private const int nx,
+  __private const int ny,
+  __private const int ng
+)
+{
+  int i = gid(DIM_I, ng);
+  int j = gid(DIM_J, ng);
+
+  int vij   = index(i,   j,   nx-1, ny-1, ng);
+  int vijm  = index(i,   j-1, nx-1, ny-1, ng);
+  int vimj  = index(i-1, j,   nx-1, ny-1, ng);
+  int vimjm = index(i-1, j-1, nx-1, ny-1, ng);
+
+  real dvxdx = 0.5f*((vload_half(vij, fx) - vload_half(vimj, fx))/dx + (vload_half(vijm, fx) - vload_half(vimjm, fx))/dx);
+  real dvydy = 0.5f*((vload_half(vij, fy) - vload_half(vijm, fy))/dy + (vload_half(vimj, fy) - vload_half(vimjm, fy))/dy);
+
+  vstore_half(dvydy + dvxdx, index(i, j, nx, ny, ng), out);
+}
+
+// As applyProjectionX and applyProjectionY in FAFS_PROGRAM, for half
+// velocities and pressure
+__kernel void applyProjectionXHalf(
+  __global half *out,
+  __global const half *f,
+  __private const real dx,
+  __private const int nx,
+  __private const int ny,
+  __private const int ng
+)
+{
+  int i = gid(DIM_I, ng);
+  int j = gid(DIM_J, ng);
+
+  int ij = index(i, j, nx, ny, ng);
+  real fij   = vload_half(index(i,   j,   nx+1, ny+1, ng), f);
+  real fijp  = vload_half(index(i,   j+1, nx+1, ny+1, ng), f);
+  real fipj  = vload_half(index(i+1, j,   nx+1, ny+1, ng), f);
+  real fipjp = vload_half(index(i+1, j+1, nx+1, ny+1, ng), f);
+
+  real dfdx = 0.5f*((fipj - fij)/dx + (fipjp - fijp)/dx);
+  vstore_half(vload_half(ij, out) - dfdx, ij, out);
+}
+
+__kernel void applyProjectionYHalf(
+  __global half *out,
+  __global const half *f,
+  __private const real dy,
+  __private const int nx,
+  __private const int ny,
+  __private const int ng
+)
+{
+  int i = gid(DIM_I, ng);
+  int j = gid(DIM_J, ng);
+
+  int ij = index(i, j, nx, ny, ng);
+  real fij   = vload_half(index(i,   j,   nx+1, ny+1, ng), f);
+  real fijp  = vload_half(index(i,   j+1, nx+1, ny+1, ng), f);
+  real fipj  = vload_half(index(i+1, j,   nx+1, ny+1, ng), f);
+  real fipjp = vload_half(index(i+1, j+1, nx+1, ny+1, ng), f);
+
+  real dfdy = 0.5f*((fijp - fij)/dy + (fipjp - fipj)/dy);
+  vstore_half(vload_half(ij, out) - dfdy, ij, out);
+}
+)CLC"};
+
+Fp64Kernels::Fp64Kernels():
+  program{buildProgramFromString("#pragma OPENCL EXTENSION cl_khr_fp64 : enable\n" + programSource(FAFS_FP64_PROGRAM))},
+  toDouble{createKernelFunctor<convertPrecision_k>(program, "toDouble")},
+  toReal{createKernelFunctor<convertPrecision_k>(program, "toReal")},
+  calcJacobiResidualDouble{createKernelFunctor<calcJacobiResidualDouble_k>(program, "calcJacobiResidualDouble")},
+  addCorrection{createKernelFunctor<convertPrecision_k>(program, "addCorrection")}
+{}
+
+// Smallest work-group size limit of any kernel of program on device
+size_t programWorkGroupSize(cl::Program program, const cl::Device& device) {
+  std::vector<cl::Kernel> all;
+  program.createKernels(&all);
+  size_t size = device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>();
+  for(const cl::Kernel& kernel : all) {
+    size = std::min(size, kernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device));
+  }
+  return size;
+}
+
+size_t Fp64Kernels::maxWorkGroupSize(const cl::Device& device) {
+  return programWorkGroupSize(program, device);
+}
+
+Fp64Kernels& fp64Kernels() {
+  static Fp64Kernels kernels;
+  return kernels;
+}
+
+HalfKernels::HalfKernels():
+  program{buildProgramFromString(programSource(FAFS_HALF_PROGRAM))},
+  toHalf{createKernelFunctor<convertPrecision_k>(program, "toHalf")},
+  fromHalf{createKernelFunctor<convertPrecision_k>(program, "fromHalf")},
+  fill{createKernelFunctor<fillKernel>(program, "fillHalf")},
+  advect{createKernelFunctor<advect_k>(program, "advectHalf")},
+  applyJacobiStep{createKernelFunctor<applyJacobiKernel>(program, "applyJacobiStepHalf")},
+  applyBoundaryConditions{createKernelFunctor<applyBoundaryConditionsHalf_k>(program, "applyBoundaryConditionsHalf")},
+  applyVonNeumannBC_x{createKernelFunctor<vonNeumannKernel>(program, "applyVonNeumannBCHalf_x")},
+  applyVonNeumannBC_y{createKernelFunctor<vonNeumannKernel>(program, "applyVonNeumannBCHalf_y")},
+  calcJacobiResidualNorms{createKernelFunctor<calcJacobiResidualNorms_k>(program, "calcJacobiResidualNormsHalf")},
+  advectVelocity{createKernelFunctor<advectVelocity_k>(program, "advectVelocityHalf")},
+  calcDivergence{createKernelFunctor<calcDivergence_k>(program, "calcDivergenceHalf")},
+  applyProjectionX{createKernelFunctor<applyProjection_k>(program, "applyProjectionXHalf")},
+  applyProjectionY{createKernelFunctor<applyProjection_k>(program, "applyProjectionYHalf")}
+{}
+
+size_t HalfKernels::maxWorkGroupSize(const cl::Device& device) {
+  return programWorkGroupSize(program, device);
+}
+
+HalfKernels& halfKernels() {
+  static HalfKernels kernels;
+  return kernels;
+}
+
+size_t Kernels::maxWorkGroupSize(const cl::Device& device) {
+  return programWorkGroupSize(program, device);
+}
+
+Kernels& kernels() {
+  // Built on first use rather than during static initialisation, so for the
+  // devices of the default context as set up by main
+  static Kernels kernels;
+  return kernels;
+}
+
+std::tuple<int, int, int, real, real, real> systemKey(const LinearSystem& system) {
+  return {system.nx, system.ny, system.ng, system.alpha, system.beta, system.gamma};
+}
+
+// Specialised kernels of each registered system, null until first used
+std::map<std::tuple<int, int, int, real, real, real>, std::unique_ptr<Kernels>> g_linearSystemKernels;
+
+std::string specialisationOptions(const LinearSystem& system) {
+  // Hexadecimal literals are exact, so the constants equal the arguments the
+  // generic kernels would be launched with
+  const std::string suffix = sizeof(real) == sizeof(float) ? "f" : "";
+  std::ostringstream options;
+  options << std::hexfloat;
+  options << "-DFAFS_SYSTEM_NX=" << system.nx;
+  options << " -DFAFS_SYSTEM_NY=" << system.ny;
+  options << " -DFAFS_SYSTEM_NG=" << system.ng;
+  options << " -DFAFS_SYSTEM_ALPHA=(" << system.alpha << suffix << ")";
+  options << " -DFAFS_SYSTEM_BETA=(" << system.beta << suffix << ")";
+  options << " -DFAFS_SYSTEM_GAMMA=(" << system.gamma << suffix << ")";
+  return options.str();
+}
+
+void specialiseLinearSystem(const LinearSystem& system) {
+  g_linearSystemKernels.emplace(systemKey(system), nullptr);
+}
+
+void clearLinearSystemSpecialisations() {
+  g_linearSystemKernels.clear();
+}
+
+Kernels& linearSystemKernels(const LinearSystem& system) {
+  if(g_linearSystemKernels.empty()) {
+    return kernels();
+  }
+  auto it = g_linearSystemKernels.find(systemKey(system));
+  if(it == g_linearSystemKernels.end()) {
+    return kernels();
+  }
+  if(!it->second) {
+    it->second = std::make_unique<Kernels>(specialisationOptions(system));
+  }
+  return *it->second;
+}
+
+size_t linearSystemsMaxWorkGroupSize(const cl::Device& device) {
+  size_t size = kernels().maxWorkGroupSize(device);
+  for(const auto& entry : g_linearSystemKernels) {
+    const auto& [nx, ny, ng, alpha, beta, gamma] = entry.first;
+    size = std::min(size, linearSystemKernels({nx, ny, ng, alpha, beta, gamma}).maxWorkGroupSize(device));
+  }
+  return size;
+}
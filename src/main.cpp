@@ -1,142 +1,251 @@
 #include <iostream>
+#include <chrono>
 #include <memory>
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <vector>
 #include <cassert>
 
 #include <ocl_utility.hpp>
 #include <constants.hpp>
 #include <precision.hpp>
-#include <openmp_implementation.hpp>
 #include <variables.hpp>
 #include <array2d.hpp>
 #include <ocl_array.hpp>
 #include <user_kernels.hpp>
 #include <hdffile.hpp>
-
-void applyVxBC(OpenCLArray& vx) {
-  applyNoSlipBC(vx);
-  vx.setUpperBoundary(1.0f);
-  vx.setLeftBoundary(0.0f);
-  vx.setRightBoundary(0.0f);
+#include <snapshot_writer.hpp>
+#include <time_series.hpp>
+#include <checkpoint.hpp>
+#include <solver.hpp>
+#include <opencl_backend.hpp>
+#include <openmp_backend.hpp>
+#include <work_group_tuning.hpp>
+#ifdef FAFS_USE_MPI
+#include <mpi.h>
+#include <decomposition.hpp>
+#include <mpi_backend.hpp>
+#endif
+
+std::string snapshotName(const int n) {
+  std::ostringstream name;
+  name << std::setw(6) << std::setfill('0') << n << ".hdf5";
+  return name.str();
 }
 
-void applyVyBC(OpenCLArray& vy) {
-  applyNoSlipBC(vy);
+// Wall time of the time loop, so that backends can be compared
+void printLoopTime(const std::chrono::steady_clock::time_point start) {
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  std::cout << "Time loop took " << elapsed.count() << " s" << std::endl;
 }
 
-void applyPressureBC(OpenCLArray& p) {
-  applyVonNeumannBC(p);
-}
+// Snapshots are written synchronously, and checkpoints are not supported
+int runOpenMP(const Constants& c) {
+  c.print();
 
-void applyBoundaryConditions(Variables<OpenCLArray>& vars) {
-  applyVxBC(vars.vx);
-  applyVyBC(vars.vy);
-  applyPressureBC(vars.p);
-}
+  Solver<OpenMPBackend> solver(c);
+  Variables<Array>& vars = solver.variables();
+  solver.applyBoundaryConditions();
 
-void setInitialConditions(Variables<OpenCLArray>& vars) {
-  vars.vx.fill(0.0f, true);
-  vars.vy.fill(0.0f, true);
-  vars.p.fill(0.0f, true);
-}
+  std::unique_ptr<TimeSeriesWriter> series;
+  if(c.outputInterval > 0 && c.timeSeriesFile != "") {
+    series = std::make_unique<TimeSeriesWriter>(c.timeSeriesFile, FileMode::Truncate);
+  }
+  auto writeSnapshot = [&](const int n, const real t, const int step) {
+    if(series) {
+      series->append(t, step, {&vars.vx, &vars.vy, &vars.p});
+    } else {
+      HDFFile file(snapshotName(n), false);
+      vars.vx.saveTo(file.file);
+      vars.vy.saveTo(file.file);
+      vars.p.saveTo(file.file);
+      file.close();
+    }
+  };
+  int nSnapshots = 0;
+  writeSnapshot(nSnapshots, 0, 0);
 
-int runOCL() {
-  const Constants c;
+  real t = 0;
+  int step = 0;
+  const auto loopStart = std::chrono::steady_clock::now();
+  while (t < c.totalTime) {
+    solver.step(t);
 
-  c.print();
+    t += c.dt;
+    ++step;
 
-  int error = setDefaultPlatform("CUDA");
-  if (error < 0) return -1;
+    if(c.outputInterval > 0 && step % c.outputInterval == 0) {
+      writeSnapshot(++nSnapshots, t, step);
+    }
+  }
+  printLoopTime(loopStart);
 
-  cl::DeviceCommandQueue deviceQueue = cl::DeviceCommandQueue::makeDefault(
-      cl::Context::getDefault(), cl::Device::getDefault());
+  HDFFile laterFile(snapshotName(++nSnapshots), false);
+  vars.vx.saveTo(laterFile.file);
+  vars.vy.saveTo(laterFile.file);
+  vars.p.saveTo(laterFile.file);
+  solver.divergence().saveTo(laterFile.file);
+  laterFile.close();
 
-  Variables <OpenCLArray> vars(c);
+  return 0;
+}
 
-  setInitialConditions(vars);
-  applyBoundaryConditions(vars);
+#ifdef FAFS_USE_MPI
+// Each rank advances one block of the grid. Snapshots are gathered to rank 0,
+// which writes them and prints solver statistics for the whole grid.
+int runMPI(const Constants& c) {
+  // MPI is only called between OpenMP parallel regions
+  int threadSupport;
+  MPI_Init_thread(nullptr, nullptr, MPI_THREAD_FUNNELED, &threadSupport);
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  std::streambuf* coutBuffer = std::cout.rdbuf();
+  if(rank != 0) {
+    std::cout.rdbuf(nullptr);
+  }
 
-  // Working arrays located at boundaries
-  OpenCLArray boundTemp1(c.nx, c.ny, c.ng, "boundTemp1");
-  OpenCLArray boundTemp2(c.nx, c.ny, c.ng, "boundTemp2");
-  // Working arrays located at cell centres
-  OpenCLArray cellTemp1(c.nx+1, c.ny+1, c.ng, "cellTemp1");
-  OpenCLArray cellTemp2(c.nx+1, c.ny+1, c.ng, "cellTemp2");
-  // Working array for divergence
-  OpenCLArray divw(c.nx+1, c.ny+1, c.ng, "divw");
+  {
+    Decomposition d(MPI_COMM_WORLD, c.nx, c.ny);
+    std::cout << "Decomposed into " << d.dims[0] << "x" << d.dims[1] << " blocks" << std::endl;
+    c.print();
 
-  HDFFile icFile("000000.hdf5", false);
-  vars.vx.saveTo(icFile.file);
-  vars.vy.saveTo(icFile.file);
-  vars.p.saveTo(icFile.file);
-  icFile.close();
+    Solver<MPIBackend> solver(d.localConstants(c), d);
+    Variables<Array>& vars = solver.variables();
+    solver.applyBoundaryConditions();
 
-  real t=0;
-  while (t < c.totalTime) {
-    // ADVECTION
-    if(c.isAdvectionImplicit) {
-      advectImplicit(boundTemp1, vars.vx, vars.vx, vars.vy, c.dx, c.dy, c.dt);
-      advectImplicit(boundTemp2, vars.vy, vars.vx, vars.vy, c.dx, c.dy, c.dt);
-      vars.vx.swapData(boundTemp1);
-      vars.vy.swapData(boundTemp2);
-    } else {
-      calcAdvectionTerm(boundTemp1, vars.vx, vars.vx, vars.vy, c.dx, c.dy);
-      calcAdvectionTerm(boundTemp2, vars.vy, vars.vx, vars.vy, c.dx, c.dy);
-      advanceEuler(vars.vx, boundTemp1, c.dt);
-      advanceEuler(vars.vy, boundTemp2, c.dt);
+    std::unique_ptr<Variables<Array>> whole;
+    std::unique_ptr<Array> wholeDivergence;
+    if(rank == 0) {
+      whole = std::make_unique<Variables<Array>>(c);
+      wholeDivergence = std::make_unique<Array>(c.nx+1, c.ny+1, c.ng, "divw");
+    }
+    auto writeSnapshot = [&](const int n, const bool withDivergence) {
+      d.gather(vars.vx, whole ? &whole->vx : nullptr);
+      d.gather(vars.vy, whole ? &whole->vy : nullptr);
+      d.gather(vars.p, whole ? &whole->p : nullptr);
+      if(withDivergence) {
+        d.gather(solver.divergence(), wholeDivergence.get());
+      }
+      if(rank == 0) {
+        HDFFile file(snapshotName(n), false);
+        whole->vx.saveTo(file.file);
+        whole->vy.saveTo(file.file);
+        whole->p.saveTo(file.file);
+        if(withDivergence) {
+          wholeDivergence->saveTo(file.file);
+        }
+        file.close();
+      }
+    };
+    int nSnapshots = 0;
+    writeSnapshot(nSnapshots, false);
+
+    real t = 0;
+    int step = 0;
+    const auto loopStart = std::chrono::steady_clock::now();
+    while (t < c.totalTime) {
+      solver.step(t);
+
+      t += c.dt;
+      ++step;
+
+      if(c.outputInterval > 0 && step % c.outputInterval == 0) {
+        writeSnapshot(++nSnapshots, false);
+      }
     }
+    printLoopTime(loopStart);
+    writeSnapshot(++nSnapshots, true);
+  }
 
-    applyBoundaryConditions(vars);
+  std::cout.rdbuf(coutBuffer);
+  MPI_Finalize();
+  return 0;
+}
+#endif
 
-    real dx2dy2 = c.dx*c.dx + c.dy*c.dy;
+int runOCL(const Constants& c, const std::string& restartFile, const int nDevices, const std::string& workGroupFile) {
+  c.print();
 
-    // DIFFUSION
-    if(c.isDiffusionImplicit) {
-      real alpha = 1.0f/(1.0f + 2.0f*c.dt/c.Re*(1.0f/(c.dx*c.dx) + 1.0f/(c.dy*c.dy)));
-      real beta  = -c.Re*c.dx*c.dx/c.dt;
-      real gamma = -c.Re*c.dy*c.dy/c.dt;
+  int error = setDefaultPlatform("CUDA");
+  if (error < 0) return -1;
+  if(nDevices > 1) {
+    setDefaultDevices(nDevices);
+  }
+  if(workGroupFile != "") {
+    tuneWorkGroupSizes(workGroupFile, c);
+  }
 
-      boundTemp1.fill(0.0f, true);
-      applyVxBC(boundTemp1);
-      applyVxBC(boundTemp2);
-      runJacobiIteration(vars.vx, boundTemp1, boundTemp2, alpha, beta, gamma, vars.vx);
+  Solver<OpenCLBackend> solver(c);
+  Variables<OpenCLArray>& vars = solver.variables();
+  OpenCLArray& divw = solver.divergence();
 
-      boundTemp1.fill(0.0f, true);
-      applyVyBC(boundTemp1);
-      applyVyBC(boundTemp2);
-      runJacobiIteration(vars.vy, boundTemp1, boundTemp2, alpha, beta, gamma, vars.vy);
-    } else {
-      calcDiffusionTerm(boundTemp1, vars.vx, c.dx, c.dy, c.Re);
-      advanceEuler(vars.vx, boundTemp1, c.dt);
+  const bool isRestart = restartFile != "";
+  RunState state{0, 0};
+  if(isRestart) {
+    state = readCheckpoint(restartFile, vars);
+    std::cout << "Restarting from " << restartFile << " at t = " << state.t << ", step " << state.step << std::endl;
+  }
+  solver.applyBoundaryConditions();
 
-      calcDiffusionTerm(boundTemp1, vars.vy, c.dx, c.dy, c.Re);
-      advanceEuler(vars.vy, boundTemp1, c.dt);
+  // Declared before the writer so that it outlives the writer's thread
+  std::unique_ptr<TimeSeriesWriter> series;
+  if(c.outputInterval > 0 && c.timeSeriesFile != "") {
+    series = std::make_unique<TimeSeriesWriter>(c.timeSeriesFile, isRestart ? FileMode::Append : FileMode::Truncate);
+    series->discardFramesAfter(state.step);
+  }
+  SnapshotWriter writer;
+  int nSnapshots = 0;
+  if(isRestart) {
+    nSnapshots = c.outputInterval > 0 ? state.step/c.outputInterval : 0;
+  } else {
+    writer.write(snapshotName(nSnapshots), {&vars.vx, &vars.vy, &vars.p});
+    if(series) {
+      writer.append(*series, 0, 0, {&vars.vx, &vars.vy, &vars.p});
     }
+  }
 
-    applyBoundaryConditions(vars);
-
-    // PROJECTION
-    divw.fill(0.0f, true);
-    calcDivergence(divw, vars.vx, vars.vy, c.dx, c.dy);
-    // Solve Poisson eq for pressure $\nabla^2 p = - \nabla \cdot v$
-    real alpha = -0.5f*(c.dx*c.dx*c.dy*c.dy)/dx2dy2;
-    real beta = c.dx*c.dx;
-    real gamma = c.dy*c.dy;
-    cellTemp1.fill(0.0f, true);
-    cellTemp2.fill(0.0f, true);
-    for(int i=0; i<200; ++i) {
-      applyPressureBC(cellTemp1);
-      g_kernels.applyJacobiStep(cellTemp2.interior, cellTemp2.getDeviceData(), cellTemp1.getDeviceData(), alpha, beta, gamma, divw.getDeviceData(), cellTemp2.nx, cellTemp2.ny, cellTemp2.ng);
-      cellTemp1.swapData(cellTemp2);
+  const bool isCheckpointing = c.checkpointInterval > 0 || c.checkpointWallTime > 0;
+  auto lastCheckpoint = std::chrono::steady_clock::now();
+  auto checkpoint = [&](const RunState& current) {
+    // Checkpoints are written synchronously, so must not overlap the writer
+    writer.flush();
+    if(series) {
+      series->flush();
     }
-    vars.p.swapData(cellTemp1);
-    applyPressureBC(vars.p);
-    // Project onto incompressible velocity space
-    applyProjectionX(vars.vx, vars.p, c.dx);
-    applyProjectionY(vars.vy, vars.p, c.dy);
+    writeCheckpoint(c.checkpointFile, vars, current, c);
+    lastCheckpoint = std::chrono::steady_clock::now();
+  };
 
-    applyBoundaryConditions(vars);
+  real t = state.t;
+  int step = state.step;
+  const auto loopStart = std::chrono::steady_clock::now();
+  while (t < c.totalTime) {
+    solver.step(t);
 
     t += c.dt;
+    ++step;
+
+    if(c.outputInterval > 0 && step % c.outputInterval == 0) {
+      if(series) {
+        writer.append(*series, t, step, {&vars.vx, &vars.vy, &vars.p});
+      } else {
+        writer.write(snapshotName(++nSnapshots), {&vars.vx, &vars.vy, &vars.p});
+      }
+    }
+
+    const std::chrono::duration<real> sinceCheckpoint = std::chrono::steady_clock::now() - lastCheckpoint;
+    if((c.checkpointInterval > 0 && step % c.checkpointInterval == 0)
+        || (c.checkpointWallTime > 0 && sinceCheckpoint.count() >= c.checkpointWallTime)) {
+      checkpoint({t, step});
+    }
+  }
+
+  solver.finish();
+  printLoopTime(loopStart);
+
+  if(isCheckpointing) {
+    checkpoint({t, step});
   }
 
   // DEBUG
@@ -174,7 +283,9 @@ int runOCL() {
   calcDivergence(divw, vars.vx, vars.vy, c.dx, c.dy);
   // END DEBUG
 
-  HDFFile laterFile("000001.hdf5", false);
+  // Debug output is written synchronously, so must not overlap the writer
+  writer.flush();
+  HDFFile laterFile(snapshotName(++nSnapshots), false);
   vars.vx.saveTo(laterFile.file);
   vars.vy.saveTo(laterFile.file);
   vars.p.saveTo(laterFile.file);
@@ -184,12 +295,106 @@ int runOCL() {
   dpdx.saveTo(laterFile.file);
   dpdy.saveTo(laterFile.file);
   // END DEBUG
-  icFile.close();
+  laterFile.close();
 
   return 0;
 }
 
-int main() {
-  return runOCL();
-  //return runCPU();
+int main(int argc, char* argv[]) {
+  Constants c;
+  std::string restartFile;
+  std::string backend = "opencl";
+  int nDevices = 1;
+  std::string workGroupFile;
+  for(int i=1; i<argc; ++i) {
+    const std::string arg(argv[i]);
+    if(arg == "--backend" && i+1 < argc) {
+      backend = argv[++i];
+    } else if(arg == "--restart" && i+1 < argc) {
+      // Replaces all constants, so options given before --restart are lost
+      restartFile = argv[++i];
+      c = readCheckpointConstants(restartFile);
+    } else if(arg == "--ensemble" && i+1 < argc) {
+      // Members differ only in lid velocity
+      c.nMembers = std::stoi(argv[++i]);
+    } else if(arg == "--lid-velocity" && i+1 < argc) {
+      c.lidVelocity = std::stof(argv[++i]);
+    } else if(arg == "--lid-velocity-step" && i+1 < argc) {
+      c.lidVelocityStep = std::stof(argv[++i]);
+    } else if(arg == "--mixed-precision") {
+      c.isPressureMixedPrecision = true;
+    } else if(arg == "--devices" && i+1 < argc) {
+      // Only the pressure solve is split, and only the Jacobi solver splits
+      nDevices = std::stoi(argv[++i]);
+      c.pressureSolver = SolverType::Jacobi;
+    } else if(arg == "--work-groups" && i+1 < argc) {
+      workGroupFile = argv[++i];
+    } else if(arg == "--kernel-cache" && i+1 < argc) {
+      setProgramCacheDirectory(argv[++i]);
+    } else if(arg == "--tiled") {
+      c.useTiledKernels = true;
+    } else if(arg == "--specialise") {
+      c.specialiseKernels = true;
+    } else if(arg == "--half-storage") {
+      // Only the Jacobi solves have kernels for half arrays
+      c.isHalfStorage = true;
+      c.pressureSolver = SolverType::Jacobi;
+      c.diffusionSolver = SolverType::Jacobi;
+    } else if(arg == "--output-interval" && i+1 < argc) {
+      c.outputInterval = std::stoi(argv[++i]);
+    } else if(arg == "--time-series" && i+1 < argc) {
+      c.timeSeriesFile = argv[++i];
+    } else if(arg == "--separate-snapshots") {
+      c.timeSeriesFile = "";
+    } else if(arg == "--checkpoint" && i+1 < argc) {
+      c.checkpointFile = argv[++i];
+    } else if(arg == "--checkpoint-interval" && i+1 < argc) {
+      c.checkpointInterval = std::stoi(argv[++i]);
+    } else if(arg == "--checkpoint-wall-time" && i+1 < argc) {
+      c.checkpointWallTime = std::stof(argv[++i]);
+    } else {
+      std::cerr << "Unknown argument: " << arg << std::endl;
+      return -1;
+    }
+  }
+
+  if(c.nMembers > 1 && (c.pressureSolver == SolverType::CG || c.diffusionSolver == SolverType::CG)) {
+    std::cerr << "CG solvers cannot be used with an ensemble" << std::endl;
+    return -1;
+  }
+
+  if(nDevices > 1 && backend != "opencl") {
+    std::cerr << "Multiple devices need the OpenCL backend" << std::endl;
+    return -1;
+  }
+
+  if(workGroupFile != "" && backend != "opencl") {
+    std::cerr << "Work-group tuning needs the OpenCL backend" << std::endl;
+    return -1;
+  }
+
+  if(c.isHalfStorage && backend != "opencl") {
+    std::cerr << "Half storage needs the OpenCL backend" << std::endl;
+    return -1;
+  }
+
+  if(backend == "openmp") {
+    if(restartFile != "" || c.checkpointInterval > 0 || c.checkpointWallTime > 0) {
+      std::cerr << "Checkpoints need the OpenCL backend" << std::endl;
+      return -1;
+    }
+    return runOpenMP(c);
+#ifdef FAFS_USE_MPI
+  } else if(backend == "mpi") {
+    if(restartFile != "" || c.checkpointInterval > 0 || c.checkpointWallTime > 0) {
+      std::cerr << "Checkpoints need the OpenCL backend" << std::endl;
+      return -1;
+    }
+    return runMPI(c);
+#endif
+  } else if(backend != "opencl") {
+    std::cerr << "Unknown backend: " << backend << std::endl;
+    return -1;
+  }
+  return runOCL(c, restartFile, nDevices, workGroupFile);
 }
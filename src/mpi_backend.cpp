@@ -0,0 +1,147 @@
+#ifdef FAFS_USE_MPI
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+#include <mpi_backend.hpp>
+#include <openmp_kernels.hpp>
+
+// Cells along the edges of a, which a five-point stencil computes from its
+// ghost cells
+std::array<CellRange, N_BOUNDARY_SIDES> edgeRanges(const Array& a) {
+  return {{
+    {0, 0, a.nx, 1},
+    {0, a.ny-1, a.nx, a.ny},
+    {0, 1, 1, a.ny-1},
+    {a.nx-1, 1, a.nx, a.ny-1}
+  }};
+}
+
+MPIBackend::MPIBackend(const Constants& c, const Decomposition& d):
+  OpenMPBackend(c),
+  d(d),
+  vxHalo(d, c.nx, c.ny, c.ng),
+  vyHalo(d, c.nx, c.ny, c.ng),
+  cellHalo(d, c.nx+1, c.ny+1, c.ng)
+{
+  physical = d.physicalSides();
+}
+
+void MPIBackend::applyVelocityBC(Variables<Array>& vars) {
+  vxHalo.begin(vars.vx);
+  vyHalo.begin(vars.vy);
+  vxHalo.finish(vars.vx);
+  vyHalo.finish(vars.vy);
+  OpenMPBackend::applyVelocityBC(vars);
+}
+
+void MPIBackend::applyPressureBC(Array& p) {
+  cellHalo.exchange(p);
+  OpenMPBackend::applyPressureBC(p);
+}
+
+// Largest magnitude of the interior of a
+real maxAbs(const Array& a) {
+  real mx = 0.0f;
+#pragma omp parallel for reduction(max:mx)
+  for(int i=0; i<a.nx; ++i) {
+    for(int j=0; j<a.ny; ++j) {
+      mx = std::max(mx, std::abs(a(i,j)));
+    }
+  }
+  return mx;
+}
+
+void MPIBackend::advect(Variables<Array>& vars) {
+  if(c.isAdvectionImplicit) {
+    // Cells a back-trace crosses along each axis, where it may cross into
+    // another block. Beyond the halo it would be clamped to this block.
+    const bool isSplitI = !physical[int(BoundarySide::Left)] || !physical[int(BoundarySide::Right)];
+    const bool isSplitJ = !physical[int(BoundarySide::Lower)] || !physical[int(BoundarySide::Upper)];
+    real courant[2] = {isSplitI ? maxAbs(vars.vx)*c.dt/c.dx : 0.0f, isSplitJ ? maxAbs(vars.vy)*c.dt/c.dy : 0.0f};
+    MPI_Allreduce(MPI_IN_PLACE, courant, 2, mpiType<real>(), MPI_MAX, d.comm);
+    if(courant[0] >= c.ng || courant[1] >= c.ng) {
+      throw std::runtime_error("Cannot advect across blocks: Courant number " + std::to_string(std::max(courant[0], courant[1])) +
+        " is not below the halo width " + std::to_string(c.ng) + ", so increase ng or decrease dt");
+    }
+  }
+  OpenMPBackend::advect(vars);
+}
+
+template<class BCFn>
+void MPIBackend::jacobiSweep(Array& out, Array& in, HaloExchange& halo, const real alpha, const real beta, const real gamma, const Array& b, BCFn applyBC) {
+  halo.begin(in);
+  applyJacobiStep(out, in, alpha, beta, gamma, b, {1, 1, in.nx-1, in.ny-1});
+  halo.finish(in);
+  applyBC(in);
+  for(const CellRange& edge : edgeRanges(in)) {
+    applyJacobiStep(out, in, alpha, beta, gamma, b, edge);
+  }
+}
+
+template<class BCFn>
+SolverStats MPIBackend::solveDiffusion(Array& var, HaloExchange& halo, const real alpha, const real beta, const real gamma, BCFn applyBC) {
+  // Dirichlet boundaries are held in the ghost cells of the guess, so only
+  // the halo changes between sweeps
+  boundTemp1.fill(0.0f);
+  applyBC(boundTemp1);
+  applyBC(boundTemp2);
+  auto noBC = [](Array&) {};
+  const SolverStats stats = iterateUntilConverged(c.diffusionControl,
+    [&](const int n) {
+      for(int k=0; k<n; ++k) {
+        jacobiSweep(boundTemp2, boundTemp1, halo, alpha, beta, gamma, var, noBC);
+        boundTemp1.swapData(boundTemp2);
+      }
+    },
+    [&]() {
+      halo.exchange(boundTemp1);
+      return d.allReduce(calcJacobiResidualNorms(boundTemp1, alpha, beta, gamma, var, d.ownedRange(boundTemp1)));
+    });
+  var.swapData(boundTemp1);
+  return stats;
+}
+
+std::vector<SolverStats> MPIBackend::diffuse(Variables<Array>& vars) {
+  if(!c.isDiffusionImplicit) {
+    // Reads only ghost cells set by the last applyVelocityBC
+    return OpenMPBackend::diffuse(vars);
+  }
+
+  // As OpenCLBackend
+  const real alpha = 1.0f/(1.0f + 2.0f*c.dt/c.Re*(1.0f/(c.dx*c.dx) + 1.0f/(c.dy*c.dy)));
+  const real beta  = -c.Re*c.dx*c.dx/c.dt;
+  const real gamma = -c.Re*c.dy*c.dy/c.dt;
+
+  const SolverStats vxStats = solveDiffusion(vars.vx, vxHalo, alpha, beta, gamma, [this](Array& x) { applyVxBC(x); });
+  const SolverStats vyStats = solveDiffusion(vars.vy, vyHalo, alpha, beta, gamma, [this](Array& x) { applyVyBC(x); });
+  return {vxStats, vyStats};
+}
+
+SolverStats MPIBackend::solvePressure(Array& p, const Array& div) {
+  const real dx2 = c.dx*c.dx;
+  const real dy2 = c.dy*c.dy;
+  const real alpha = -0.5f*dx2*dy2/(dx2 + dy2);
+
+  // von Neumann boundaries are reapplied before every sweep reads them
+  auto applyNeumannBC = [this](Array& x) { OpenMPBackend::applyPressureBC(x); };
+  p.fill(0.0f);
+  const SolverStats stats = iterateUntilConverged(c.pressureControl,
+    [&](const int n) {
+      for(int k=0; k<n; ++k) {
+        jacobiSweep(cellTemp, p, cellHalo, alpha, dx2, dy2, div, applyNeumannBC);
+        p.swapData(cellTemp);
+      }
+    },
+    [&]() {
+      applyPressureBC(p);
+      return d.allReduce(calcJacobiResidualNorms(p, alpha, dx2, dy2, div, d.ownedRange(p)));
+    });
+  applyPressureBC(p);
+  return stats;
+}
+
+#endif
@@ -0,0 +1,218 @@
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include <multi_device.hpp>
+#include <layout.hpp>
+#include <boundary.hpp>
+#include <user_kernels.hpp>
+
+// Lines of an array run along the contiguous axis and are stacked along the
+// other, each member after the last
+int lineLength(const OpenCLArray& a) {
+  return (I_CONTIGUOUS ? a.nx : a.ny) + 2*a.ng;
+}
+
+int nLines(const OpenCLArray& a) {
+  return I_CONTIGUOUS ? a.ny : a.nx;
+}
+
+// Enqueues a copy of count lines of every member of src from line srcK into
+// dst from line dstK. Lines are numbered from the first non-ghost line.
+void copyLines(const cl::CommandQueue& queue, const OpenCLArray& src, const int srcK, const OpenCLArray& dst, const int dstK, const int count, const std::vector<cl::Event>* waitFor = nullptr, cl::Event* event = nullptr) {
+  const cl::size_type lineBytes = lineLength(src)*sizeof(real);
+  // One row of the copied rectangle per member
+  const cl::array<cl::size_type, 3> srcOrigin{(srcK + src.ng)*lineBytes, 0, 0};
+  const cl::array<cl::size_type, 3> dstOrigin{(dstK + dst.ng)*lineBytes, 0, 0};
+  const cl::array<cl::size_type, 3> region{count*lineBytes, cl::size_type(src.nMembers), 1};
+  queue.enqueueCopyBufferRect(src.getDeviceData(), dst.getDeviceData(), srcOrigin, dstOrigin, region,
+      (nLines(src) + 2*src.ng)*lineBytes, 0, (nLines(dst) + 2*dst.ng)*lineBytes, 0, waitFor, event);
+}
+
+// Cells along the edges of a, which a five-point stencil computes from its
+// ghost cells
+std::vector<cl::EnqueueArgs> edgeRanges(const OpenCLArray& a) {
+  return {
+    a.makeRange(0, 0, a.nx, 1),
+    a.makeRange(0, a.ny-1, a.nx, a.ny),
+    a.makeRange(0, 1, 1, a.ny-1),
+    a.makeRange(a.nx-1, 1, a.nx, a.ny-1)
+  };
+}
+
+MultiDeviceJacobiSolver::Slab::Slab(const cl::Device& device, const int nx, const int ny, const int ng, const int nMembers, const int k0):
+  queue(cl::Context::getDefault(), device),
+  haloQueue(cl::Context::getDefault(), device),
+  k0{k0},
+  n{I_CONTIGUOUS ? ny : nx},
+  x(nx, ny, ng, "x", 0.0f, nMembers),
+  temp(nx, ny, ng, "temp", 0.0f, nMembers),
+  b(nx, ny, ng, "b", 0.0f, nMembers)
+{
+  // The arrays were filled on the default queue
+  waitForQueues(queue, {cl::CommandQueue::getDefault()});
+  for(OpenCLArray* arr : {&x, &temp, &b}) {
+    arr->setQueue(queue);
+  }
+}
+
+MultiDeviceJacobiSolver::MultiDeviceJacobiSolver(const std::vector<cl::Device>& devices, const int nx, const int ny, const int ng, const int nMembers):
+  nx{nx},
+  ny{ny},
+  ng{ng},
+  nMembers{nMembers},
+  haloCopies(devices.size())
+{
+  const int n = I_CONTIGUOUS ? ny : nx;
+  const int length = I_CONTIGUOUS ? nx : ny;
+  const int nSlabs = int(devices.size());
+  // Every slab needs inner cells between its edges
+  if(nSlabs < 1 || n/nSlabs < 3 || length < 3) {
+    throw std::runtime_error("Cannot split a " + std::to_string(nx) + "x" + std::to_string(ny) + " grid into " + std::to_string(nSlabs) + " slabs");
+  }
+
+  const BoundarySide lowerSide = I_CONTIGUOUS ? BoundarySide::Lower : BoundarySide::Left;
+  const BoundarySide upperSide = I_CONTIGUOUS ? BoundarySide::Upper : BoundarySide::Right;
+  for(int s=0; s<nSlabs; ++s) {
+    int slabN, k0;
+    splitEvenly(n, nSlabs, s, slabN, k0);
+    slabs.push_back(std::make_unique<Slab>(devices[s], I_CONTIGUOUS ? nx : slabN, I_CONTIGUOUS ? slabN : ny, ng, nMembers, k0));
+
+    // Sides shared with another slab hold its edge lines
+    OpenCLArray& x = slabs.back()->x;
+    x.setBoundaryConditions(BoundaryType::Neumann);
+    if(s > 0) {
+      x.setBoundaryCondition(lowerSide, BoundaryType::Halo);
+    }
+    if(s < nSlabs-1) {
+      x.setBoundaryCondition(upperSide, BoundaryType::Halo);
+    }
+  }
+}
+
+int MultiDeviceJacobiSolver::nSlabs() const {
+  return int(slabs.size());
+}
+
+size_t MultiDeviceJacobiSolver::deviceBytes() const {
+  size_t bytes = 0;
+  for(const auto& slab : slabs) {
+    bytes += slab->x.deviceBytes() + slab->temp.deviceBytes() + slab->b.deviceBytes();
+  }
+  return bytes;
+}
+
+void MultiDeviceJacobiSolver::beginHaloExchange() {
+  std::vector<cl::Event> ready(slabs.size());
+  for(size_t s=0; s<slabs.size(); ++s) {
+    slabs[s]->queue.enqueueMarkerWithWaitList(nullptr, &ready[s]);
+  }
+
+  // Each slab's transfer queue fills its own ghost lines
+  for(size_t s=0; s<slabs.size(); ++s) {
+    Slab& slab = *slabs[s];
+    for(const size_t t : {s-1, s+1}) {
+      if(t >= slabs.size()) {
+        continue;
+      }
+      const Slab& neighbour = *slabs[t];
+      const std::vector<cl::Event> waitFor{ready[s], ready[t]};
+      cl::Event copied;
+      if(t < s) {
+        copyLines(slab.haloQueue, neighbour.x, neighbour.n - ng, slab.x, -ng, ng, &waitFor, &copied);
+      } else {
+        copyLines(slab.haloQueue, neighbour.x, 0, slab.x, slab.n, ng, &waitFor, &copied);
+      }
+      haloCopies[s].push_back(copied);
+      haloCopies[t].push_back(copied);
+    }
+  }
+}
+
+void MultiDeviceJacobiSolver::finishHaloExchange() {
+  for(size_t s=0; s<slabs.size(); ++s) {
+    if(!haloCopies[s].empty()) {
+      slabs[s]->queue.enqueueBarrierWithWaitList(&haloCopies[s]);
+      haloCopies[s].clear();
+    }
+  }
+}
+
+void MultiDeviceJacobiSolver::sweep(const real alpha, const real beta, const real gamma) {
+  beginHaloExchange();
+  for(const std::unique_ptr<Slab>& slab : slabs) {
+    OpenCLArray& out = slab->temp;
+    applyJacobiStep(out, slab->x, alpha, beta, gamma, slab->b, out.makeRange(1, 1, out.nx-1, out.ny-1));
+  }
+  finishHaloExchange();
+  for(const std::unique_ptr<Slab>& slab : slabs) {
+    applyBoundaryConditions(slab->x);
+    for(const cl::EnqueueArgs& edge : edgeRanges(slab->temp)) {
+      applyJacobiStep(slab->temp, slab->x, alpha, beta, gamma, slab->b, edge);
+    }
+    slab->x.swapData(slab->temp);
+  }
+}
+
+ResidualNorms MultiDeviceJacobiSolver::calcResidualNorms(const real alpha, const real beta, const real gamma) {
+  beginHaloExchange();
+  finishHaloExchange();
+  std::vector<PendingNorms> pending;
+  for(const std::unique_ptr<Slab>& slab : slabs) {
+    applyBoundaryConditions(slab->x);
+    pending.push_back(enqueueJacobiResidualNorms(slab->x, alpha, beta, gamma, slab->b));
+  }
+  // Slabs share no cells
+  double sumSquares = 0.0;
+  real mx = 0.0f;
+  for(PendingNorms& p : pending) {
+    const ResidualNorms norms = p.get();
+    sumSquares += double(norms.l2)*norms.l2;
+    mx = std::max(mx, norms.max);
+  }
+  return {real(std::sqrt(sumSquares)), mx};
+}
+
+SolverStats MultiDeviceJacobiSolver::solve(OpenCLArray& out, const real alpha, const real beta, const real gamma, const OpenCLArray& b, const SolverControl& control) {
+  for(const OpenCLArray* arr : std::vector<const OpenCLArray*>{&out, &b}) {
+    arr->requireRealStorage("MultiDeviceJacobiSolver");
+    if(arr->nx != nx || arr->ny != ny || arr->ng != ng || arr->nMembers != nMembers) {
+      throw std::runtime_error("Cannot solve for " + arr->getName() + " on slabs: Size differs from the solver");
+    }
+  }
+
+  // Copies to and from the whole arrays run on out's queue, so that its
+  // buffer is only used by one device
+  const cl::CommandQueue& queue = out.getQueue();
+  std::vector<cl::CommandQueue> slabQueues;
+  for(const std::unique_ptr<Slab>& slab : slabs) {
+    slabQueues.push_back(slab->queue);
+  }
+  waitForQueues(queue, slabQueues);
+  waitForQueues(queue, {b.getQueue()});
+  for(const std::unique_ptr<Slab>& slab : slabs) {
+    copyLines(queue, out, slab->k0, slab->x, 0, slab->n);
+    copyLines(queue, b, slab->k0, slab->b, 0, slab->n);
+  }
+  for(const cl::CommandQueue& slabQueue : slabQueues) {
+    waitForQueues(slabQueue, {queue});
+  }
+
+  const SolverStats stats = iterateUntilConverged(control,
+    [&](const int n) {
+      for(int k=0; k<n; ++k) {
+        sweep(alpha, beta, gamma);
+      }
+    },
+    [&]() {
+      return calcResidualNorms(alpha, beta, gamma);
+    });
+
+  waitForQueues(queue, slabQueues);
+  for(const std::unique_ptr<Slab>& slab : slabs) {
+    copyLines(queue, slab->x, 0, out, slab->k0, slab->n);
+  }
+  return stats;
+}
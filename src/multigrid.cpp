@@ -0,0 +1,147 @@
+#include <algorithm>
+
+#include <multigrid.hpp>
+#include <kernels.hpp>
+#include <user_kernels.hpp>
+
+// Levels are coarsened until either dimension reaches this size
+const int COARSEST_SIZE = 3;
+
+MultigridLevel::MultigridLevel(const int nx, const int ny, const int ng, const real dx_in, const real dy_in, const bool isFinest, const bool needsTemp, const int nMembers):
+  u{isFinest ? nullptr : std::make_unique<OpenCLArray>(nx, ny, ng, "", 0.0f, nMembers)},
+  b{isFinest ? nullptr : std::make_unique<OpenCLArray>(nx, ny, ng, "", 0.0f, nMembers)},
+  res(nx, ny, ng, "", 0.0f, nMembers),
+  temp{needsTemp ? std::make_unique<OpenCLArray>(nx, ny, ng, "", 0.0f, nMembers) : nullptr},
+  dx{dx_in},
+  dy{dy_in},
+  alpha{-0.5f*(dx*dx*dy*dy)/(dx*dx + dy*dy)},
+  beta{dx*dx},
+  gamma{dy*dy}
+{}
+
+MultigridSolver::MultigridSolver(const int nx, const int ny, const int ng, const real dx, const real dy, const MultigridCycle cycle_in, const MultigridSmoother smoother_in, const int nMembers):
+  nPreSmooth{2},
+  nPostSmooth{2},
+  nCoarseSmooth{50},
+  omega{smoother_in == MultigridSmoother::WeightedJacobi ? 0.8f : 1.0f},
+  cycle{cycle_in},
+  smoother{smoother_in}
+{
+  const bool needsTemp = smoother == MultigridSmoother::WeightedJacobi;
+  int lnx = nx, lny = ny;
+  real ldx = dx, ldy = dy;
+  levels.push_back(std::make_unique<MultigridLevel>(lnx, lny, ng, ldx, ldy, true, needsTemp, nMembers));
+  while(std::min(lnx, lny) > COARSEST_SIZE) {
+    int cnx = (lnx+1)/2;
+    int cny = (lny+1)/2;
+    // Coarse grids span the same domain as the fine one
+    ldx *= real(lnx)/cnx;
+    ldy *= real(lny)/cny;
+    lnx = cnx;
+    lny = cny;
+    levels.push_back(std::make_unique<MultigridLevel>(lnx, lny, ng, ldx, ldy, false, needsTemp, nMembers));
+  }
+}
+
+int MultigridSolver::nLevels() const {
+  return levels.size();
+}
+
+size_t MultigridSolver::deviceBytes() const {
+  size_t bytes = 0;
+  for(const auto& level : levels) {
+    bytes += level->res.deviceBytes();
+    for(const OpenCLArray* arr : {level->u.get(), level->b.get(), level->temp.get()}) {
+      bytes += arr ? arr->deviceBytes() : 0;
+    }
+  }
+  return bytes;
+}
+
+void MultigridSolver::solve(OpenCLArray& out, const OpenCLArray& b, const int nCycles) {
+  for(int n=0; n<nCycles; ++n) {
+    if(cycle == MultigridCycle::F) {
+      fCycle(out, b, 0);
+    } else {
+      vCycle(out, b, 0);
+    }
+  }
+  applyVonNeumannBC(out);
+}
+
+SolverStats MultigridSolver::solve(OpenCLArray& out, const OpenCLArray& b, const SolverControl& control) {
+  const MultigridLevel& l = *levels[0];
+  return iterateUntilConverged(control,
+    [&](const int n) {
+      solve(out, b, n);
+    },
+    [&]() {
+      applyVonNeumannBC(out);
+      return calcJacobiResidualNorms(out, l.alpha, l.beta, l.gamma, b);
+    });
+}
+
+void MultigridSolver::vCycle(OpenCLArray& u, const OpenCLArray& b, const int level) {
+  if(level == nLevels()-1) {
+    smooth(u, b, level, nCoarseSmooth);
+    return;
+  }
+
+  MultigridLevel& coarse = *levels[level+1];
+
+  smooth(u, b, level, nPreSmooth);
+  restrictResidual(u, b, level);
+  coarse.u->fill(0.0f, true);
+  vCycle(*coarse.u, *coarse.b, level+1);
+  prolongateCorrection(u, level);
+  smooth(u, b, level, nPostSmooth);
+}
+
+void MultigridSolver::fCycle(OpenCLArray& u, const OpenCLArray& b, const int level) {
+  if(level == nLevels()-1) {
+    smooth(u, b, level, nCoarseSmooth);
+    return;
+  }
+
+  MultigridLevel& coarse = *levels[level+1];
+
+  smooth(u, b, level, nPreSmooth);
+  restrictResidual(u, b, level);
+  coarse.u->fill(0.0f, true);
+  fCycle(*coarse.u, *coarse.b, level+1);
+  vCycle(*coarse.u, *coarse.b, level+1);
+  prolongateCorrection(u, level);
+  smooth(u, b, level, nPostSmooth);
+}
+
+void MultigridSolver::smooth(OpenCLArray& u, const OpenCLArray& b, const int level, const int iterations) {
+  MultigridLevel& l = *levels[level];
+  if(smoother == MultigridSmoother::RedBlackGaussSeidel) {
+    runSORIteration(u, l.alpha, l.beta, l.gamma, b, omega, iterations, applyVonNeumannBC);
+    return;
+  }
+
+  for(int i=0; i<iterations; ++i) {
+    applyVonNeumannBC(u);
+    kernels().applyWeightedJacobiStep(l.temp->interior, l.temp->getDeviceData(), u.getDeviceData(), l.alpha, l.beta, l.gamma, b.getDeviceData(), omega, u.nx, u.ny, u.ng);
+    u.swapData(*l.temp);
+  }
+}
+
+void MultigridSolver::restrictResidual(OpenCLArray& u, const OpenCLArray& b, const int level) {
+  MultigridLevel& l = *levels[level];
+  OpenCLArray& coarseB = *levels[level+1]->b;
+
+  applyVonNeumannBC(u);
+  kernels().calcJacobiResidual(l.res.interior, l.res.getDeviceData(), u.getDeviceData(), l.alpha, l.beta, l.gamma, b.getDeviceData(), l.res.nx, l.res.ny, l.res.ng);
+  // Restriction reads the ghost cells of grids which don't halve exactly
+  applyVonNeumannBC(l.res);
+  kernels().restrictCellCentred(coarseB.interior, coarseB.getDeviceData(), l.res.getDeviceData(), l.res.nx, l.res.ny, coarseB.nx, coarseB.ny, coarseB.ng);
+}
+
+void MultigridSolver::prolongateCorrection(OpenCLArray& u, const int level) {
+  OpenCLArray& coarseU = *levels[level+1]->u;
+
+  applyVonNeumannBC(coarseU);
+  kernels().prolongateCellCentred(u.interior, u.getDeviceData(), coarseU.getDeviceData(), coarseU.nx, coarseU.ny, u.nx, u.ny, u.ng);
+}
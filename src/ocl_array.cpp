@@ -1,31 +1,48 @@
+#include <algorithm>
+#include <stdexcept>
+
 #include <ocl_array.hpp>
 #include <kernels.hpp>
+#include <work_group_tuning.hpp>
 
-OpenCLArray::OpenCLArray(const int nx, const int ny, const int ng, const std::string& name, real initialVal, bool initDevice):
-  Array(nx, ny, ng, name, initialVal),
-  isDeviceDirty{true},
+OpenCLArray::OpenCLArray(const int nx, const int ny, const int ng, const std::string& name, real initialVal, const int nMembers, const Storage storage, bool initDevice):
+  Array(nx, ny, ng, name, initialVal, nMembers, true),
+  queue(cl::CommandQueue::getDefault()),
   interior(makeRange(0, 0, nx, ny)),
   entire(makeRange(-1, -1, nx+1, ny+1)),
   lowerBound(makeRowRange(-1, true)),
   upperBound(makeRowRange(ny, true)),
   leftBound(makeColumnRange(-1, true)),
-  rightBound(makeColumnRange(nx, true))
+  rightBound(makeColumnRange(nx, true)),
+  redBlackInterior(makeRange(0, 0, nx, (ny+1)/2)),
+  tiledInterior(makeTiledRange(0, 0, nx, ny, TILE_SIZE)),
+  storage{storage},
+  boundaryValues(N_BOUNDARY_SIDES*nMembers),
+  d_boundaryTypes(CL_MEM_READ_ONLY, N_BOUNDARY_SIDES*sizeof(int)),
+  d_boundaryValues(CL_MEM_READ_ONLY, N_BOUNDARY_SIDES*nMembers*sizeof(real)),
+  isDeviceDirty{true}
 {
   if(initDevice) {
     initOnDevice();
   }
   fill(initialVal, true);
+  setBoundaryConditions(BoundaryType::Dirichlet, 0.0f);
 }
 
 void OpenCLArray::initOnDevice(bool readOnly) {
-  d_data = cl::Buffer(begin(), end(), readOnly);
+  if(storage == Storage::Half) {
+    d_data = cl::Buffer(readOnly ? CL_MEM_READ_ONLY : CL_MEM_READ_WRITE, size()*sizeof(cl_half));
+    toDevice();
+  } else {
+    d_data = cl::Buffer(begin(), end(), readOnly);
+  }
 }
 
-std::vector<real>::iterator OpenCLArray::begin() {
+ArrayData::iterator OpenCLArray::begin() {
   return data.begin();
 }
 
-std::vector<real>::iterator OpenCLArray::end() {
+ArrayData::iterator OpenCLArray::end() {
   isDeviceDirty = true;
   return data.end();
 }
@@ -38,19 +55,73 @@ cl::Buffer& OpenCLArray::getDeviceData() {
   return d_data;
 }
 
+cl::Buffer OpenCLArray::getRealDeviceData() const {
+  if(storage != Storage::Half) {
+    return d_data;
+  }
+  cl::Buffer converted(CL_MEM_READ_WRITE, size()*sizeof(real));
+  halfKernels().fromHalf(makeRange(-ng, -ng, nx+ng, ny+ng), converted, d_data, nx, ny, ng);
+  return converted;
+}
+
+Storage OpenCLArray::getStorage() const {
+  return storage;
+}
+
+void OpenCLArray::requireRealStorage(const std::string& operation) const {
+  if(storage != Storage::Real) {
+    throw std::runtime_error(operation + " does not support half storage");
+  }
+}
+
+// Half arrays are converted on the device, through a real staging buffer
+// covering every cell including ghosts
 void OpenCLArray::toDevice() {
-  cl::copy(begin(), end(), d_data);
+  if(storage == Storage::Half) {
+    cl::Buffer staging(CL_MEM_READ_ONLY, size()*sizeof(real));
+    cl::copy(queue, begin(), end(), staging);
+    halfKernels().toHalf(makeRange(-ng, -ng, nx+ng, ny+ng), d_data, staging, nx, ny, ng);
+  } else {
+    cl::copy(queue, begin(), end(), d_data);
+  }
 }
 
 void OpenCLArray::toHost() {
-  cl::copy(d_data, begin(), end());
+  cl::copy(queue, getRealDeviceData(), begin(), end());
   isDeviceDirty = false;
 }
 
+Storage fieldStorage(const Constants& c) {
+  return c.isHalfStorage ? Storage::Half : Storage::Real;
+}
+
+template<>
+OpenCLArray makeField<OpenCLArray>(const Constants& c, const int nx, const int ny, const std::string& name) {
+  return OpenCLArray(nx, ny, c.ng, name, 0.0f, c.nMembers, fieldStorage(c));
+}
+
+cl::NDRange layoutRange(const int i, const int j, const int member) {
+  return I_CONTIGUOUS ? cl::NDRange(i, j, member) : cl::NDRange(j, i, member);
+}
+
+cl::EnqueueArgs makeArrayRange(const cl::CommandQueue& queue, int x0, int y0, int x1, int y1, int ng, int nMembers) {
+  return makeArrayRange(queue, x0, y0, x1, y1, ng, nMembers, tunedLocalRange(queue, layoutRange(x1-x0, y1-y0, nMembers)));
+}
+
+cl::EnqueueArgs makeArrayRange(const cl::CommandQueue& queue, int x0, int y0, int x1, int y1, int ng, int nMembers, const cl::NDRange& local) {
+  cl::CommandQueue q = queue;
+  return cl::EnqueueArgs(q, layoutRange(x0+ng, y0+ng, 0), layoutRange(x1-x0, y1-y0, nMembers), local);
+}
+
 const cl::EnqueueArgs OpenCLArray::makeRange(int x0, int y0, int x1, int y1) const {
-  int xGroup = x1-x0;
-  int yGroup = y1-y0;
-  return cl::EnqueueArgs(cl::NDRange(x0+ng, y0+ng), cl::NDRange(x1-x0, y1-y0), cl::NullRange);
+  return makeArrayRange(queue, x0, y0, x1, y1, ng, nMembers);
+}
+
+const cl::EnqueueArgs OpenCLArray::makeTiledRange(int x0, int y0, int x1, int y1, int tileSize) const {
+  int xGroups = (x1-x0 + tileSize-1)/tileSize;
+  int yGroups = (y1-y0 + tileSize-1)/tileSize;
+  cl::CommandQueue q = queue;
+  return cl::EnqueueArgs(q, layoutRange(x0+ng, y0+ng, 0), layoutRange(xGroups*tileSize, yGroups*tileSize, nMembers), cl::NDRange(tileSize, tileSize, 1));
 }
 
 const cl::EnqueueArgs OpenCLArray::makeColumnRange(int col, bool includeGhost) const {
@@ -75,7 +146,44 @@ const cl::EnqueueArgs OpenCLArray::makeRowRange(int row, bool includeGhost) cons
   return makeRange(x0,y0,x1,y1);
 }
 
+void OpenCLArray::setQueue(const cl::CommandQueue& newQueue) {
+  queue = newQueue;
+  interior = makeRange(0, 0, nx, ny);
+  entire = makeRange(-1, -1, nx+1, ny+1);
+  lowerBound = makeRowRange(-1, true);
+  upperBound = makeRowRange(ny, true);
+  leftBound = makeColumnRange(-1, true);
+  rightBound = makeColumnRange(nx, true);
+  redBlackInterior = makeRange(0, 0, nx, (ny+1)/2);
+  tiledInterior = makeTiledRange(0, 0, nx, ny, TILE_SIZE);
+  // Copies of the array share its scratch, so don't reduce into it from
+  // another queue
+  d_reduction = cl::Buffer();
+}
+
+const cl::CommandQueue& OpenCLArray::getQueue() const {
+  return queue;
+}
+
+size_t bufferBytes(const cl::Buffer& buffer) {
+  return buffer() == nullptr ? 0 : buffer.getInfo<CL_MEM_SIZE>();
+}
+
+size_t OpenCLArray::deviceBytes() const {
+  return bufferBytes(d_data) + bufferBytes(d_boundaryTypes) + bufferBytes(d_boundaryValues) + bufferBytes(d_reduction);
+}
+
+const cl::Buffer& OpenCLArray::getReductionBuffer(const size_t size) const {
+  if(d_reduction() == nullptr || d_reduction.getInfo<CL_MEM_SIZE>() < size) {
+    d_reduction = cl::Buffer(CL_MEM_READ_WRITE, size);
+  }
+  return d_reduction;
+}
+
 void OpenCLArray::swapData(OpenCLArray& arr) {
+  if(arr.storage != storage) {
+    throw std::runtime_error("Cannot swap data: Storage differs");
+  }
   std::swap(d_data, arr.d_data);
   Array::swapData(arr);
 }
@@ -84,28 +192,167 @@ void OpenCLArray::fillHost(real val) {
   Array::fill(val);
 }
 
+void OpenCLArray::fillRange(const cl::EnqueueArgs& range, real val) {
+  if(storage == Storage::Half) {
+    halfKernels().fill(range, getDeviceData(), val, nx, ny, ng);
+  } else {
+    kernels().fill(range, getDeviceData(), val, nx, ny, ng);
+  }
+}
+
 void OpenCLArray::fill(real val, bool includeGhost) {
-  auto range = includeGhost ? entire : interior;
-  g_kernels.fill(range, getDeviceData(), val, nx, ny, ng);
+  fillRange(includeGhost ? entire : interior, val);
 }
 
 void OpenCLArray::setUpperBoundary(real val) {
-  g_kernels.fill(upperBound, getDeviceData(), val, nx, ny, ng);
+  fillRange(upperBound, val);
 }
 
 void OpenCLArray::setLowerBoundary(real val) {
-  g_kernels.fill(lowerBound, getDeviceData(), val, nx, ny, ng);
+  fillRange(lowerBound, val);
 }
 
 void OpenCLArray::setLeftBoundary(real val) {
-  g_kernels.fill(leftBound, getDeviceData(), val, nx, ny, ng);
+  fillRange(leftBound, val);
 }
 
 void OpenCLArray::setRightBoundary(real val) {
-  g_kernels.fill(rightBound, getDeviceData(), val, nx, ny, ng);
+  fillRange(rightBound, val);
 }
 
 void OpenCLArray::saveTo(H5::H5File& file) {
   toHost();
   Array::saveTo(file);
 }
+
+void OpenCLArray::load(H5::H5File& file) {
+  Array::load(file);
+  toDevice();
+}
+
+void OpenCLArray::setBoundaryCondition(BoundarySide side, BoundaryType type, real value) {
+  boundaryConditions[static_cast<int>(side)] = {type, value};
+  for(int member=0; member<nMembers; ++member) {
+    boundaryValues[member*N_BOUNDARY_SIDES + static_cast<int>(side)] = value;
+  }
+  boundaryConditionsToDevice();
+}
+
+void OpenCLArray::setBoundaryConditions(BoundaryType type, real value) {
+  boundaryConditions.fill({type, value});
+  std::fill(boundaryValues.begin(), boundaryValues.end(), value);
+  boundaryConditionsToDevice();
+}
+
+void OpenCLArray::setBoundaryValue(BoundarySide side, int member, real value) {
+  boundaryValues[member*N_BOUNDARY_SIDES + static_cast<int>(side)] = value;
+  boundaryConditionsToDevice();
+}
+
+void OpenCLArray::copyBoundaryConditions(const OpenCLArray& arr) {
+  if(arr.nMembers != nMembers) {
+    throw std::runtime_error("Cannot copy boundary conditions: Number of members differs");
+  }
+  boundaryConditions = arr.boundaryConditions;
+  boundaryValues = arr.boundaryValues;
+  queue.enqueueCopyBuffer(arr.d_boundaryTypes, d_boundaryTypes, 0, 0, N_BOUNDARY_SIDES*sizeof(int));
+  queue.enqueueCopyBuffer(arr.d_boundaryValues, d_boundaryValues, 0, 0, N_BOUNDARY_SIDES*nMembers*sizeof(real));
+}
+
+const BoundaryCondition& OpenCLArray::getBoundaryCondition(BoundarySide side) const {
+  return boundaryConditions[static_cast<int>(side)];
+}
+
+real OpenCLArray::getBoundaryValue(BoundarySide side, int member) const {
+  return boundaryValues[member*N_BOUNDARY_SIDES + static_cast<int>(side)];
+}
+
+const cl::Buffer& OpenCLArray::getBoundaryTypes() const {
+  return d_boundaryTypes;
+}
+
+const cl::Buffer& OpenCLArray::getBoundaryValues() const {
+  return d_boundaryValues;
+}
+
+void OpenCLArray::boundaryConditionsToDevice() {
+  std::array<int, N_BOUNDARY_SIDES> types;
+  for(int side=0; side<N_BOUNDARY_SIDES; ++side) {
+    types[side] = static_cast<int>(boundaryConditions[side].type);
+  }
+  cl::copy(queue, types.begin(), types.end(), d_boundaryTypes);
+  cl::copy(queue, boundaryValues.begin(), boundaryValues.end(), d_boundaryValues);
+}
+
+void OpenCLArray::applyBoundaryConditions() {
+  ::applyBoundaryConditions(*this);
+}
+
+int ghostRingSize(int nx, int ny, int ng) {
+  return (nx + 2*ng)*(ny + 2*ng) - nx*ny;
+}
+
+int ghostRingSize(const OpenCLArray* arr) {
+  return ghostRingSize(arr->nx, arr->ny, arr->ng);
+}
+
+// Half arrays have a kernel of their own, launched per array on its queue
+void applyHalfBoundaryConditions(OpenCLArray& arr) {
+  cl::CommandQueue queue = arr.getQueue();
+  halfKernels().applyBoundaryConditions(cl::EnqueueArgs(queue, cl::NDRange(ghostRingSize(&arr), 1, arr.nMembers)),
+      arr.getDeviceData(), arr.getBoundaryTypes(), arr.getBoundaryValues(), arr.nx, arr.ny, arr.ng);
+}
+
+bool isHalf(const OpenCLArray* arr) {
+  return arr && arr->getStorage() == Storage::Half;
+}
+
+void applyBoundaryConditions(std::array<OpenCLArray*, 3> arrs) {
+  if(std::any_of(arrs.begin(), arrs.end(), isHalf)) {
+    std::array<OpenCLArray*, 3> realArrs{};
+    int nReal = 0;
+    for(OpenCLArray* arr : arrs) {
+      if(isHalf(arr)) {
+        applyHalfBoundaryConditions(*arr);
+      } else if(arr) {
+        realArrs[nReal++] = arr;
+      }
+    }
+    if(nReal > 0) {
+      applyBoundaryConditions(realArrs);
+    }
+    return;
+  }
+
+  int ringSize = 0;
+  for(OpenCLArray* arr : arrs) {
+    if(arr) {
+      if(arr->nMembers != arrs[0]->nMembers) {
+        throw std::runtime_error("Cannot apply boundary conditions: Number of members differs");
+      }
+      ringSize = std::max(ringSize, ghostRingSize(arr));
+    }
+  }
+  // Unused slots point at the first array with nx = 0
+  OpenCLArray& a = *arrs[0];
+  OpenCLArray& b = arrs[1] ? *arrs[1] : a;
+  OpenCLArray& c = arrs[2] ? *arrs[2] : a;
+  cl::CommandQueue queue = a.getQueue();
+  kernels().applyBoundaryConditions(cl::EnqueueArgs(queue, cl::NDRange(ringSize, 1, a.nMembers)),
+      a.getDeviceData(), a.getBoundaryTypes(), a.getBoundaryValues(), a.nx, a.ny,
+      b.getDeviceData(), b.getBoundaryTypes(), b.getBoundaryValues(), arrs[1] ? b.nx : 0, b.ny,
+      c.getDeviceData(), c.getBoundaryTypes(), c.getBoundaryValues(), arrs[2] ? c.nx : 0, c.ny,
+      a.ng);
+}
+
+void applyBoundaryConditions(OpenCLArray& a) {
+  applyBoundaryConditions({&a, nullptr, nullptr});
+}
+
+void applyBoundaryConditions(OpenCLArray& a, OpenCLArray& b) {
+  applyBoundaryConditions({&a, &b, nullptr});
+}
+
+void applyBoundaryConditions(OpenCLArray& a, OpenCLArray& b, OpenCLArray& c) {
+  applyBoundaryConditions({&a, &b, &c});
+}
@@ -1,5 +1,13 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
 #include <iostream>
+#include <iomanip>
 #include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <unistd.h>
 
 #include <ocl_utility.hpp>
 
@@ -41,6 +49,42 @@ int setDefaultPlatform(const std::string& targetName) {
   return 0;
 }
 
+std::vector<cl::Device> setDefaultDevices(const int n) {
+  std::vector<cl::Device> devices;
+  cl::Platform::getDefault().getDevices(CL_DEVICE_TYPE_ALL, &devices);
+  if(devices.empty()) {
+    throw std::runtime_error("The default platform has no devices");
+  }
+
+  if(int(devices.size()) >= n) {
+    devices.resize(n);
+  } else {
+    cl::Device parent = devices.front();
+    const cl_uint units = parent.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>();
+    if(int(units) < n) {
+      throw std::runtime_error("Cannot split " + parent.getInfo<CL_DEVICE_NAME>() + " with " + std::to_string(units) + " compute units into " + std::to_string(n) + " sub-devices");
+    }
+    const cl_device_partition_property properties[] = {CL_DEVICE_PARTITION_EQUALLY, cl_device_partition_property(units/n), 0};
+    devices.clear();
+    parent.createSubDevices(properties, &devices);
+    // There may be more than n equal partitions
+    devices.resize(n);
+  }
+
+  cl::Context context(devices);
+  if(cl::Context::setDefault(context)() != context()) {
+    throw std::runtime_error("Cannot set the default devices: The default context is already in use");
+  }
+  cl::Device::setDefault(devices.front());
+  cl::CommandQueue::setDefault(cl::CommandQueue(context, devices.front()));
+
+  std::cout << "Running on " << n << " devices:" << std::endl;
+  for(const cl::Device& device : devices) {
+    std::cout << device.getInfo<CL_DEVICE_NAME>() << ", " << device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>() << " compute units" << std::endl;
+  }
+  return devices;
+}
+
 auto readFile(std::string_view path) -> std::string {
   // Read entire file into string
   // stolen from https://stackoverflow.com/a/116220
@@ -61,12 +105,121 @@ auto readFile(std::string_view path) -> std::string {
   return out;
 }
 
-cl::Program buildProgramFromString(const std::string& source) {
+std::string g_programCacheDirectory = "kernel_cache";
+
+void setProgramCacheDirectory(const std::string& directory) {
+  g_programCacheDirectory = directory;
+}
+
+// 64-bit FNV-1a hash of s and its terminating null, continuing from hash.
+// The null keeps consecutive fields from running into each other.
+uint64_t fnv1a(const std::string& s, uint64_t hash = 14695981039346656037ull) {
+  for(size_t k=0; k<=s.size(); ++k) {
+    hash ^= static_cast<unsigned char>(s.c_str()[k]);
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+// Identifies the binaries of a program: its source and build options, and
+// the name, driver and OpenCL version of every device it is built for
+uint64_t programKey(const std::string& source, const std::string& options, const std::vector<cl::Device>& devices) {
+  uint64_t key = fnv1a(options, fnv1a(source));
+  for(const cl::Device& device : devices) {
+    key = fnv1a(device.getInfo<CL_DEVICE_NAME>(), key);
+    key = fnv1a(device.getInfo<CL_DRIVER_VERSION>(), key);
+    key = fnv1a(device.getInfo<CL_DEVICE_VERSION>(), key);
+  }
+  return key;
+}
+
+std::string programCachePath(const uint64_t key) {
+  std::ostringstream path;
+  path << g_programCacheDirectory << "/" << std::hex << std::setw(16) << std::setfill('0') << key << ".bin";
+  return path.str();
+}
+
+// Cache files hold the magic number, the key, the number of devices, then the
+// size and bytes of each device's binary
+const char PROGRAM_CACHE_MAGIC[8] = {'F', 'A', 'F', 'S', 'P', 'R', 'G', '1'};
+
+// Binaries of the program with key for nDevices devices, or none if the file
+// is missing, truncated or for another key
+cl::Program::Binaries readProgramCache(const std::string& path, const uint64_t key, const size_t nDevices) {
+  std::ifstream file(path, std::ios::binary);
+  char magic[sizeof(PROGRAM_CACHE_MAGIC)];
+  uint64_t fileKey, n;
+  if(!file.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), PROGRAM_CACHE_MAGIC) ||
+     !file.read(reinterpret_cast<char*>(&fileKey), sizeof(fileKey)) || fileKey != key ||
+     !file.read(reinterpret_cast<char*>(&n), sizeof(n)) || n != nDevices) {
+    return {};
+  }
+  cl::Program::Binaries binaries(n);
+  for(std::vector<unsigned char>& binary : binaries) {
+    uint64_t size;
+    if(!file.read(reinterpret_cast<char*>(&size), sizeof(size))) {
+      return {};
+    }
+    binary.resize(size);
+    if(!file.read(reinterpret_cast<char*>(binary.data()), size)) {
+      return {};
+    }
+  }
+  return binaries;
+}
+
+// Failures are ignored, so the program is just built from source next time
+void writeProgramCache(const std::string& path, const uint64_t key, const cl::Program::Binaries& binaries) {
+  std::error_code error;
+  std::filesystem::create_directories(g_programCacheDirectory, error);
+
+  // Written under a name unique to this process then renamed, so that runs
+  // starting together never read a partly written file
+  const std::string tempPath = path + "." + std::to_string(getpid());
+  {
+    std::ofstream file(tempPath, std::ios::binary);
+    const uint64_t n = binaries.size();
+    file.write(PROGRAM_CACHE_MAGIC, sizeof(PROGRAM_CACHE_MAGIC));
+    file.write(reinterpret_cast<const char*>(&key), sizeof(key));
+    file.write(reinterpret_cast<const char*>(&n), sizeof(n));
+    for(const std::vector<unsigned char>& binary : binaries) {
+      const uint64_t size = binary.size();
+      file.write(reinterpret_cast<const char*>(&size), sizeof(size));
+      file.write(reinterpret_cast<const char*>(binary.data()), size);
+    }
+    if(!file) {
+      file.close();
+      std::remove(tempPath.c_str());
+      return;
+    }
+  }
+  std::rename(tempPath.c_str(), path.c_str());
+}
+
+cl::Program buildProgramFromString(const std::string& source, const std::string& options) {
+  const cl::Context context = cl::Context::getDefault();
+  const std::vector<cl::Device> devices = context.getInfo<CL_CONTEXT_DEVICES>();
+  const uint64_t key = programKey(source, options, devices);
+  const std::string cachePath = g_programCacheDirectory.empty() ? "" : programCachePath(key);
+
+  if(!cachePath.empty()) {
+    const cl::Program::Binaries binaries = readProgramCache(cachePath, key, devices.size());
+    if(!binaries.empty()) {
+      try {
+        cl::Program program(context, devices, binaries);
+        program.build(devices, options.c_str());
+        return program;
+      } catch (cl::Error&) {
+        // Rejected by the driver, so rebuilt from source and replaced
+      }
+    }
+  }
+
   // Compile kernel source into program
-  cl::Program program(source, false);
+  cl::Program program(context, source, false);
 
   try {
-    program.build();
+    program.build(devices, options.c_str());
   } catch (cl::Error& e) {
     if (e.err() == CL_BUILD_PROGRAM_FAILURE) {
       // Check the build status
@@ -75,14 +228,38 @@ cl::Program buildProgramFromString(const std::string& source) {
       // Get the build log
       std::string bl = program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(cl::Device::getDefault());
       std::cerr << bl << std::endl;
+      return program;
     } else {
       throw e;
     }
   }
 
+  if(!cachePath.empty()) {
+    writeProgramCache(cachePath, key, program.getInfo<CL_PROGRAM_BINARIES>());
+  }
   return program;
 }
 
 cl::Program buildProgramFromFile(const std::string& filename) {
   return buildProgramFromString(readFile(filename));
 }
+
+std::vector<cl::Event> enqueueMarkers(const std::vector<cl::CommandQueue>& queues) {
+  std::vector<cl::Event> markers(queues.size());
+  for(size_t i=0; i<queues.size(); ++i) {
+    queues[i].enqueueMarkerWithWaitList(nullptr, &markers[i]);
+  }
+  return markers;
+}
+
+void waitForQueues(const cl::CommandQueue& queue, const std::vector<cl::CommandQueue>& others) {
+  const std::vector<cl::Event> markers = enqueueMarkers(others);
+  queue.enqueueBarrierWithWaitList(&markers);
+}
+
+void joinQueues(const std::vector<cl::CommandQueue>& queues) {
+  const std::vector<cl::Event> markers = enqueueMarkers(queues);
+  for(const cl::CommandQueue& queue : queues) {
+    queue.enqueueBarrierWithWaitList(&markers);
+  }
+}
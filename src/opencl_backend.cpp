@@ -0,0 +1,270 @@
+#include <stdexcept>
+
+#include <opencl_backend.hpp>
+#include <user_kernels.hpp>
+#include <kernels.hpp>
+
+// Coefficients of the implicit diffusion equation, in the form solved by
+// applyJacobiStep
+void diffusionCoefficients(const Constants& c, real& alpha, real& beta, real& gamma) {
+  alpha = 1.0f/(1.0f + 2.0f*c.dt/c.Re*(1.0f/(c.dx*c.dx) + 1.0f/(c.dy*c.dy)));
+  beta  = -c.Re*c.dx*c.dx/c.dt;
+  gamma = -c.Re*c.dy*c.dy/c.dt;
+}
+
+// Coefficients of the pressure Poisson equation, in the form solved by
+// applyJacobiStep
+void pressureCoefficients(const Constants& c, double& alpha, double& beta, double& gamma) {
+  const double dx2 = double(c.dx)*c.dx;
+  const double dy2 = double(c.dy)*c.dy;
+  alpha = -0.5*dx2*dy2/(dx2 + dy2);
+  beta = dx2;
+  gamma = dy2;
+}
+
+void specialiseSolves(const Constants& c) {
+  real alpha, beta, gamma;
+  diffusionCoefficients(c, alpha, beta, gamma);
+  specialiseLinearSystem({c.nx, c.ny, c.ng, alpha, beta, gamma});
+  double pAlpha, pBeta, pGamma;
+  pressureCoefficients(c, pAlpha, pBeta, pGamma);
+  specialiseLinearSystem({c.nx+1, c.ny+1, c.ng, real(pAlpha), real(pBeta), real(pGamma)});
+}
+
+// Half storage has kernels for the steps below only
+void requireHalfStorageSupport(const Constants& c, const size_t nDevices) {
+  if(!c.isAdvectionImplicit || !c.isDiffusionImplicit) {
+    throw std::runtime_error("Half storage needs implicit advection and diffusion");
+  }
+  if(c.pressureSolver != SolverType::Jacobi || c.diffusionSolver != SolverType::Jacobi) {
+    throw std::runtime_error("Half storage needs Jacobi pressure and diffusion solvers");
+  }
+  if(c.isPressureMixedPrecision || c.useTiledKernels || nDevices > 1) {
+    throw std::runtime_error("Half storage cannot be used with mixed precision, tiled kernels or several devices");
+  }
+}
+
+OpenCLBackend::OpenCLBackend(const Constants& c):
+  c{c},
+  mainQueue(cl::CommandQueue::getDefault()),
+  vxQueue(cl::Context::getDefault(), cl::Device::getDefault()),
+  vyQueue(cl::Context::getDefault(), cl::Device::getDefault()),
+  boundTemp1(makeField<OpenCLArray>(c, c.nx, c.ny, "boundTemp1")),
+  boundTemp2(makeField<OpenCLArray>(c, c.nx, c.ny, "boundTemp2")),
+  boundTemp3(makeField<OpenCLArray>(c, c.nx, c.ny, "boundTemp3")),
+  boundTemp4(makeField<OpenCLArray>(c, c.nx, c.ny, "boundTemp4")),
+  cellTemp(makeField<OpenCLArray>(c, c.nx+1, c.ny+1, "cellTemp2"))
+{
+  const std::vector<cl::Device> devices = cl::Context::getDefault().getInfo<CL_CONTEXT_DEVICES>();
+  if(c.isHalfStorage) {
+    requireHalfStorageSupport(c, devices.size());
+  }
+  if(c.pressureSolver == SolverType::Multigrid) {
+    pressureSolver = std::make_unique<MultigridSolver>(c.nx+1, c.ny+1, c.ng, c.dx, c.dy, MultigridCycle::V, MultigridSmoother::RedBlackGaussSeidel, c.nMembers);
+  } else if(c.pressureSolver == SolverType::CG) {
+    pressureCGSolver = std::make_unique<CGSolver>(c.nx+1, c.ny+1, c.ng);
+  } else if(c.pressureSolver == SolverType::Jacobi && devices.size() > 1) {
+    pressureSlabSolver = std::make_unique<MultiDeviceJacobiSolver>(devices, c.nx+1, c.ny+1, c.ng, c.nMembers);
+  }
+  if(c.isPressureMixedPrecision) {
+    pressureRefinement = std::make_unique<IterativeRefinement>(c.nx+1, c.ny+1, c.ng, c.nMembers);
+  }
+  if(c.isDiffusionImplicit && c.diffusionSolver == SolverType::CG) {
+    vxCGSolver = std::make_unique<CGSolver>(c.nx, c.ny, c.ng);
+    vyCGSolver = std::make_unique<CGSolver>(c.nx, c.ny, c.ng);
+    vxCGSolver->setQueue(vxQueue);
+    vyCGSolver->setQueue(vyQueue);
+  }
+  setUseTiledKernels(c.useTiledKernels);
+  if(c.specialiseKernels) {
+    specialiseSolves(c);
+  }
+  boundTemp1.setQueue(vxQueue);
+  boundTemp2.setQueue(vxQueue);
+  boundTemp3.setQueue(vyQueue);
+  boundTemp4.setQueue(vyQueue);
+}
+
+void OpenCLBackend::initialise(Variables<OpenCLArray>& vars) {
+  vars.vx.setQueue(vxQueue);
+  vars.vy.setQueue(vyQueue);
+
+  vars.vx.fill(0.0f, true);
+  vars.vy.fill(0.0f, true);
+  vars.p.fill(0.0f, true);
+
+  // No slip, with the lid moving along the upper boundary
+  vars.vx.setBoundaryConditions(BoundaryType::Dirichlet, 0.0f);
+  vars.vx.setBoundaryCondition(BoundarySide::Upper, BoundaryType::Dirichlet, c.lidVelocity);
+  for(int member=1; member<c.nMembers; ++member) {
+    vars.vx.setBoundaryValue(BoundarySide::Upper, member, c.lidVelocity + member*c.lidVelocityStep);
+  }
+  vars.vy.setBoundaryConditions(BoundaryType::Dirichlet, 0.0f);
+  vars.p.setBoundaryConditions(BoundaryType::Neumann);
+}
+
+void OpenCLBackend::applyVelocityBC(Variables<OpenCLArray>& vars) {
+  applyBoundaryConditions(vars.vx);
+  applyBoundaryConditions(vars.vy);
+}
+
+void OpenCLBackend::applyPressureBC(OpenCLArray& p) {
+  applyVonNeumannBC(p);
+}
+
+void OpenCLBackend::advect(Variables<OpenCLArray>& vars) {
+  // Both components are read by the advection of each
+  joinQueues({vxQueue, vyQueue});
+  if(c.isAdvectionImplicit) {
+    // Fused over both components, so runs on vxQueue
+    advectVelocityImplicit(boundTemp1, boundTemp3, vars.vx, vars.vy, c.dx, c.dy, c.dt);
+    waitForQueues(vyQueue, {vxQueue});
+    vars.vx.swapData(boundTemp1);
+    vars.vy.swapData(boundTemp3);
+  } else {
+    calcAdvectionTerm(boundTemp1, vars.vx, vars.vx, vars.vy, c.dx, c.dy);
+    calcAdvectionTerm(boundTemp3, vars.vy, vars.vx, vars.vy, c.dx, c.dy);
+    joinQueues({vxQueue, vyQueue});
+    advanceEuler(vars.vx, boundTemp1, c.dt);
+    advanceEuler(vars.vy, boundTemp3, c.dt);
+  }
+}
+
+// A velocity component with the work arrays for its implicit diffusion
+// solve, all on the same queue
+struct DiffusionSystem {
+  OpenCLArray& var;
+  OpenCLArray& guess;
+  OpenCLArray& temp;
+  CGSolver* cgSolver; // null unless c.diffusionSolver is CG
+};
+
+// Solves for each component together, so solves on different queues overlap
+std::vector<SolverStats> solveDiffusion(const std::vector<DiffusionSystem>& systems, const Constants& c) {
+  real alpha, beta, gamma;
+  diffusionCoefficients(c, alpha, beta, gamma);
+
+  for(const DiffusionSystem& s : systems) {
+    // Dirichlet boundaries are held in the ghost cells of the guess
+    s.guess.copyBoundaryConditions(s.var);
+    s.temp.copyBoundaryConditions(s.var);
+    s.guess.fill(0.0f, true);
+    applyBoundaryConditions(s.guess, s.temp);
+  }
+
+  std::vector<SolverStats> stats;
+  if(c.diffusionSolver == SolverType::CG) {
+    // CG reads back a dot product every iteration, so solves run in turn
+    for(const DiffusionSystem& s : systems) {
+      stats.push_back(s.cgSolver->solve(s.guess, makeJacobiOperator(alpha, beta, gamma), s.var, c.diffusionControl));
+    }
+  } else {
+    stats = iterateTogetherUntilConverged(c.diffusionControl,
+      [&](const int k, const int n) {
+        const DiffusionSystem& s = systems[k];
+        if(c.diffusionSolver == SolverType::RedBlackSOR) {
+          runSORIteration(s.guess, alpha, beta, gamma, s.var, c.relaxationFactor, n);
+        } else {
+          for(int i=0; i<n; ++i) {
+            applyJacobiStep(s.temp, s.guess, alpha, beta, gamma, s.var);
+            s.guess.swapData(s.temp);
+          }
+        }
+      },
+      [&]() {
+        std::vector<PendingNorms> pending;
+        for(const DiffusionSystem& s : systems) {
+          pending.push_back(enqueueJacobiResidualNorms(s.guess, alpha, beta, gamma, s.var));
+        }
+        std::vector<ResidualNorms> residuals;
+        for(PendingNorms& p : pending) {
+          residuals.push_back(p.get());
+        }
+        return residuals;
+      });
+  }
+
+  for(const DiffusionSystem& s : systems) {
+    s.var.swapData(s.guess);
+  }
+  return stats;
+}
+
+std::vector<SolverStats> OpenCLBackend::diffuse(Variables<OpenCLArray>& vars) {
+  if(c.isDiffusionImplicit) {
+    return solveDiffusion({
+        {vars.vx, boundTemp1, boundTemp2, vxCGSolver.get()},
+        {vars.vy, boundTemp3, boundTemp4, vyCGSolver.get()}
+      }, c);
+  }
+  calcDiffusionTerm(boundTemp1, vars.vx, c.dx, c.dy, c.Re);
+  advanceEuler(vars.vx, boundTemp1, c.dt);
+
+  calcDiffusionTerm(boundTemp3, vars.vy, c.dx, c.dy, c.Re);
+  advanceEuler(vars.vy, boundTemp3, c.dt);
+  return {};
+}
+
+void OpenCLBackend::calcDivergence(OpenCLArray& div, Variables<OpenCLArray>& vars) {
+  waitForQueues(mainQueue, {vxQueue, vyQueue});
+  div.fill(0.0f, true);
+  ::calcDivergence(div, vars.vx, vars.vy, c.dx, c.dy);
+}
+
+SolverStats OpenCLBackend::solvePressure(OpenCLArray& p, const OpenCLArray& div) {
+  double alpha, beta, gamma;
+  pressureCoefficients(c, alpha, beta, gamma);
+
+  auto applyBC = [this](OpenCLArray& x) { applyPressureBC(x); };
+  auto solve = [&](OpenCLArray& x, const OpenCLArray& b) {
+    if(c.pressureSolver == SolverType::CG) {
+      return pressureCGSolver->solve(x, makeJacobiOperator(alpha, beta, gamma, applyBC), b, c.pressureControl);
+    } else if(c.pressureSolver == SolverType::RedBlackSOR) {
+      return runSORIteration(x, alpha, beta, gamma, b, c.relaxationFactor, c.pressureControl, applyBC);
+    } else if(c.pressureSolver == SolverType::Jacobi && pressureSlabSolver) {
+      return pressureSlabSolver->solve(x, alpha, beta, gamma, b, c.pressureControl);
+    } else if(c.pressureSolver == SolverType::Jacobi) {
+      return runBlockedJacobiIteration(x, cellTemp, alpha, beta, gamma, b, c.jacobiSweepsPerLaunch, c.pressureControl);
+    } else {
+      return pressureSolver->solve(x, b, c.pressureControl);
+    }
+  };
+
+  p.fill(0.0f, true);
+  SolverStats stats;
+  if(c.isPressureMixedPrecision) {
+    stats = pressureRefinement->solve(p, div, alpha, beta, gamma, true,
+        [&](OpenCLArray& e, const OpenCLArray& r) { solve(e, r); },
+        c.refinementControl);
+  } else {
+    stats = solve(p, div);
+  }
+  applyPressureBC(p);
+  return stats;
+}
+
+void OpenCLBackend::project(Variables<OpenCLArray>& vars) {
+  waitForQueues(vxQueue, {mainQueue});
+  waitForQueues(vyQueue, {mainQueue});
+  applyProjectionX(vars.vx, vars.p, c.dx);
+  applyProjectionY(vars.vy, vars.p, c.dy);
+}
+
+size_t OpenCLBackend::deviceBytes() const {
+  size_t bytes = 0;
+  for(const OpenCLArray* arr : {&boundTemp1, &boundTemp2, &boundTemp3, &boundTemp4, &cellTemp}) {
+    bytes += arr->deviceBytes();
+  }
+  bytes += pressureSolver ? pressureSolver->deviceBytes() : 0;
+  bytes += pressureCGSolver ? pressureCGSolver->deviceBytes() : 0;
+  bytes += pressureRefinement ? pressureRefinement->deviceBytes() : 0;
+  bytes += pressureSlabSolver ? pressureSlabSolver->deviceBytes() : 0;
+  bytes += vxCGSolver ? vxCGSolver->deviceBytes() : 0;
+  bytes += vyCGSolver ? vyCGSolver->deviceBytes() : 0;
+  return bytes;
+}
+
+void OpenCLBackend::finish() {
+  waitForQueues(mainQueue, {vxQueue, vyQueue});
+  mainQueue.finish();
+}
@@ -0,0 +1,171 @@
+#include <iostream>
+#include <stdexcept>
+
+#include <openmp_backend.hpp>
+#include <openmp_kernels.hpp>
+
+// Ghost cells of var set to the given Dirichlet values on each physical side.
+// Corners of the domain take the left and right values, as with boundary
+// descriptors on the device.
+void applyDirichletBC(Array& var, const real lower, const real upper, const real left, const real right, const PhysicalSides& physical) {
+  const bool isLower = physical[int(BoundarySide::Lower)];
+  const bool isUpper = physical[int(BoundarySide::Upper)];
+  const bool isLeft = physical[int(BoundarySide::Left)];
+  const bool isRight = physical[int(BoundarySide::Right)];
+  // Ghost corners next to a neighbouring block lie along the lower or upper
+  // boundary, so take its value
+  for (int i=-1; i<var.nx+1; ++i) {
+    if(isLower) {
+      var(i, -1) = i < 0 && isLeft ? left : i >= var.nx && isRight ? right : lower;
+    }
+    if(isUpper) {
+      var(i, var.ny) = i < 0 && isLeft ? left : i >= var.nx && isRight ? right : upper;
+    }
+  }
+  for(int j=-1; j<var.ny+1; ++j) {
+    if(isLeft) {
+      var(-1, j) = left;
+    }
+    if(isRight) {
+      var(var.nx, j) = right;
+    }
+  }
+}
+
+void applyVonNeumannBC(Array& var, const PhysicalSides& physical) {
+  for (int i=0; i<var.nx; ++i) {
+    if(physical[int(BoundarySide::Lower)]) {
+      var(i, -1) = var(i, 0);
+    }
+    if(physical[int(BoundarySide::Upper)]) {
+      var(i, var.ny) = var(i, var.ny-1);
+    }
+  }
+  for(int j=0; j<var.ny; ++j) {
+    if(physical[int(BoundarySide::Left)]) {
+      var(-1, j) = var(0, j);
+    }
+    if(physical[int(BoundarySide::Right)]) {
+      var(var.nx, j) = var(var.nx-1, j);
+    }
+  }
+}
+
+OpenMPBackend::OpenMPBackend(const Constants& c):
+  c{c},
+  boundTemp1(c.nx, c.ny, c.ng, "boundTemp1"),
+  boundTemp2(c.nx, c.ny, c.ng, "boundTemp2"),
+  cellTemp(c.nx+1, c.ny+1, c.ng, "cellTemp2"),
+  physical(ALL_SIDES_PHYSICAL)
+{
+  if(c.nMembers > 1) {
+    throw std::runtime_error("The OpenMP backend does not support ensembles");
+  }
+  if(c.pressureSolver != SolverType::Jacobi || (c.isDiffusionImplicit && c.diffusionSolver != SolverType::Jacobi)) {
+    std::cout << "The OpenMP backend solves every system by Jacobi iteration" << std::endl;
+  }
+}
+
+// No slip, with the lid moving along the upper boundary
+void OpenMPBackend::applyVxBC(Array& vx) {
+  applyDirichletBC(vx, 0.0f, c.lidVelocity, 0.0f, 0.0f, physical);
+}
+
+void OpenMPBackend::applyVyBC(Array& vy) {
+  applyDirichletBC(vy, 0.0f, 0.0f, 0.0f, 0.0f, physical);
+}
+
+void OpenMPBackend::initialise(Variables<Array>& vars) {
+  vars.vx.fill(0.0f);
+  vars.vy.fill(0.0f);
+  vars.p.fill(0.0f);
+}
+
+void OpenMPBackend::applyVelocityBC(Variables<Array>& vars) {
+  applyVxBC(vars.vx);
+  applyVyBC(vars.vy);
+}
+
+void OpenMPBackend::applyPressureBC(Array& p) {
+  applyVonNeumannBC(p, physical);
+}
+
+void OpenMPBackend::advect(Variables<Array>& vars) {
+  if(c.isAdvectionImplicit) {
+    advectImplicit(boundTemp1, vars.vx, vars.vx, vars.vy, c.dx, c.dy, c.dt, c.nx, c.ny, c.ng);
+    advectImplicit(boundTemp2, vars.vy, vars.vx, vars.vy, c.dx, c.dy, c.dt, c.nx, c.ny, c.ng);
+    vars.vx.swapData(boundTemp1);
+    vars.vy.swapData(boundTemp2);
+  } else {
+    calcAdvectionTerm(boundTemp1, vars.vx, vars.vx, vars.vy, c.dx, c.dy);
+    calcAdvectionTerm(boundTemp2, vars.vy, vars.vx, vars.vy, c.dx, c.dy);
+    advanceEuler(vars.vx, boundTemp1, c.dt);
+    advanceEuler(vars.vy, boundTemp2, c.dt);
+  }
+}
+
+std::vector<SolverStats> OpenMPBackend::diffuse(Variables<Array>& vars) {
+  if(!c.isDiffusionImplicit) {
+    calcDiffusionTerm(boundTemp1, vars.vx, c.dx, c.dy, c.Re);
+    advanceEuler(vars.vx, boundTemp1, c.dt);
+    calcDiffusionTerm(boundTemp1, vars.vy, c.dx, c.dy, c.Re);
+    advanceEuler(vars.vy, boundTemp1, c.dt);
+    return {};
+  }
+
+  // As OpenCLBackend
+  const real alpha = 1.0f/(1.0f + 2.0f*c.dt/c.Re*(1.0f/(c.dx*c.dx) + 1.0f/(c.dy*c.dy)));
+  const real beta  = -c.Re*c.dx*c.dx/c.dt;
+  const real gamma = -c.Re*c.dy*c.dy/c.dt;
+
+  // Dirichlet boundaries are held in the ghost cells of the guess
+  boundTemp1.fill(0.0f);
+  applyVxBC(boundTemp1);
+  applyVxBC(boundTemp2);
+  const SolverStats vxStats = runJacobiIteration(boundTemp2, boundTemp1, alpha, beta, gamma, vars.vx, c.diffusionControl);
+  vars.vx.swapData(boundTemp1);
+
+  boundTemp1.fill(0.0f);
+  applyVyBC(boundTemp1);
+  applyVyBC(boundTemp2);
+  const SolverStats vyStats = runJacobiIteration(boundTemp2, boundTemp1, alpha, beta, gamma, vars.vy, c.diffusionControl);
+  vars.vy.swapData(boundTemp1);
+
+  return {vxStats, vyStats};
+}
+
+void OpenMPBackend::calcDivergence(Array& div, Variables<Array>& vars) {
+  div.fill(0.0f);
+  ::calcDivergence(div, vars.vx, vars.vy, c.dx, c.dy);
+}
+
+SolverStats OpenMPBackend::solvePressure(Array& p, const Array& div) {
+  const real dx2 = c.dx*c.dx;
+  const real dy2 = c.dy*c.dy;
+  const real alpha = -0.5f*dx2*dy2/(dx2 + dy2);
+
+  // von Neumann boundaries are reapplied before every sweep
+  p.fill(0.0f);
+  const SolverStats stats = iterateUntilConverged(c.pressureControl,
+    [&](const int n) {
+      for(int k=0; k<n; ++k) {
+        applyVonNeumannBC(p, physical);
+        applyJacobiStep(cellTemp, p, alpha, dx2, dy2, div);
+        p.swapData(cellTemp);
+      }
+    },
+    [&]() {
+      applyVonNeumannBC(p, physical);
+      return calcJacobiResidualNorms(p, alpha, dx2, dy2, div);
+    });
+  applyPressureBC(p);
+  return stats;
+}
+
+void OpenMPBackend::project(Variables<Array>& vars) {
+  applyProjectionX(vars.vx, vars.p, c.dx);
+  applyProjectionY(vars.vy, vars.p, c.dy);
+}
+
+void OpenMPBackend::finish() {
+}
@@ -1,7 +1,151 @@
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <experimental/simd>
+#include <initializer_list>
+#include <unistd.h>
 
 #include <openmp_kernels.hpp>
 
+namespace stdx = std::experimental;
+
+// The row kernels below step along the contiguous axis a vector at a time,
+// then finish the row one element at a time. The vector width is the widest
+// the compiler targets, so build with FAFS_NATIVE_ARCH for AVX2 or AVX-512.
+typedef stdx::native_simd<real> VectorReal;
+typedef stdx::simd<real, stdx::simd_abi::scalar> ScalarReal;
+
+static_assert(stdx::memory_alignment_v<VectorReal> <= SIMD_ALIGNMENT, "Vectors must not need more than the row alignment");
+
+template<class V, class Flags = stdx::element_aligned_tag>
+V load(const real* p, Flags flags = {}) {
+  return V(p, flags);
+}
+
+template<class V, class Flags = stdx::element_aligned_tag>
+void store(const V& v, real* p, Flags flags = {}) {
+  v.copy_to(p, flags);
+}
+
+// Whether the first interior element of every row of each array is
+// SIMD_ALIGNMENT-aligned, so that a vector at a multiple of its width along a
+// row may be loaded and stored with vector_aligned. Packed arrays need not be.
+bool rowsAligned(std::initializer_list<const Array*> arrays) {
+  for(const Array* a : arrays) {
+    if(reinterpret_cast<std::uintptr_t>(a->ptr(0, 0)) % SIMD_ALIGNMENT != 0 || a->rowStride*sizeof(real) % SIMD_ALIGNMENT != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Number of interior rows of out, the lines along the contiguous axis
+int interiorRows(const Array& out) {
+  return I_CONTIGUOUS ? out.ny : out.nx;
+}
+
+int interiorRowLength(const Array& out) {
+  return I_CONTIGUOUS ? out.nx : out.ny;
+}
+
+CellRange interiorRange(const Array& a) {
+  return {0, 0, a.nx, a.ny};
+}
+
+template<class Kernel, class V, class Flags>
+void callAt(const int n, const int k, Kernel& kernel, const V& v, const Flags& flags) {
+  I_CONTIGUOUS ? kernel(k, n, v, flags) : kernel(n, k, v, flags);
+}
+
+// Calls kernel(i, j, V(), flags) along elements [k0, k1) of interior row n,
+// with V a vector of consecutive elements starting at (i, j) where a whole
+// vector fits and a single element otherwise. flags is for loads and stores
+// at (i, j): vector_aligned if aligned, as given by rowsAligned for every
+// array so accessed, and the segment starts at a multiple of the vector width,
+// otherwise element_aligned.
+template<class Kernel>
+void forEachInSegment(const int n, const int k0, const int k1, const bool aligned, Kernel kernel) {
+  const int width = VectorReal::size();
+  int k = k0;
+  if(aligned && k0%width == 0) {
+    for(; k+width <= k1; k += width) {
+      callAt(n, k, kernel, VectorReal(), stdx::vector_aligned);
+    }
+  }
+  for(; k+width <= k1; k += width) {
+    callAt(n, k, kernel, VectorReal(), stdx::element_aligned);
+  }
+  for(; k<k1; ++k) {
+    callAt(n, k, kernel, ScalarReal(), stdx::element_aligned);
+  }
+}
+
+template<class Kernel>
+void forEachInRow(const Array& out, const int n, const bool aligned, Kernel kernel) {
+  forEachInSegment(n, 0, interiorRowLength(out), aligned, kernel);
+}
+
+// Bytes of cache a tile may fill: half of L2, leaving room for everything else
+std::size_t tileCacheBytes() {
+  static const std::size_t bytes = [] {
+    long l2 = 0;
+#ifdef _SC_LEVEL2_CACHE_SIZE
+    l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+    return l2 > 0 ? std::size_t(l2)/2 : std::size_t(128*1024);
+  }();
+  return bytes;
+}
+
+// Calls kernel(i, j, V(), flags) over cells [i0, i1) x [j0, j1) of range, as
+// forEachInRow, in tiles spanning each thread's rows and a segment of the
+// contiguous axis. A sweep keeps rowsLive rows in use at once (three of the
+// input for a five-point stencil, plus one of each other array), and segments
+// are short enough for those to stay in L2, so rows loaded for one output row
+// are reused by the next. Rows are shared between threads as in Array::fill,
+// so that each thread mostly works on pages it touched first, on its own NUMA
+// node.
+template<class Kernel>
+void forEachTile(const CellRange& range, const int rowsLive, const bool aligned, Kernel kernel) {
+  const int width = VectorReal::size();
+  const int n0 = I_CONTIGUOUS ? range.j0 : range.i0;
+  const int n1 = I_CONTIGUOUS ? range.j1 : range.i1;
+  const int k0 = I_CONTIGUOUS ? range.i0 : range.j0;
+  const int k1 = I_CONTIGUOUS ? range.i1 : range.j1;
+  const int segment = std::max(width, int(tileCacheBytes()/(rowsLive*sizeof(real)))/width*width);
+#pragma omp parallel
+  for(int k=k0; k<k1; k+=segment) {
+    // The static schedule gives each thread the same rows for every segment
+#pragma omp for schedule(static) nowait
+    for(int n=n0; n<n1; ++n) {
+      forEachInSegment(n, k, std::min(k+segment, k1), aligned, kernel);
+    }
+  }
+}
+
+template<class Kernel>
+void forEachTile(const Array& out, const int rowsLive, const bool aligned, Kernel kernel) {
+  forEachTile(interiorRange(out), rowsLive, aligned, kernel);
+}
+
+// Calls kernel(i, j) for every interior cell of out, with rows shared between
+// threads as in the vectorised kernels
+template<class Kernel>
+void forEachCell(const Array& out, Kernel kernel) {
+#pragma omp parallel for schedule(static)
+  for(int n=0; n<interiorRows(out); ++n) {
+    for(int k=0; k<interiorRowLength(out); ++k) {
+      I_CONTIGUOUS ? kernel(k, n) : kernel(n, k);
+    }
+  }
+}
+
+// Index of each lane of a vector starting at index i0 along the contiguous axis
+template<class V>
+V laneIndices(const int i0) {
+  return V([&](auto k) { return real(i0 + int(k)); });
+}
+
 real calcAdvection(const Array& f, const int i, const int j, const real dx, const real dy, const real dt, const int nx, const int ny, const int ng, const Array& vx, const Array& vy) {
   // figure out where the current piece has come from (in index space)
   real x = i - dt*vx(i,j)/dx;
@@ -11,9 +155,9 @@ real calcAdvection(const Array& f, const int i, const int j, const real dx, cons
   int lefIdx = -ng;
   int topIdx = ny-1+ng;
   int botIdx = -ng;
-  int x2 = clamp(int(std::floor(x+1)),rigIdx, lefIdx);
+  int x2 = clamp(int(std::floor(x))+1,rigIdx, lefIdx);
   int x1 = clamp(int(std::floor(x))  ,rigIdx, lefIdx);
-  int y2 = clamp(int(std::floor(y+1)),topIdx, botIdx);
+  int y2 = clamp(int(std::floor(y))+1,topIdx, botIdx);
   int y1 = clamp(int(std::floor(y))  ,topIdx, botIdx);
   x = clamp(x, real(rigIdx), real(lefIdx));
   y = clamp(y, real(topIdx), real(botIdx));
@@ -42,26 +186,69 @@ real calcAdvection(const Array& f, const int i, const int j, const real dx, cons
   return fAv;
 }
 
-real calcJacobiStep(const Array& f, const real alpha, const real beta, const Array& b, const int i, const int j) {
-  return (alpha*b(i,j) + f(i,j+1) + f(i,j-1) + f(i+1,j) + f(i-1,j))/beta;
+real calcJacobiStep(const Array& f, const real alpha, const real beta, const real gamma, const Array& b, const int i, const int j) {
+  return alpha*(b(i,j) - (f(i+1,j) + f(i-1,j))/beta - (f(i,j+1) + f(i,j-1))/gamma);
 }
 
-void applyJacobiStep(Array& out, const Array& f, const real alpha, const real beta, const Array& b) {
-#pragma omp parallel for collapse(2)
-  for (int i=0; i<out.nx; ++i) {
-    for(int j=0; j<out.ny; ++j) {
-      out(i,j) = calcJacobiStep(f, alpha, beta, b, i, j);
-    }
-  }
+void applyJacobiStep(Array& out, const Array& f, const real alpha, const real beta, const real gamma, const Array& b, const CellRange& range) {
+  const int si = f.strideI();
+  const int sj = f.strideJ();
+  forEachTile(range, 5, rowsAligned({&out, &b}), [&](const int i, const int j, auto v, auto flags) {
+    typedef decltype(v) V;
+    const real* c = f.ptr(i, j);
+    store(alpha*(load<V>(b.ptr(i, j), flags) - (load<V>(c+si) + load<V>(c-si))/beta - (load<V>(c+sj) + load<V>(c-sj))/gamma), out.ptr(i, j), flags);
+  });
+}
+
+void applyJacobiStep(Array& out, const Array& f, const real alpha, const real beta, const real gamma, const Array& b) {
+  applyJacobiStep(out, f, alpha, beta, gamma, b, interiorRange(out));
 }
 
-void runJacobiIteration(Array& out, Array& in, const real alpha, const real beta, const Array& b, const int iterations) {
+void runJacobiIteration(Array& out, Array& in, const real alpha, const real beta, const real gamma, const Array& b, const int iterations) {
   for(int i=0; i<iterations; ++i) {
-    applyJacobiStep(out, in, alpha, beta, b);
+    applyJacobiStep(out, in, alpha, beta, gamma, b);
     in.swap(out);
   }
 }
 
+SolverStats runJacobiIteration(Array& out, Array& in, const real alpha, const real beta, const real gamma, const Array& b, const SolverControl& control) {
+  return iterateUntilConverged(control,
+    [&](const int n) {
+      runJacobiIteration(out, in, alpha, beta, gamma, b, n);
+    },
+    [&]() {
+      return calcJacobiResidualNorms(in, alpha, beta, gamma, b);
+    });
+}
+
+ResidualNorms calcJacobiResidualNorms(const Array& f, const real alpha, const real beta, const real gamma, const Array& b, const CellRange& range) {
+  double sum = 0.0;
+  real mx = 0.0f;
+  const int si = f.strideI();
+  const int sj = f.strideJ();
+  const int n0 = I_CONTIGUOUS ? range.j0 : range.i0;
+  const int n1 = I_CONTIGUOUS ? range.j1 : range.i1;
+  const int k0 = I_CONTIGUOUS ? range.i0 : range.j0;
+  const int k1 = I_CONTIGUOUS ? range.i1 : range.j1;
+  const bool aligned = rowsAligned({&f, &b});
+#pragma omp parallel for schedule(static) reduction(+:sum) reduction(max:mx)
+  for (int n=n0; n<n1; ++n) {
+    forEachInSegment(n, k0, k1, aligned, [&](const int i, const int j, auto v, auto flags) {
+      typedef decltype(v) V;
+      const real* c = f.ptr(i, j);
+      // b - Ax for the system solved by calcJacobiStep
+      const V res = load<V>(b.ptr(i, j), flags) - load<V>(c, flags)/alpha - (load<V>(c+si) + load<V>(c-si))/beta - (load<V>(c+sj) + load<V>(c-sj))/gamma;
+      sum += stdx::reduce(res*res);
+      mx = std::max(mx, stdx::hmax(stdx::abs(res)));
+    });
+  }
+  return {real(std::sqrt(sum)), mx};
+}
+
+ResidualNorms calcJacobiResidualNorms(const Array& f, const real alpha, const real beta, const real gamma, const Array& b) {
+  return calcJacobiResidualNorms(f, alpha, beta, gamma, b, interiorRange(f));
+}
+
 real ddx(const Array& f, const real dx, const int i, const int j) {
   return (f(i+1,j)-f(i-1,j))/(2.0f*dx);
 }
@@ -70,12 +257,53 @@ real ddy(const Array& f, const real dy, const int i, const int j) {
   return (f(i,j+1) - f(i,j-1))/(2.0f*dy);
 }
 
+// Bilinear weights of the lower and upper neighbours of x, as calcAdvection
+template<class V>
+void interpolationWeights(const V& x, const V& x1, const V& x2, V& x1Weight, V& x2Weight) {
+  x1Weight = (x2-x)/(x2-x1);
+  x2Weight = (x-x1)/(x2-x1);
+  where(x1 == x2, x1Weight) = 1;
+  where(x1 == x2, x2Weight) = 0;
+}
+
+// f at integer coordinates held in real vectors, one element at a time
+template<class V>
+V gather(const Array& f, const V& x, const V& y) {
+  return V([&](auto k) {
+    return *f.ptr(int(x[k]), int(y[k]));
+  });
+}
+
+// Vectorised calcAdvection. The back-traced points are not contiguous, so
+// only the four corner reads are gathered element by element.
 void advectImplicit(Array& out, const Array& f, const Array& vx, const Array& vy, const real dx, const real dy, const real dt, const int nx, const int ny, const int ng) {
-#pragma omp parallel for collapse(2)
-  for (int i=0; i<out.nx; ++i) {
-    for(int j=0; j<out.ny; ++j) {
-      out(i,j) = calcAdvection(f, i, j, dx, dy, dt, nx, ny, ng, vx, vy);
-    }
+  const real rigIdx = nx-1+ng;
+  const real lefIdx = -ng;
+  const real topIdx = ny-1+ng;
+  const real botIdx = -ng;
+  const bool aligned = rowsAligned({&out, &vx, &vy});
+#pragma omp parallel for schedule(static)
+  for (int n=0; n<interiorRows(out); ++n) {
+    forEachInRow(out, n, aligned, [&](const int i, const int j, auto v, auto flags) {
+      typedef decltype(v) V;
+      const V iv = I_CONTIGUOUS ? laneIndices<V>(i) : V(real(i));
+      const V jv = I_CONTIGUOUS ? V(real(j)) : laneIndices<V>(j);
+      V x = iv - dt*load<V>(vx.ptr(i, j), flags)/dx;
+      V y = jv - dt*load<V>(vy.ptr(i, j), flags)/dy;
+      const V x2 = stdx::max(stdx::min(floor(x)+1, V(rigIdx)), V(lefIdx));
+      const V x1 = stdx::max(stdx::min(floor(x), V(rigIdx)), V(lefIdx));
+      const V y2 = stdx::max(stdx::min(floor(y)+1, V(topIdx)), V(botIdx));
+      const V y1 = stdx::max(stdx::min(floor(y), V(topIdx)), V(botIdx));
+      x = stdx::max(stdx::min(x, V(rigIdx)), V(lefIdx));
+      y = stdx::max(stdx::min(y, V(topIdx)), V(botIdx));
+
+      V x1Weight, x2Weight, y1Weight, y2Weight;
+      interpolationWeights(x, x1, x2, x1Weight, x2Weight);
+      interpolationWeights(y, y1, y2, y1Weight, y2Weight);
+      const V fy1 = x1Weight*gather(f, x1, y1) + x2Weight*gather(f, x2, y1);
+      const V fy2 = x1Weight*gather(f, x1, y2) + x2Weight*gather(f, x2, y2);
+      store(y1Weight*fy1 + y2Weight*fy2, out.ptr(i, j), flags);
+    });
   }
 }
 
@@ -84,59 +312,62 @@ real calcAdvectionTerm(const Array& f, const Array& vx, const Array& vy, const r
 }
 
 void calcAdvectionTerm(Array& out, const Array& f, const Array& vx, const Array& vy, const real dx, const real dy) {
-#pragma omp parallel for collapse(2)
-  for(int i=0; i<out.nx; ++i) {
-    for(int j=0; j<out.ny; ++j) {
-      out(i,j) = calcAdvectionTerm(f, vx, vy, dx, dy, i, j);
-    }
-  }
+  forEachCell(out, [&](const int i, const int j) {
+    out(i,j) = calcAdvectionTerm(f, vx, vy, dx, dy, i, j);
+  });
 }
 
-real calcDiffusionTerm(const Array& f, const real dx, const real dy, const int i, const int j) {
-  return (f(i,j+1) + f(i,j-1) + f(i+1,j) + f(i-1,j) - 4*f(i,j))/(dx*dy);
+real calcDiffusionTerm(const Array& f, const real dx, const real dy, const real Re, const int i, const int j) {
+  return 1.0f/Re*((f(i,j+1) - 2.0f*f(i,j) + f(i,j-1))/(dy*dy) + (f(i+1,j) - 2.0f*f(i,j) + f(i-1,j))/(dx*dx));
 }
 
-void calcDiffusionTerm(Array& out, const Array& f, const real dx, const real dy) {
-#pragma omp parallel for collapse(2)
-  for(int i=0; i<out.nx; ++i) {
-    for(int j=0; j<out.ny; ++j) {
-      out(i,j) = calcDiffusionTerm(f, dx, dy, i, j);
-    }
-  }
+void calcDiffusionTerm(Array& out, const Array& f, const real dx, const real dy, const real Re) {
+  forEachCell(out, [&](const int i, const int j) {
+    out(i,j) = calcDiffusionTerm(f, dx, dy, Re, i, j);
+  });
 }
 
 void advanceEuler(Array& out, const Array& ddt, const real dt) {
-#pragma omp parallel for collapse(2)
-  for(int i=0; i<out.nx; ++i) {
-    for(int j=0; j<out.ny; ++j) {
-      out(i,j) = out(i,j) + ddt(i,j)*dt;
-    }
-  }
+  forEachCell(out, [&](const int i, const int j) {
+    out(i,j) = out(i,j) + ddt(i,j)*dt;
+  });
 }
 
+// Velocities are node-centred, at the corners of the cells of out, and each
+// difference is averaged over the two edges it spans, as in the OpenCL kernels
 void calcDivergence(Array& out, const Array& fx, const Array& fy, const real dx, const real dy) {
-#pragma omp parallel for collapse(2)
-  for(int i=0; i<out.nx; ++i) {
-    for(int j=0; j<out.ny; ++j) {
-      out(i,j) = (fx(i,j) - fx(i-1,j))/dx + (fy(i,j) - fy(i,j-1))/dy;
-    }
-  }
+  forEachTile(out, 5, rowsAligned({&out, &fx, &fy}), [&](const int i, const int j, auto v, auto flags) {
+    typedef decltype(v) V;
+    const real* x = fx.ptr(i, j);
+    const real* y = fy.ptr(i, j);
+    const int xi = fx.strideI(), xj = fx.strideJ();
+    const int yi = fy.strideI(), yj = fy.strideJ();
+    const V dvxdx = 0.5f*((load<V>(x, flags) - load<V>(x-xi))/dx + (load<V>(x-xj) - load<V>(x-xi-xj))/dx);
+    const V dvydy = 0.5f*((load<V>(y, flags) - load<V>(y-yj))/dy + (load<V>(y-yi) - load<V>(y-yi-yj))/dy);
+    store(dvydy + dvxdx, out.ptr(i, j), flags);
+  });
 }
 
+// Pressure is cell-centred, so its gradient at node (i, j) averages the
+// differences across the two cells above and below (left and right of) it
 void applyProjectionX(Array& out, const Array& f, const real dx) {
-#pragma omp parallel for collapse(2)
-  for(int i=0; i<out.nx; ++i) {
-    for(int j=0; j<out.ny; ++j) {
-      out(i,j) = out(i,j) - (f(i+1,j)-f(i,j))/dx;
-    }
-  }
+  forEachTile(out, 3, rowsAligned({&out, &f}), [&](const int i, const int j, auto v, auto flags) {
+    typedef decltype(v) V;
+    real* o = out.ptr(i, j);
+    const real* fij = f.ptr(i, j);
+    const int si = f.strideI(), sj = f.strideJ();
+    const V dfdx = 0.5f*((load<V>(fij+si) - load<V>(fij, flags))/dx + (load<V>(fij+si+sj) - load<V>(fij+sj))/dx);
+    store(load<V>(o, flags) - dfdx, o, flags);
+  });
 }
 
 void applyProjectionY(Array& out, const Array& f, const real dy) {
-#pragma omp parallel for collapse(2)
-  for(int i=0; i<out.nx; ++i) {
-    for(int j=0; j<out.ny; ++j) {
-      out(i,j) = out(i,j) - (f(i,j+1)-f(i,j))/dy;
-    }
-  }
+  forEachTile(out, 3, rowsAligned({&out, &f}), [&](const int i, const int j, auto v, auto flags) {
+    typedef decltype(v) V;
+    real* o = out.ptr(i, j);
+    const real* fij = f.ptr(i, j);
+    const int si = f.strideI(), sj = f.strideJ();
+    const V dfdy = 0.5f*((load<V>(fij+sj) - load<V>(fij, flags))/dy + (load<V>(fij+si+sj) - load<V>(fij+si))/dy);
+    store(load<V>(o, flags) - dfdy, o, flags);
+  });
 }
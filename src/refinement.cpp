@@ -0,0 +1,43 @@
+#include <refinement.hpp>
+#include <kernels.hpp>
+#include <user_kernels.hpp>
+
+IterativeRefinement::IterativeRefinement(const int nx, const int ny, const int ng, const int nMembers):
+  x(CL_MEM_READ_WRITE, nMembers*(nx+2*ng)*(ny+2*ng)*sizeof(double)),
+  res(nx, ny, ng, "", 0.0f, nMembers),
+  correction(nx, ny, ng, "", 0.0f, nMembers)
+{}
+
+size_t IterativeRefinement::deviceBytes() const {
+  return bufferBytes(x) + res.deviceBytes() + correction.deviceBytes();
+}
+
+SolverStats IterativeRefinement::solve(OpenCLArray& out, const OpenCLArray& b, const double alpha, const double beta, const double gamma, const bool isVonNeumann, const InnerSolve& inner, const SolverControl& control) {
+  Fp64Kernels& kernels = fp64Kernels();
+  const int nx = out.nx, ny = out.ny, ng = out.ng;
+  kernels.toDouble(out.entire, x, out.getDeviceData(), nx, ny, ng);
+
+  auto updateResidual = [&]() {
+    kernels.calcJacobiResidualDouble(res.interior, res.getDeviceData(), x, alpha, beta, gamma, b.getDeviceData(), isVonNeumann, nx, ny, ng);
+  };
+
+  SolverStats stats = iterateUntilConverged(control,
+    [&](const int n) {
+      for(int i=0; i<n; ++i) {
+        // The residual is current after every check, but not between them
+        if(i > 0) {
+          updateResidual();
+        }
+        correction.fill(0.0f, true);
+        inner(correction, res);
+        kernels.addCorrection(correction.interior, x, correction.getDeviceData(), nx, ny, ng);
+      }
+    },
+    [&]() {
+      updateResidual();
+      return calcNorms(res);
+    });
+
+  kernels.toReal(out.interior, out.getDeviceData(), x, nx, ny, ng);
+  return stats;
+}
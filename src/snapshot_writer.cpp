@@ -0,0 +1,134 @@
+#include <stdexcept>
+
+#include <snapshot_writer.hpp>
+#include <hdffile.hpp>
+
+StagingBuffer::StagingBuffer(const size_t count_in):
+  buffer(CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, count_in*sizeof(real)),
+  count{count_in}
+{
+  hostPtr = static_cast<real*>(cl::CommandQueue::getDefault().enqueueMapBuffer(buffer, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, count*sizeof(real)));
+}
+
+StagingBuffer::~StagingBuffer() {
+  cl::CommandQueue::getDefault().enqueueUnmapMemObject(buffer, hostPtr);
+}
+
+real* StagingBuffer::data() {
+  return hostPtr;
+}
+
+size_t StagingBuffer::size() const {
+  return count;
+}
+
+SnapshotWriter::SnapshotWriter(const int maxPending_in):
+  maxPending{maxPending_in},
+  nInFlight{0},
+  stopping{false},
+  worker(&SnapshotWriter::run, this)
+{}
+
+SnapshotWriter::~SnapshotWriter() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  changed.notify_all();
+  worker.join();
+}
+
+void SnapshotWriter::write(const std::string& filename, const std::vector<const OpenCLArray*>& arrays) {
+  enqueue(Snapshot{filename, nullptr, 0, 0, {}}, arrays);
+}
+
+void SnapshotWriter::append(TimeSeriesWriter& series, const real t, const int step, const std::vector<const OpenCLArray*>& arrays) {
+  enqueue(Snapshot{"", &series, t, step, {}}, arrays);
+}
+
+void SnapshotWriter::enqueue(Snapshot snapshot, const std::vector<const OpenCLArray*>& arrays) {
+  std::unique_lock<std::mutex> lock(mutex);
+  changed.wait(lock, [&]() { return nInFlight < maxPending || error; });
+  rethrowError();
+
+  for(const OpenCLArray* arr : arrays) {
+    if(arr->getName() == "") {
+      throw std::runtime_error("Cannot save unnamed Array");
+    }
+    SnapshotField field{arr->getName(), arr->rows(), arr->rowLength(), arr->getH5Type(), acquireStaging(arr->size()), cl::Event()};
+    const cl::CommandQueue& queue = arr->getQueue();
+    queue.enqueueReadBuffer(arr->getRealDeviceData(), CL_FALSE, 0, arr->size()*sizeof(real), field.staging->data(), nullptr, &field.readback);
+    queue.flush();
+    snapshot.fields.push_back(std::move(field));
+  }
+
+  pending.push_back(std::move(snapshot));
+  ++nInFlight;
+  changed.notify_all();
+}
+
+void SnapshotWriter::flush() {
+  std::unique_lock<std::mutex> lock(mutex);
+  changed.wait(lock, [&]() { return nInFlight == 0 || error; });
+  rethrowError();
+}
+
+void SnapshotWriter::run() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while(true) {
+    changed.wait(lock, [&]() { return stopping || !pending.empty(); });
+    if(pending.empty()) {
+      return;
+    }
+    Snapshot snapshot = std::move(pending.front());
+    pending.pop_front();
+    lock.unlock();
+
+    try {
+      if(snapshot.series) {
+        snapshot.series->beginFrame(snapshot.t, snapshot.step);
+        for(SnapshotField& field : snapshot.fields) {
+          field.readback.wait();
+          snapshot.series->write(field.name, field.staging->data(), field.nx, field.ny, field.type);
+        }
+      } else {
+        HDFFile file(snapshot.filename, false);
+        for(SnapshotField& field : snapshot.fields) {
+          field.readback.wait();
+          writeDataset(file.file, field.name, field.staging->data(), field.nx, field.ny, field.type);
+        }
+        file.close();
+      }
+    } catch(...) {
+      lock.lock();
+      error = std::current_exception();
+      lock.unlock();
+    }
+
+    lock.lock();
+    for(SnapshotField& field : snapshot.fields) {
+      freeStaging.push_back(std::move(field.staging));
+    }
+    --nInFlight;
+    changed.notify_all();
+  }
+}
+
+std::unique_ptr<StagingBuffer> SnapshotWriter::acquireStaging(const size_t count) {
+  for(auto it = freeStaging.begin(); it != freeStaging.end(); ++it) {
+    if((*it)->size() == count) {
+      std::unique_ptr<StagingBuffer> staging = std::move(*it);
+      freeStaging.erase(it);
+      return staging;
+    }
+  }
+  return std::make_unique<StagingBuffer>(count);
+}
+
+void SnapshotWriter::rethrowError() {
+  if(error) {
+    std::exception_ptr e = error;
+    error = nullptr;
+    std::rethrow_exception(e);
+  }
+}
@@ -0,0 +1,17 @@
+#include <solver_control.hpp>
+
+std::ostream& operator<<(std::ostream& os, const SolverStats& stats) {
+  os << stats.iterations << " iterations, residual L2: " << stats.residual.l2 << ", max: " << stats.residual.max;
+  return os;
+}
+
+SolverControl::SolverControl(const int maxIterations_in, const int checkInterval_in, const real relTolerance_in, const real absTolerance_in):
+  maxIterations{maxIterations_in},
+  checkInterval{std::max(checkInterval_in, 1)},
+  relTolerance{relTolerance_in},
+  absTolerance{absTolerance_in}
+{}
+
+bool SolverControl::isConverged(const ResidualNorms& residual, const ResidualNorms& initial) const {
+  return residual.l2 <= absTolerance || residual.l2 <= relTolerance*initial.l2;
+}
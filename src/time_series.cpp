@@ -0,0 +1,177 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include <time_series.hpp>
+
+// Frames per chunk of the time and step datasets
+const hsize_t SCALAR_CHUNK = 256;
+
+// An empty dataset of frames of shape frameDims, extensible in the number of frames
+H5::DataSet createSeries(H5::H5File& file, const std::string& name, const H5::DataType& type, const std::vector<hsize_t>& frameDims, const hsize_t framesPerChunk, const int deflateLevel) {
+  std::vector<hsize_t> dims{0};
+  std::vector<hsize_t> maxDims{H5S_UNLIMITED};
+  std::vector<hsize_t> chunk{framesPerChunk};
+  for(const hsize_t n : frameDims) {
+    dims.push_back(n);
+    maxDims.push_back(n);
+    chunk.push_back(n);
+  }
+  const int rank = dims.size();
+  H5::DataSpace space(rank, dims.data(), maxDims.data());
+
+  H5::DSetCreatPropList props;
+  props.setChunk(rank, chunk.data());
+  if(deflateLevel > 0) {
+    // Shuffling the bytes of each value first lets deflate find far more redundancy in floats
+    props.setShuffle();
+    props.setDeflate(deflateLevel);
+  }
+  return file.createDataSet(name.c_str(), type, space, props);
+}
+
+// Write one frame at index frame, extending the dataset to hold it if needed
+void writeFrame(H5::DataSet& ds, const hsize_t frame, const void* data, const H5::PredType& memType) {
+  H5::DataSpace filespace = ds.getSpace();
+  const int rank = filespace.getSimpleExtentNdims();
+  std::vector<hsize_t> dims(rank);
+  filespace.getSimpleExtentDims(dims.data());
+  if(dims[0] <= frame) {
+    dims[0] = frame + 1;
+    ds.extend(dims.data());
+    filespace = ds.getSpace();
+  }
+
+  std::vector<hsize_t> start(rank, 0);
+  std::vector<hsize_t> count(dims);
+  start[0] = frame;
+  count[0] = 1;
+  filespace.selectHyperslab(H5S_SELECT_SET, count.data(), start.data());
+  H5::DataSpace memspace(rank, count.data());
+  ds.write(data, memType, memspace, filespace);
+}
+
+TimeSeriesWriter::TimeSeriesWriter(const std::string& filename, const FileMode mode, const int deflateLevel_in):
+  file(filename, mode),
+  deflateLevel{deflateLevel_in},
+  frames{0}
+{
+  if(mode == FileMode::ReadOnly) {
+    throw std::runtime_error("Cannot write to " + filename + ": Opened read-only");
+  }
+  if(file.file.nameExists("time")) {
+    times = file.file.openDataSet("time");
+    steps = file.file.openDataSet("step");
+    hsize_t dims[1];
+    times.getSpace().getSimpleExtentDims(dims);
+    frames = dims[0];
+  } else {
+    times = createSeries(file.file, "time", H5::PredType::IEEE_F64LE, {}, SCALAR_CHUNK, 0);
+    steps = createSeries(file.file, "step", H5::PredType::STD_I32LE, {}, SCALAR_CHUNK, 0);
+  }
+}
+
+void TimeSeriesWriter::beginFrame(const real t, const int step) {
+  const double time = t;
+  writeFrame(times, frames, &time, H5::PredType::NATIVE_DOUBLE);
+  writeFrame(steps, frames, &step, H5::PredType::NATIVE_INT);
+  ++frames;
+}
+
+void TimeSeriesWriter::write(const std::string& name, const real* data, const int nx, const int ny, const H5::PredType& type) {
+  if(frames == 0) {
+    throw std::runtime_error("Cannot write " + name + ": No frame begun");
+  }
+  writeFrame(series(name, nx, ny, type), frames - 1, data, type);
+}
+
+void TimeSeriesWriter::write(const Array& arr) {
+  if(arr.getName() == "") {
+    throw std::runtime_error("Cannot save unnamed Array");
+  }
+  const int nx = arr.rows();
+  const int ny = arr.rowLength();
+  // First element of the first row
+  const real* first = arr.ptr(-arr.ng, -arr.ng);
+  if(arr.rowStride == ny) {
+    write(arr.getName(), first, nx, ny, arr.getH5Type());
+    return;
+  }
+  // Frames are written packed, so padded rows are copied out first
+  std::vector<real> packed(nx*ny);
+  for(int i=0; i<nx; ++i) {
+    std::copy(first + i*arr.rowStride, first + i*arr.rowStride + ny, packed.begin() + i*ny);
+  }
+  write(arr.getName(), packed.data(), nx, ny, arr.getH5Type());
+}
+
+void TimeSeriesWriter::append(const real t, const int step, const std::vector<const Array*>& arrays) {
+  beginFrame(t, step);
+  for(const Array* arr : arrays) {
+    write(*arr);
+  }
+}
+
+void TimeSeriesWriter::discardFramesAfter(const int step) {
+  std::vector<int> frameSteps(frames);
+  steps.read(frameSteps.data(), H5::PredType::NATIVE_INT);
+  int kept = 0;
+  while(kept < frames && frameSteps[kept] <= step) {
+    ++kept;
+  }
+  if(kept == frames) {
+    return;
+  }
+
+  for(hsize_t i=0; i<file.file.getNumObjs(); ++i) {
+    H5::DataSet ds = file.file.openDataSet(file.file.getObjnameByIdx(i));
+    H5::DataSpace filespace = ds.getSpace();
+    std::vector<hsize_t> dims(filespace.getSimpleExtentNdims());
+    filespace.getSimpleExtentDims(dims.data());
+    if(dims[0] > hsize_t(kept)) {
+      dims[0] = kept;
+      ds.extend(dims.data());
+    }
+  }
+  frames = kept;
+}
+
+int TimeSeriesWriter::nFrames() const {
+  return frames;
+}
+
+void TimeSeriesWriter::flush() {
+  file.file.flush(H5F_SCOPE_LOCAL);
+}
+
+void TimeSeriesWriter::close() {
+  fields.clear();
+  times.close();
+  steps.close();
+  file.close();
+}
+
+H5::DataSet& TimeSeriesWriter::series(const std::string& name, const int nx, const int ny, const H5::PredType& type) {
+  auto it = fields.find(name);
+  if(it == fields.end()) {
+    H5::DataSet ds;
+    if(file.file.nameExists(name)) {
+      ds = file.file.openDataSet(name.c_str());
+    } else {
+      H5::FloatType datatype(type);
+      datatype.setOrder(H5T_ORDER_LE);
+      ds = createSeries(file.file, name, datatype, {hsize_t(nx), hsize_t(ny)}, 1, deflateLevel);
+    }
+    it = fields.emplace(name, ds).first;
+  }
+
+  hsize_t dims[3];
+  H5::DataSpace filespace = it->second.getSpace();
+  if(filespace.getSimpleExtentNdims() != 3) {
+    throw std::runtime_error("Cannot write " + name + ": Dataset is not a time series");
+  }
+  filespace.getSimpleExtentDims(dims);
+  if(dims[1] != hsize_t(nx) || dims[2] != hsize_t(ny)) {
+    throw std::runtime_error("Cannot write " + name + ": Size differs from earlier frames");
+  }
+  return it->second;
+}
@@ -1,31 +1,252 @@
+#include <cmath>
+#include <initializer_list>
+#include <stdexcept>
+#include <string>
+
 #include <ocl_array.hpp>
+#include <user_kernels.hpp>
+
+// Reductions run a fixed number of work groups and finish the sum on the host
+const int REDUCTION_GROUP_SIZE = 256;
+const int REDUCTION_GROUPS = 64;
+
+// Partial results of a reduction over a, room for two per group. Each array
+// owns its scratch, so reductions over different arrays can be in flight
+// together.
+const cl::Buffer& reductionBuffer(const OpenCLArray& a) {
+  return a.getReductionBuffer(2*REDUCTION_GROUPS*sizeof(real));
+}
+
+const cl::EnqueueArgs reductionRange(const cl::CommandQueue& queue) {
+  cl::CommandQueue q = queue;
+  return cl::EnqueueArgs(q, cl::NDRange(REDUCTION_GROUPS*REDUCTION_GROUP_SIZE), cl::NDRange(REDUCTION_GROUP_SIZE));
+}
+
+PendingNorms::PendingNorms(const OpenCLArray& a):
+  partial(2*REDUCTION_GROUPS)
+{
+  a.getQueue().enqueueReadBuffer(reductionBuffer(a), CL_FALSE, 0, partial.size()*sizeof(real), partial.data(), nullptr, &event);
+}
+
+ResidualNorms PendingNorms::get() {
+  event.wait();
+
+  double sum = 0.0;
+  real mx = 0.0f;
+  for(int i=0; i<REDUCTION_GROUPS; ++i) {
+    sum += partial[i];
+    mx = std::max(mx, partial[REDUCTION_GROUPS+i]);
+  }
+  return {real(std::sqrt(sum)), mx};
+}
+
+bool g_useTiledKernels = false;
+
+void setUseTiledKernels(const bool useTiled) {
+  g_useTiledKernels = useTiled;
+}
+
+bool useTiledKernels() {
+  return g_useTiledKernels;
+}
+
+// Local memory for a TILE_SIZE^2 work group plus a halo of the given width
+cl::LocalSpaceArg tileWithHalo(const int halo) {
+  return cl::Local((TILE_SIZE+halo)*(TILE_SIZE+halo)*sizeof(real));
+}
+
+void applyJacobiStep(OpenCLArray& out, const OpenCLArray& in, const real alpha, const real beta, const real gamma, const OpenCLArray& b) {
+  if(out.getStorage() == Storage::Half) {
+    if(in.getStorage() != Storage::Half || b.getStorage() != Storage::Half) {
+      throw std::runtime_error("applyJacobiStep: Half storage must be used by out, in and b together");
+    }
+    halfKernels().applyJacobiStep(out.interior, out.getDeviceData(), in.getDeviceData(), alpha, beta, gamma, b.getDeviceData(), out.nx, out.ny, out.ng);
+    return;
+  }
+  in.requireRealStorage("applyJacobiStep");
+  b.requireRealStorage("applyJacobiStep");
+  if(g_useTiledKernels) {
+    kernels().applyJacobiStepTiled(out.tiledInterior, out.getDeviceData(), in.getDeviceData(), alpha, beta, gamma, b.getDeviceData(), tileWithHalo(2), out.nx, out.ny, out.ng);
+  } else {
+    linearSystemKernels({out.nx, out.ny, out.ng, alpha, beta, gamma}).applyJacobiStep(out.interior, out.getDeviceData(), in.getDeviceData(), alpha, beta, gamma, b.getDeviceData(), out.nx, out.ny, out.ng);
+  }
+}
+
+void applyJacobiStep(OpenCLArray& out, const OpenCLArray& in, const real alpha, const real beta, const real gamma, const OpenCLArray& b, const cl::EnqueueArgs& range) {
+  out.requireRealStorage("applyJacobiStep");
+  in.requireRealStorage("applyJacobiStep");
+  b.requireRealStorage("applyJacobiStep");
+  linearSystemKernels({out.nx, out.ny, out.ng, alpha, beta, gamma}).applyJacobiStep(range, out.getDeviceData(), in.getDeviceData(), alpha, beta, gamma, b.getDeviceData(), out.nx, out.ny, out.ng);
+}
 
 void runJacobiIteration(OpenCLArray& out, OpenCLArray& initialGuess, OpenCLArray& temp, const real alpha, const real beta, const real gamma, const OpenCLArray& b, const int iterations) {
   for(int i=0; i<iterations; ++i) {
-    g_kernels.applyJacobiStep(temp.interior, temp.getDeviceData(), initialGuess.getDeviceData(), alpha, beta, gamma, b.getDeviceData(), temp.nx, temp.ny, temp.ng);
+    applyJacobiStep(temp, initialGuess, alpha, beta, gamma, b);
     initialGuess.swapData(temp);
   }
   out.swapData(initialGuess);
 }
 
+SolverStats runJacobiIteration(OpenCLArray& out, OpenCLArray& initialGuess, OpenCLArray& temp, const real alpha, const real beta, const real gamma, const OpenCLArray& b, const SolverControl& control) {
+  SolverStats stats = iterateUntilConverged(control,
+    [&](const int n) {
+      for(int i=0; i<n; ++i) {
+        applyJacobiStep(temp, initialGuess, alpha, beta, gamma, b);
+        initialGuess.swapData(temp);
+      }
+    },
+    [&]() {
+      return calcJacobiResidualNorms(initialGuess, alpha, beta, gamma, b);
+    });
+  out.swapData(initialGuess);
+  return stats;
+}
+
+void applyJacobiSweeps(OpenCLArray& out, const OpenCLArray& in, const real alpha, const real beta, const real gamma, const OpenCLArray& b, const int sweeps) {
+  out.requireRealStorage("applyJacobiSweeps");
+  in.requireRealStorage("applyJacobiSweeps");
+  b.requireRealStorage("applyJacobiSweeps");
+  const cl::LocalSpaceArg tile = tileWithHalo(2*sweeps);
+  linearSystemKernels({out.nx, out.ny, out.ng, alpha, beta, gamma}).applyJacobiSweeps(out.tiledInterior, out.getDeviceData(), in.getDeviceData(), alpha, beta, gamma, b.getDeviceData(), sweeps, tile, tile, tile, out.nx, out.ny, out.ng);
+}
+
+SolverStats runBlockedJacobiIteration(OpenCLArray& out, OpenCLArray& temp, const real alpha, const real beta, const real gamma, const OpenCLArray& b, const int sweepsPerLaunch, const SolverControl& control) {
+  // Check the residual on whole launches only
+  SolverControl blockedControl = control;
+  blockedControl.checkInterval = sweepsPerLaunch*((control.checkInterval + sweepsPerLaunch-1)/sweepsPerLaunch);
+
+  applyVonNeumannBC(out);
+  return iterateUntilConverged(blockedControl,
+    [&](int n) {
+      while(n > 0) {
+        const int sweeps = std::min(n, sweepsPerLaunch);
+        if(out.getStorage() == Storage::Half) {
+          // No blocked kernel for half arrays, so one launch per sweep
+          for(int k=0; k<sweeps; ++k) {
+            applyJacobiStep(temp, out, alpha, beta, gamma, b);
+            out.swapData(temp);
+            applyVonNeumannBC(out);
+          }
+        } else {
+          applyJacobiSweeps(temp, out, alpha, beta, gamma, b, sweeps);
+          out.swapData(temp);
+        }
+        n -= sweeps;
+      }
+      applyVonNeumannBC(out);
+    },
+    [&]() {
+      return calcJacobiResidualNorms(out, alpha, beta, gamma, b);
+    });
+}
+
+void applyRedBlackSORStep(OpenCLArray& out, const real alpha, const real beta, const real gamma, const OpenCLArray& b, const real omega, const int colour) {
+  linearSystemKernels({out.nx, out.ny, out.ng, alpha, beta, gamma}).applyRedBlackSORStep(out.redBlackInterior, out.getDeviceData(), alpha, beta, gamma, b.getDeviceData(), omega, colour, out.nx, out.ny, out.ng);
+}
+
+void runSORIteration(OpenCLArray& out, const real alpha, const real beta, const real gamma, const OpenCLArray& b, const real omega, const int iterations, const std::function<void(OpenCLArray&)>& applyBC) {
+  for(int i=0; i<iterations; ++i) {
+    if(applyBC) {
+      applyBC(out);
+    }
+    applyRedBlackSORStep(out, alpha, beta, gamma, b, omega, 0);
+    applyRedBlackSORStep(out, alpha, beta, gamma, b, omega, 1);
+  }
+}
+
+SolverStats runSORIteration(OpenCLArray& out, const real alpha, const real beta, const real gamma, const OpenCLArray& b, const real omega, const SolverControl& control, const std::function<void(OpenCLArray&)>& applyBC) {
+  return iterateUntilConverged(control,
+    [&](const int n) {
+      runSORIteration(out, alpha, beta, gamma, b, omega, n, applyBC);
+    },
+    [&]() {
+      if(applyBC) {
+        applyBC(out);
+      }
+      return calcJacobiResidualNorms(out, alpha, beta, gamma, b);
+    });
+}
+
+PendingNorms enqueueJacobiResidualNorms(const OpenCLArray& in, const real alpha, const real beta, const real gamma, const OpenCLArray& b) {
+  const cl::CommandQueue& queue = in.getQueue();
+  auto scratch = cl::Local(REDUCTION_GROUP_SIZE*sizeof(real));
+  if(in.getStorage() == Storage::Half) {
+    if(b.getStorage() != Storage::Half) {
+      throw std::runtime_error("calcJacobiResidualNorms: Half storage must be used by in and b together");
+    }
+    halfKernels().calcJacobiResidualNorms(reductionRange(queue), reductionBuffer(in), in.getDeviceData(), alpha, beta, gamma, b.getDeviceData(), scratch, scratch, in.nx, in.ny, in.ng, in.nMembers);
+    return PendingNorms(in);
+  }
+  b.requireRealStorage("calcJacobiResidualNorms");
+  linearSystemKernels({in.nx, in.ny, in.ng, alpha, beta, gamma}).calcJacobiResidualNorms(reductionRange(queue), reductionBuffer(in), in.getDeviceData(), alpha, beta, gamma, b.getDeviceData(), scratch, scratch, in.nx, in.ny, in.ng, in.nMembers);
+  return PendingNorms(in);
+}
+
+ResidualNorms calcJacobiResidualNorms(const OpenCLArray& in, const real alpha, const real beta, const real gamma, const OpenCLArray& b) {
+  return enqueueJacobiResidualNorms(in, alpha, beta, gamma, b).get();
+}
+
+ResidualNorms calcNorms(const OpenCLArray& a) {
+  const cl::CommandQueue& queue = a.getQueue();
+  a.requireRealStorage("calcNorms");
+  auto scratch = cl::Local(REDUCTION_GROUP_SIZE*sizeof(real));
+  kernels().calcNorms(reductionRange(queue), reductionBuffer(a), a.getDeviceData(), scratch, scratch, a.nx, a.ny, a.ng, a.nMembers);
+  return PendingNorms(a).get();
+}
+
+void applyJacobiOperator(OpenCLArray& out, const OpenCLArray& in, const real alpha, const real beta, const real gamma) {
+  linearSystemKernels({out.nx, out.ny, out.ng, alpha, beta, gamma}).applyJacobiOperator(out.interior, out.getDeviceData(), in.getDeviceData(), alpha, beta, gamma, out.nx, out.ny, out.ng);
+}
+
+real dotProduct(const OpenCLArray& a, const OpenCLArray& b) {
+  a.requireRealStorage("dotProduct");
+  b.requireRealStorage("dotProduct");
+  std::vector<real> partial(REDUCTION_GROUPS);
+  const cl::CommandQueue& queue = a.getQueue();
+  kernels().dotProduct(reductionRange(queue), reductionBuffer(a), a.getDeviceData(), b.getDeviceData(), cl::Local(REDUCTION_GROUP_SIZE*sizeof(real)), a.nx, a.ny, a.ng, a.nMembers);
+  cl::copy(queue, reductionBuffer(a), partial.begin(), partial.end());
+
+  double sum = 0.0;
+  for(real p : partial) {
+    sum += p;
+  }
+  return sum;
+}
+
+void axpby(OpenCLArray& out, const OpenCLArray& x, const real a, const real b) {
+  kernels().axpby(out.interior, out.getDeviceData(), x.getDeviceData(), a, b, out.nx, out.ny, out.ng);
+}
+
 void calcDiffusionTerm(OpenCLArray& out, const OpenCLArray& f, const real dx, const real dy, const real Re) {
-  g_kernels.calcDiffusionTerm(out.interior, out.getDeviceData(), f.getDeviceData(), dx, dy, Re, out.nx, out.ny, out.ng);
+  if(g_useTiledKernels) {
+    kernels().calcDiffusionTermTiled(out.tiledInterior, out.getDeviceData(), f.getDeviceData(), dx, dy, Re, tileWithHalo(2), out.nx, out.ny, out.ng);
+  } else {
+    kernels().calcDiffusionTerm(out.interior, out.getDeviceData(), f.getDeviceData(), dx, dy, Re, out.nx, out.ny, out.ng);
+  }
 }
 
 void calcAdvectionTerm(OpenCLArray& out, const OpenCLArray& f, const OpenCLArray& vx, const OpenCLArray& vy, const real dx, const real dy) {
-  g_kernels.calcAdvectionTerm(out.interior, out.getDeviceData(), f.getDeviceData(), vx.getDeviceData(), vy.getDeviceData(), dx, dy, out.nx, out.ny, out.ng);
+  kernels().calcAdvectionTerm(out.interior, out.getDeviceData(), f.getDeviceData(), vx.getDeviceData(), vy.getDeviceData(), dx, dy, out.nx, out.ny, out.ng);
 }
 
 void advanceEuler(OpenCLArray& out, const OpenCLArray& ddt, const real dt) {
-  g_kernels.advanceEuler(out.interior, out.getDeviceData(), ddt.getDeviceData(), dt, out.nx, out.ny, out.ng);
+  kernels().advanceEuler(out.interior, out.getDeviceData(), ddt.getDeviceData(), dt, out.nx, out.ny, out.ng);
 }
 
 void applyVonNeumannBC_y(OpenCLArray& out) {
-  g_kernels.applyVonNeumannBC_y(out.lowerBound, out.getDeviceData(), out.nx, out.ny, out.ng);
+  if(out.getStorage() == Storage::Half) {
+    halfKernels().applyVonNeumannBC_y(out.lowerBound, out.getDeviceData(), out.nx, out.ny, out.ng);
+  } else {
+    kernels().applyVonNeumannBC_y(out.lowerBound, out.getDeviceData(), out.nx, out.ny, out.ng);
+  }
 }
 
 void applyVonNeumannBC_x(OpenCLArray& out) {
-  g_kernels.applyVonNeumannBC_x(out.leftBound, out.getDeviceData(), out.nx, out.ny, out.ng);
+  if(out.getStorage() == Storage::Half) {
+    halfKernels().applyVonNeumannBC_x(out.leftBound, out.getDeviceData(), out.nx, out.ny, out.ng);
+  } else {
+    kernels().applyVonNeumannBC_x(out.leftBound, out.getDeviceData(), out.nx, out.ny, out.ng);
+  }
 }
 
 void applyVonNeumannBC(OpenCLArray& out) {
@@ -40,18 +261,80 @@ void applyNoSlipBC(OpenCLArray& var) {
   var.setRightBoundary(0.0f);
 }
 
+// Half storage must be used by every array of a kernel or none
+bool isHalfTogether(const std::string& operation, std::initializer_list<const OpenCLArray*> arrays) {
+  const bool isHalf = (*arrays.begin())->getStorage() == Storage::Half;
+  for(const OpenCLArray* arr : arrays) {
+    if((arr->getStorage() == Storage::Half) != isHalf) {
+      throw std::runtime_error(operation + ": Half storage must be used by every array or none");
+    }
+  }
+  return isHalf;
+}
+
 void calcDivergence(OpenCLArray& out, OpenCLArray& fx, OpenCLArray& fy, const real dx, const real dy) {
-  g_kernels.calcDivergence(out.interior, out.getDeviceData(), fx.getDeviceData(), fy.getDeviceData(), dx, dy, out.nx, out.ny, out.ng);
+  if(isHalfTogether("calcDivergence", {&out, &fx, &fy})) {
+    halfKernels().calcDivergence(out.interior, out.getDeviceData(), fx.getDeviceData(), fy.getDeviceData(), dx, dy, out.nx, out.ny, out.ng);
+  } else if(g_useTiledKernels) {
+    kernels().calcDivergenceTiled(out.tiledInterior, out.getDeviceData(), fx.getDeviceData(), fy.getDeviceData(), dx, dy, tileWithHalo(1), tileWithHalo(1), out.nx, out.ny, out.ng);
+  } else {
+    kernels().calcDivergence(out.interior, out.getDeviceData(), fx.getDeviceData(), fy.getDeviceData(), dx, dy, out.nx, out.ny, out.ng);
+  }
 }
 
 void applyProjectionX(OpenCLArray& out, OpenCLArray& f, const real dx) {
-  g_kernels.applyProjectionX(out.interior, out.getDeviceData(), f.getDeviceData(), dx, out.nx, out.ny, out.ng);
+  if(isHalfTogether("applyProjectionX", {&out, &f})) {
+    halfKernels().applyProjectionX(out.interior, out.getDeviceData(), f.getDeviceData(), dx, out.nx, out.ny, out.ng);
+  } else if(g_useTiledKernels) {
+    kernels().applyProjectionXTiled(out.tiledInterior, out.getDeviceData(), f.getDeviceData(), dx, tileWithHalo(1), out.nx, out.ny, out.ng);
+  } else {
+    kernels().applyProjectionX(out.interior, out.getDeviceData(), f.getDeviceData(), dx, out.nx, out.ny, out.ng);
+  }
 }
 
 void applyProjectionY(OpenCLArray& out, OpenCLArray& f, const real dy) {
-  g_kernels.applyProjectionY(out.interior, out.getDeviceData(), f.getDeviceData(), dy, out.nx, out.ny, out.ng);
+  if(isHalfTogether("applyProjectionY", {&out, &f})) {
+    halfKernels().applyProjectionY(out.interior, out.getDeviceData(), f.getDeviceData(), dy, out.nx, out.ny, out.ng);
+  } else if(g_useTiledKernels) {
+    kernels().applyProjectionYTiled(out.tiledInterior, out.getDeviceData(), f.getDeviceData(), dy, tileWithHalo(1), out.nx, out.ny, out.ng);
+  } else {
+    kernels().applyProjectionY(out.interior, out.getDeviceData(), f.getDeviceData(), dy, out.nx, out.ny, out.ng);
+  }
 }
 
 void advectImplicit(OpenCLArray& out, OpenCLArray& f, OpenCLArray& vx, OpenCLArray& vy, const real dx, const real dy, const real dt) {
-  g_kernels.advect(out.interior, out.getDeviceData(), f.getDeviceData(), vx.getDeviceData(), vy.getDeviceData(), dx, dy, dt, out.nx, out.ny, out.ng);
+  vx.requireRealStorage("advectImplicit velocity");
+  vy.requireRealStorage("advectImplicit velocity");
+  if(out.getStorage() != f.getStorage()) {
+    throw std::runtime_error("advectImplicit: out and f must share a storage");
+  }
+  if(f.getStorage() == Storage::Half) {
+    halfKernels().advect(out.interior, out.getDeviceData(), f.getDeviceData(), vx.getDeviceData(), vy.getDeviceData(), dx, dy, dt, out.nx, out.ny, out.ng);
+    return;
+  }
+  kernels().advect(out.interior, out.getDeviceData(), f.getDeviceData(), vx.getDeviceData(), vy.getDeviceData(), dx, dy, dt, out.nx, out.ny, out.ng);
+}
+
+void advectVelocityImplicit(OpenCLArray& outx, OpenCLArray& outy, OpenCLArray& vx, OpenCLArray& vy, const real dx, const real dy, const real dt) {
+  if(isHalfTogether("advectVelocityImplicit", {&outx, &outy, &vx, &vy})) {
+    halfKernels().advectVelocity(outx.interior, outx.getDeviceData(), outy.getDeviceData(), vx.getDeviceData(), vy.getDeviceData(), dx, dy, dt, outx.nx, outx.ny, outx.ng);
+    return;
+  }
+  kernels().advectVelocity(outx.interior, outx.getDeviceData(), outy.getDeviceData(), vx.getDeviceData(), vy.getDeviceData(), dx, dy, dt, outx.nx, outx.ny, outx.ng);
+}
+
+void advectVelocityImplicit(OpenCLArray& outx, OpenCLArray& outy, OpenCLArray& outf, OpenCLArray& vx, OpenCLArray& vy, OpenCLArray& f, const real dx, const real dy, const real dt) {
+  kernels().advectVelocityScalar(outx.interior, outx.getDeviceData(), outy.getDeviceData(), outf.getDeviceData(), vx.getDeviceData(), vy.getDeviceData(), f.getDeviceData(), dx, dy, dt, outx.nx, outx.ny, outx.ng);
+}
+
+void advectVelocityImplicit(VectorOpenCLArray& out, VectorOpenCLArray& v, const real dx, const real dy, const real dt) {
+  kernels().advectVector(out.interior, out.getDeviceData(), v.getDeviceData(), dx, dy, dt, out.nx, out.ny, out.ng);
+}
+
+void calcDivergence(OpenCLArray& out, VectorOpenCLArray& v, const real dx, const real dy) {
+  kernels().calcDivergenceVector(out.interior, out.getDeviceData(), v.getDeviceData(), dx, dy, out.nx, out.ny, out.ng);
+}
+
+void applyProjection(VectorOpenCLArray& v, OpenCLArray& f, const real dx, const real dy) {
+  kernels().applyProjectionVector(v.interior, v.getDeviceData(), f.getDeviceData(), dx, dy, v.nx, v.ny, v.ng);
 }
@@ -0,0 +1,91 @@
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <vector_ocl_array.hpp>
+#include <kernels.hpp>
+
+VectorOpenCLArray::VectorOpenCLArray(const int nx, const int ny, const int ng, const std::string& name, const int nMembers):
+  nx{nx},
+  ny{ny},
+  ng{ng},
+  nMembers{nMembers},
+  queue(cl::CommandQueue::getDefault()),
+  interior(makeArrayRange(queue, 0, 0, nx, ny, ng, nMembers)),
+  entire(makeArrayRange(queue, -ng, -ng, nx+ng, ny+ng, ng, nMembers)),
+  name{name},
+  d_data(CL_MEM_READ_WRITE, 2*nMembers*(nx+2*ng)*(ny+2*ng)*sizeof(real))
+{
+  const std::vector<int> types(N_BOUNDARY_SIDES, static_cast<int>(BoundaryType::Dirichlet));
+  const std::vector<real> values(N_BOUNDARY_SIDES*nMembers, 0.0f);
+  for(int c=0; c<2; ++c) {
+    d_boundaryTypes[c] = cl::Buffer(CL_MEM_READ_ONLY, N_BOUNDARY_SIDES*sizeof(int));
+    d_boundaryValues[c] = cl::Buffer(CL_MEM_READ_ONLY, N_BOUNDARY_SIDES*nMembers*sizeof(real));
+    cl::copy(queue, types.begin(), types.end(), d_boundaryTypes[c]);
+    cl::copy(queue, values.begin(), values.end(), d_boundaryValues[c]);
+  }
+}
+
+void VectorOpenCLArray::requireSameShape(const OpenCLArray& arr, const std::string& operation) const {
+  if(arr.nx != nx || arr.ny != ny || arr.ng != ng || arr.nMembers != nMembers) {
+    throw std::runtime_error("Cannot " + operation + " " + name + ": Size differs from " + arr.getName());
+  }
+  arr.requireRealStorage(operation);
+}
+
+void VectorOpenCLArray::pack(const OpenCLArray& x, const OpenCLArray& y) {
+  requireSameShape(x, "pack");
+  requireSameShape(y, "pack");
+  kernels().interleave(entire, d_data, x.getDeviceData(), y.getDeviceData(), nx, ny, ng);
+}
+
+void VectorOpenCLArray::unpack(OpenCLArray& x, OpenCLArray& y) const {
+  requireSameShape(x, "unpack");
+  requireSameShape(y, "unpack");
+  kernels().deinterleave(entire, x.getDeviceData(), y.getDeviceData(), d_data, nx, ny, ng);
+}
+
+void VectorOpenCLArray::copyBoundaryConditions(const OpenCLArray& x, const OpenCLArray& y) {
+  if(x.nMembers != nMembers || y.nMembers != nMembers) {
+    throw std::runtime_error("Cannot copy boundary conditions: Number of members differs");
+  }
+  const OpenCLArray* components[2] = {&x, &y};
+  for(int c=0; c<2; ++c) {
+    queue.enqueueCopyBuffer(components[c]->getBoundaryTypes(), d_boundaryTypes[c], 0, 0, N_BOUNDARY_SIDES*sizeof(int));
+    queue.enqueueCopyBuffer(components[c]->getBoundaryValues(), d_boundaryValues[c], 0, 0, N_BOUNDARY_SIDES*nMembers*sizeof(real));
+  }
+}
+
+void VectorOpenCLArray::applyBoundaryConditions() {
+  kernels().applyBoundaryConditionsVector(cl::EnqueueArgs(queue, cl::NDRange(ghostRingSize(nx, ny, ng), 1, nMembers)),
+      d_data, d_boundaryTypes[0], d_boundaryValues[0], d_boundaryTypes[1], d_boundaryValues[1], nx, ny, ng);
+}
+
+const cl::Buffer& VectorOpenCLArray::getDeviceData() const {
+  return d_data;
+}
+
+cl::Buffer& VectorOpenCLArray::getDeviceData() {
+  return d_data;
+}
+
+const std::string& VectorOpenCLArray::getName() const {
+  return name;
+}
+
+void VectorOpenCLArray::swapData(VectorOpenCLArray& arr) {
+  if(arr.nx != nx || arr.ny != ny || arr.ng != ng || arr.nMembers != nMembers) {
+    throw std::runtime_error("Cannot swap data: Size differs");
+  }
+  std::swap(d_data, arr.d_data);
+}
+
+void VectorOpenCLArray::setQueue(const cl::CommandQueue& newQueue) {
+  queue = newQueue;
+  interior = makeArrayRange(queue, 0, 0, nx, ny, ng, nMembers);
+  entire = makeArrayRange(queue, -ng, -ng, nx+ng, ny+ng, ng, nMembers);
+}
+
+const cl::CommandQueue& VectorOpenCLArray::getQueue() const {
+  return queue;
+}
@@ -0,0 +1,217 @@
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <work_group_tuning.hpp>
+#include <ocl_array.hpp>
+#include <kernels.hpp>
+#include <opencl_backend.hpp>
+
+typedef std::array<size_t, 3> RangeSize;
+
+// Local sizes by global size, tuned on g_tunedDevice. A zero local size means
+// the driver's choice was fastest.
+cl::Device g_tunedDevice;
+std::map<RangeSize, RangeSize> g_workGroupSizes;
+
+RangeSize rangeSize(const cl::NDRange& range) {
+  return {range.get()[0], range.get()[1], range.get()[2]};
+}
+
+cl::NDRange tunedLocalRange(const cl::CommandQueue& queue, const cl::NDRange& global) {
+  if(g_workGroupSizes.empty() || global.dimensions() != 3) {
+    return cl::NullRange;
+  }
+  if(queue.getInfo<CL_QUEUE_DEVICE>()() != g_tunedDevice()) {
+    return cl::NullRange;
+  }
+  const auto it = g_workGroupSizes.find(rangeSize(global));
+  if(it == g_workGroupSizes.end() || it->second[0] == 0) {
+    return cl::NullRange;
+  }
+  return cl::NDRange(it->second[0], it->second[1], it->second[2]);
+}
+
+void clearWorkGroupSizes() {
+  g_workGroupSizes.clear();
+}
+
+// Identifies the device a tuning file was written for
+std::string deviceDescription(const cl::Device& device) {
+  return device.getInfo<CL_DEVICE_NAME>() + ", " + device.getInfo<CL_DRIVER_VERSION>();
+}
+
+// Adds the sizes in path to sizes if it was written for device. Each line
+// after the device holds a global size then its local size.
+bool readWorkGroupSizes(const std::string& path, const cl::Device& device, std::map<RangeSize, RangeSize>& sizes) {
+  std::ifstream file(path);
+  std::string line;
+  if(!std::getline(file, line) || line != "device " + deviceDescription(device)) {
+    return false;
+  }
+  RangeSize global, local;
+  while(file >> global[0] >> global[1] >> global[2] >> local[0] >> local[1] >> local[2]) {
+    sizes[global] = local;
+  }
+  return true;
+}
+
+void writeWorkGroupSizes(const std::string& path, const cl::Device& device, const std::map<RangeSize, RangeSize>& sizes) {
+  std::ofstream file(path);
+  if(!file) {
+    throw std::runtime_error("Cannot write work-group sizes to " + path);
+  }
+  file << "device " << deviceDescription(device) << "\n";
+  for(const auto& [global, local] : sizes) {
+    file << global[0] << " " << global[1] << " " << global[2] << " " << local[0] << " " << local[1] << " " << local[2] << "\n";
+  }
+}
+
+typedef std::function<cl::Event(const cl::EnqueueArgs&)> Launch;
+
+// A range of an array as made by OpenCLArray, with the kernels launched on it
+struct TuningRange {
+  int x0, y0, x1, y1;
+  std::vector<Launch> launches;
+};
+
+// The ranges of a and b, which are the same size, with the kernels that the
+// solver launches on each
+std::vector<TuningRange> arrayRanges(OpenCLArray& a, OpenCLArray& b) {
+  const Launch fill = [&a](const cl::EnqueueArgs& r) {
+    return kernels().fill(r, a.getDeviceData(), 0.0f, a.nx, a.ny, a.ng);
+  };
+  const Launch euler = [&a, &b](const cl::EnqueueArgs& r) {
+    return kernels().advanceEuler(r, a.getDeviceData(), b.getDeviceData(), 0.01f, a.nx, a.ny, a.ng);
+  };
+  const Launch diffusion = [&a, &b](const cl::EnqueueArgs& r) {
+    return kernels().calcDiffusionTerm(r, a.getDeviceData(), b.getDeviceData(), 1.0f, 1.0f, 100.0f, a.nx, a.ny, a.ng);
+  };
+  const Launch jacobi = [&a, &b](const cl::EnqueueArgs& r) {
+    return kernels().applyJacobiStep(r, a.getDeviceData(), b.getDeviceData(), -0.25f, 1.0f, 1.0f, b.getDeviceData(), a.nx, a.ny, a.ng);
+  };
+  const Launch jacobiOperator = [&a, &b](const cl::EnqueueArgs& r) {
+    return kernels().applyJacobiOperator(r, a.getDeviceData(), b.getDeviceData(), -0.25f, 1.0f, 1.0f, a.nx, a.ny, a.ng);
+  };
+  const Launch sor = [&a, &b](const cl::EnqueueArgs& r) {
+    kernels().applyRedBlackSORStep(r, a.getDeviceData(), -0.25f, 1.0f, 1.0f, b.getDeviceData(), 1.0f, 0, a.nx, a.ny, a.ng);
+    return kernels().applyRedBlackSORStep(r, a.getDeviceData(), -0.25f, 1.0f, 1.0f, b.getDeviceData(), 1.0f, 1, a.nx, a.ny, a.ng);
+  };
+  const int nx = a.nx;
+  const int ny = a.ny;
+  const int ng = a.ng;
+  return {
+    {0, 0, nx, ny, {fill, euler, diffusion, jacobi, jacobiOperator}}, // interior
+    {-1, -1, nx+1, ny+1, {fill}}, // entire
+    {0, 0, nx, (ny+1)/2, {sor}}, // redBlackInterior
+    {-ng, -1, nx+ng, 0, {fill}}, // lowerBound
+    {-ng, ny, nx+ng, ny+1, {fill}}, // upperBound
+    {-1, -ng, 0, ny+ng, {fill}}, // leftBound
+    {nx, -ng, nx+1, ny+ng, {fill}} // rightBound
+  };
+}
+
+// The driver's choice, then every local size that divides global, is flat
+// in members and has at most maxSize work items
+std::vector<cl::NDRange> candidateLocalRanges(const RangeSize& global, const size_t maxSize) {
+  std::vector<cl::NDRange> candidates{cl::NullRange};
+  for(size_t l0=1; l0<=std::min(global[0], maxSize); ++l0) {
+    for(size_t l1=1; l1<=std::min(global[1], maxSize/l0); ++l1) {
+      if(global[0]%l0 == 0 && global[1]%l1 == 0) {
+        candidates.emplace_back(l0, l1, 1);
+      }
+    }
+  }
+  return candidates;
+}
+
+// Device seconds taken by repeats launches of every kernel of range with the
+// given local size, after one untimed launch of each. Infinite if the device
+// rejects the size, e.g. for exceeding its limit along one dimension.
+double timeLaunches(const cl::CommandQueue& queue, const TuningRange& range, const int ng, const int nMembers, const cl::NDRange& local, const int repeats) {
+  const cl::EnqueueArgs args = makeArrayRange(queue, range.x0, range.y0, range.x1, range.y1, ng, nMembers, local);
+  std::vector<cl::Event> events;
+  try {
+    for(const Launch& launch : range.launches) {
+      launch(args);
+    }
+    for(int r=0; r<repeats; ++r) {
+      for(const Launch& launch : range.launches) {
+        events.push_back(launch(args));
+      }
+    }
+    queue.finish();
+  } catch(cl::Error&) {
+    queue.finish();
+    return std::numeric_limits<double>::infinity();
+  }
+
+  double seconds = 0.0;
+  for(const cl::Event& event : events) {
+    seconds += 1e-9*(event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - event.getProfilingInfo<CL_PROFILING_COMMAND_START>());
+  }
+  return seconds;
+}
+
+// Largest work group that every kernel c's solver may launch on a range of an
+// OpenCLArray accepts on device, not only the kernels timed. Arrays with half
+// storage may be made whatever c says, and FAFS_HALF_PROGRAM builds on any
+// device, but FAFS_FP64_PROGRAM is only built when the pressure is refined.
+// Each linear-system specialisation is a separate build of FAFS_PROGRAM with
+// its own limit, so c's systems are registered here, ahead of OpenCLBackend,
+// and every registered build is covered.
+size_t launchableWorkGroupSize(const cl::Device& device, const Constants& c) {
+  if(c.specialiseKernels) {
+    specialiseSolves(c);
+  }
+  size_t size = std::min(linearSystemsMaxWorkGroupSize(device), halfKernels().maxWorkGroupSize(device));
+  if(c.isPressureMixedPrecision) {
+    size = std::min(size, fp64Kernels().maxWorkGroupSize(device));
+  }
+  return size;
+}
+
+void tuneWorkGroupSizes(const std::string& path, const Constants& c, const int repeats) {
+  const cl::Device device = cl::Device::getDefault();
+  std::map<RangeSize, RangeSize> sizes;
+  readWorkGroupSizes(path, device, sizes);
+  const size_t nLoaded = sizes.size();
+
+  const size_t maxSize = launchableWorkGroupSize(device, c);
+  const cl::CommandQueue queue(cl::Context::getDefault(), device, CL_QUEUE_PROFILING_ENABLE);
+  for(const auto& [nx, ny] : {std::make_pair(c.nx, c.ny), std::make_pair(c.nx+1, c.ny+1)}) {
+    OpenCLArray a(nx, ny, c.ng, "a", 0.0f, c.nMembers);
+    OpenCLArray b(nx, ny, c.ng, "b", 1.0f, c.nMembers);
+    // Filled on the default queue
+    waitForQueues(queue, {a.getQueue()});
+
+    for(const TuningRange& range : arrayRanges(a, b)) {
+      const RangeSize global = rangeSize(layoutRange(range.x1-range.x0, range.y1-range.y0, c.nMembers));
+      if(sizes.count(global)) {
+        continue;
+      }
+      double bestSeconds = std::numeric_limits<double>::infinity();
+      for(const cl::NDRange& local : candidateLocalRanges(global, maxSize)) {
+        const double seconds = timeLaunches(queue, range, c.ng, c.nMembers, local, repeats);
+        if(seconds < bestSeconds) {
+          bestSeconds = seconds;
+          sizes[global] = rangeSize(local);
+        }
+      }
+    }
+  }
+
+  if(sizes.size() > nLoaded) {
+    writeWorkGroupSizes(path, device, sizes);
+  }
+  g_tunedDevice = device;
+  g_workGroupSizes = sizes;
+  std::cout << "Work-group sizes: " << nLoaded << " ranges loaded from " << path << ", " << sizes.size()-nLoaded << " tuned" << std::endl;
+}
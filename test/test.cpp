@@ -1,5 +1,8 @@
 #include <iostream>
 #include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
 
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/catch_approx.hpp>
@@ -9,6 +12,24 @@
 #include <kernels.hpp>
 #include <user_kernels.hpp>
 #include <hdffile.hpp>
+#include <multigrid.hpp>
+#include <cg_solver.hpp>
+#include <snapshot_writer.hpp>
+#include <time_series.hpp>
+#include <checkpoint.hpp>
+#include <refinement.hpp>
+#include <openmp_kernels.hpp>
+#include <solver.hpp>
+#include <openmp_backend.hpp>
+#include <opencl_backend.hpp>
+#include <multi_device.hpp>
+#include <work_group_tuning.hpp>
+#ifdef FAFS_USE_MPI
+#include <cstdlib>
+#include <mpi.h>
+#include <decomposition.hpp>
+#include <mpi_backend.hpp>
+#endif
 
 TEST_CASE( "Test filling array with value", "[ocl]" ) {
   const int nx = 64;
@@ -113,6 +134,73 @@ TEST_CASE( "Test applying von Neumann boundary conditions on device", "[boundary
   }
 }
 
+TEST_CASE( "Test applying boundary descriptors to several arrays", "[boundary, ocl]" ) {
+  const int nx = 6;
+  const int ny = 4;
+  const int ng = 1;
+
+  OpenCLArray dirichlet(nx, ny, ng);
+  OpenCLArray neumann(nx+1, ny+1, ng);
+  OpenCLArray periodic(nx, ny+3, ng);
+
+  for(OpenCLArray* arr : {&dirichlet, &neumann, &periodic}) {
+    for(int i=0; i<arr->nx; ++i) {
+      for(int j=0; j<arr->ny; ++j) {
+        (*arr)(i,j) = 10*i + j;
+      }
+    }
+    arr->toDevice();
+  }
+
+  dirichlet.setBoundaryCondition(BoundarySide::Lower, BoundaryType::Dirichlet, 1.0f);
+  dirichlet.setBoundaryCondition(BoundarySide::Upper, BoundaryType::Dirichlet, 2.0f);
+  dirichlet.setBoundaryCondition(BoundarySide::Left, BoundaryType::Dirichlet, 3.0f);
+  dirichlet.setBoundaryCondition(BoundarySide::Right, BoundaryType::Dirichlet, 4.0f);
+  neumann.setBoundaryConditions(BoundaryType::Neumann);
+  periodic.setBoundaryConditions(BoundaryType::Periodic);
+
+  applyBoundaryConditions(dirichlet, neumann, periodic);
+
+  dirichlet.toHost();
+  neumann.toHost();
+  periodic.toHost();
+
+  // Corners take the left/right conditions
+  for(int i=-1; i<nx+1; ++i) {
+    real lower = i < 0 ? 3.0f : i >= nx ? 4.0f : 1.0f;
+    real upper = i < 0 ? 3.0f : i >= nx ? 4.0f : 2.0f;
+    REQUIRE(dirichlet(i,-1) == lower);
+    REQUIRE(dirichlet(i,ny) == upper);
+  }
+  for(int j=0; j<ny; ++j) {
+    REQUIRE(dirichlet(-1,j) == 3.0f);
+    REQUIRE(dirichlet(nx,j) == 4.0f);
+  }
+
+  const int nnx = neumann.nx;
+  const int nny = neumann.ny;
+  for(int i=-1; i<nnx+1; ++i) {
+    int ii = std::min(std::max(i, 0), nnx-1);
+    REQUIRE(neumann(i,-1) == neumann(ii,0));
+    REQUIRE(neumann(i,nny) == neumann(ii,nny-1));
+  }
+  for(int j=0; j<nny; ++j) {
+    REQUIRE(neumann(-1,j) == neumann(0,j));
+    REQUIRE(neumann(nnx,j) == neumann(nnx-1,j));
+  }
+
+  const int pny = periodic.ny;
+  for(int i=-1; i<nx+1; ++i) {
+    int ii = (i+nx)%nx;
+    REQUIRE(periodic(i,-1) == periodic(ii,pny-1));
+    REQUIRE(periodic(i,pny) == periodic(ii,0));
+  }
+  for(int j=0; j<pny; ++j) {
+    REQUIRE(periodic(-1,j) == periodic(nx-1,j));
+    REQUIRE(periodic(nx,j) == periodic(0,j));
+  }
+}
+
 TEST_CASE( "Test Euler method", "[ocl]" ) {
   const int nx = 16;
   const int ny = 16;
@@ -189,6 +277,57 @@ TEST_CASE( "Test calculating advection term", "[ocl]") {
   }
 }
 
+TEST_CASE( "Test fused advection matches per-field advection", "[ocl]") {
+  const int nx = 16;
+  const int ny = 16;
+  const int ng = 1;
+
+  const real dx = 1.0f/nx;
+  const real dy = 1.0f/ny;
+  const real dt = 0.05f;
+
+  OpenCLArray vx(nx, ny, ng);
+  OpenCLArray vy(nx, ny, ng);
+  OpenCLArray f(nx, ny, ng);
+
+  for(int i=-ng; i<nx+ng; ++i) {
+    for(int j=-ng; j<ny+ng; ++j) {
+      real x = (i+0.5f)*dx;
+      real y = (j+0.5f)*dy;
+      vx(i,j) = sin(M_PI*x)*cos(M_PI*y);
+      vy(i,j) = -cos(M_PI*x)*sin(M_PI*y);
+      f(i,j) = x*x + y;
+    }
+  }
+  vx.toDevice();
+  vy.toDevice();
+  f.toDevice();
+
+  OpenCLArray outx(nx, ny, ng), outy(nx, ny, ng), outf(nx, ny, ng);
+  OpenCLArray fusedx(nx, ny, ng), fusedy(nx, ny, ng), fusedf(nx, ny, ng);
+
+  advectImplicit(outx, vx, vx, vy, dx, dy, dt);
+  advectImplicit(outy, vy, vx, vy, dx, dy, dt);
+  advectImplicit(outf, f, vx, vy, dx, dy, dt);
+  advectVelocityImplicit(fusedx, fusedy, fusedf, vx, vy, f, dx, dy, dt);
+  OpenCLArray pairx(nx, ny, ng), pairy(nx, ny, ng);
+  advectVelocityImplicit(pairx, pairy, vx, vy, dx, dy, dt);
+
+  for(OpenCLArray* arr : {&outx, &outy, &outf, &fusedx, &fusedy, &fusedf, &pairx, &pairy}) {
+    arr->toHost();
+  }
+
+  for(int i=0; i<nx; ++i) {
+    for(int j=0; j<ny; ++j) {
+      REQUIRE(fusedx(i,j) == Catch::Approx(outx(i,j)));
+      REQUIRE(fusedy(i,j) == Catch::Approx(outy(i,j)));
+      REQUIRE(fusedf(i,j) == Catch::Approx(outf(i,j)));
+      REQUIRE(pairx(i,j) == Catch::Approx(outx(i,j)));
+      REQUIRE(pairy(i,j) == Catch::Approx(outy(i,j)));
+    }
+  }
+}
+
 TEST_CASE( "Test Jacobi iteration on Poisson eqn", "[ocl]") {
   const int nx = 32;
   const int ny = nx;
@@ -224,7 +363,7 @@ TEST_CASE( "Test Jacobi iteration on Poisson eqn", "[ocl]") {
 
   for(int i=0; i<100; ++i) {
     applyVonNeumannBC(temp1);
-    g_kernels.applyJacobiStep(temp2.interior, temp2.getDeviceData(), temp1.getDeviceData(), alpha, beta, gamma, b.getDeviceData(), temp2.nx, temp2.ny, temp2.ng);
+    kernels().applyJacobiStep(temp2.interior, temp2.getDeviceData(), temp1.getDeviceData(), alpha, beta, gamma, b.getDeviceData(), temp2.nx, temp2.ny, temp2.ng);
     temp1.swapData(temp2);
   }
 
@@ -244,6 +383,581 @@ TEST_CASE( "Test Jacobi iteration on Poisson eqn", "[ocl]") {
   }
 }
 
+TEST_CASE( "Test multigrid solve of Poisson eqn", "[ocl]") {
+  // Odd size to exercise coarsening onto grids which don't halve exactly
+  const int nx = 65;
+  const int ny = nx;
+  const int ng = 1;
+
+  const real dx = 1.0f/nx;
+  const real dy = 1.0f/ny;
+
+  OpenCLArray result(nx, ny, ng);
+  OpenCLArray b(nx, ny, ng);
+
+  for(int i=0; i<b.nx; ++i) {
+    for(int j=0; j<b.ny; ++j) {
+      real x = (i+0.5f)*dx;
+      real y = (j+0.5f)*dy;
+      b(i,j) = cos(M_PI*x)*cos(2.0f*M_PI*y);
+    }
+  }
+
+  b.toDevice();
+  result.fill(0.0f, true);
+
+  MultigridSolver solver(nx, ny, ng, dx, dy);
+  REQUIRE(solver.nLevels() > 1);
+  solver.solve(result, b, 10);
+
+  result.toHost();
+
+  for(int i=0; i<nx; ++i) {
+    for(int j=0; j<ny; ++j) {
+      real lap = (result(i+1,j) + result(i-1,j) - 2.0f*result(i,j))/(dx*dx)
+               + (result(i,j+1) + result(i,j-1) - 2.0f*result(i,j))/(dy*dy);
+      REQUIRE(lap == Catch::Approx(b(i,j)).margin(0.001));
+    }
+  }
+}
+
+TEST_CASE( "Test red-black SOR on Poisson eqn", "[ocl]") {
+  const int nx = 16;
+  const int ny = nx;
+  const int ng = 1;
+
+  const real dx = 1.0f/nx;
+  const real dy = 1.0f/ny;
+
+  OpenCLArray result(nx, ny, ng);
+  OpenCLArray b(nx, ny, ng);
+
+  for(int i=0; i<b.nx; ++i) {
+    for(int j=0; j<b.ny; ++j) {
+      real x = (i+0.5f)*dx;
+      real y = (j+0.5f)*dy;
+      b(i,j) = cos(M_PI*x)*cos(2.0f*M_PI*y) + 10.0f*(x-0.5f)*(y-0.5f)*(y-0.5f);
+    }
+  }
+
+  b.toDevice();
+  result.fill(0.0f, true);
+
+  real alpha = -0.5f*(dx*dx*dy*dy)/(dx*dx + dy*dy);
+  real beta = dx*dx;
+  real gamma = dy*dy;
+
+  // Updates in place, no scratch array
+  runSORIteration(result, alpha, beta, gamma, b, 1.7f, 300, applyVonNeumannBC);
+
+  applyVonNeumannBC(result);
+  result.toHost();
+
+  for(int i=0; i<nx; ++i) {
+    for(int j=0; j<ny; ++j) {
+      real lap = (result(i+1,j) + result(i-1,j) - 2.0f*result(i,j))/(dx*dx)
+               + (result(i,j+1) + result(i,j-1) - 2.0f*result(i,j))/(dy*dy);
+      REQUIRE(lap == Catch::Approx(b(i,j)).margin(0.001));
+    }
+  }
+}
+
+TEST_CASE( "Test residual controlled SOR solve", "[ocl]") {
+  const int nx = 32;
+  const int ny = nx;
+  const int ng = 1;
+
+  const real dx = 1.0f/nx;
+  const real dy = 1.0f/ny;
+
+  OpenCLArray result(nx, ny, ng);
+  OpenCLArray b(nx, ny, ng);
+
+  for(int i=0; i<b.nx; ++i) {
+    for(int j=0; j<b.ny; ++j) {
+      real x = (i+0.5f)*dx;
+      real y = (j+0.5f)*dy;
+      b(i,j) = cos(M_PI*x)*cos(2.0f*M_PI*y) + 10.0f*(x-0.5f)*(y-0.5f)*(y-0.5f);
+    }
+  }
+
+  b.toDevice();
+  result.fill(0.0f, true);
+
+  real alpha = -0.5f*(dx*dx*dy*dy)/(dx*dx + dy*dy);
+  real beta = dx*dx;
+  real gamma = dy*dy;
+
+  // Residual of the zero initial guess is just b
+  ResidualNorms initial = calcJacobiResidualNorms(result, alpha, beta, gamma, b);
+  real bSqr = 0.0f;
+  real bMax = 0.0f;
+  for(int i=0; i<nx; ++i) {
+    for(int j=0; j<ny; ++j) {
+      bSqr += b(i,j)*b(i,j);
+      bMax = std::max(bMax, std::abs(b(i,j)));
+    }
+  }
+  REQUIRE(initial.l2 == Catch::Approx(std::sqrt(bSqr)));
+  REQUIRE(initial.max == Catch::Approx(bMax));
+
+  SolverControl control(10000, 10, 1e-4f);
+  SolverStats stats = runSORIteration(result, alpha, beta, gamma, b, 1.8f, control, applyVonNeumannBC);
+
+  // Stops on tolerance, at a multiple of the check interval
+  REQUIRE(stats.iterations < control.maxIterations);
+  REQUIRE(stats.iterations % control.checkInterval == 0);
+  REQUIRE(stats.residual.l2 <= control.relTolerance*initial.l2);
+
+  applyVonNeumannBC(result);
+  REQUIRE(calcJacobiResidualNorms(result, alpha, beta, gamma, b).l2 == Catch::Approx(stats.residual.l2));
+}
+
+TEST_CASE( "Test device dot product", "[ocl]") {
+  const int nx = 100;
+  const int ny = 37;
+  const int ng = 1;
+
+  OpenCLArray a(nx, ny, ng);
+  OpenCLArray b(nx, ny, ng);
+
+  a.fill(2.0f);
+  b.fill(3.0f);
+  // Ghost cells must not contribute
+  a.setUpperBoundary(100.0f);
+
+  REQUIRE(dotProduct(a, b) == Catch::Approx(6.0f*nx*ny));
+
+  // Scratch is remade for each queue, so reductions stay correct after the
+  // queues they ran on are released
+  for(int k=0; k<3; ++k) {
+    cl::CommandQueue queue(cl::Context::getDefault(), cl::Device::getDefault());
+    a.setQueue(queue);
+    b.setQueue(queue);
+    REQUIRE(dotProduct(a, b) == Catch::Approx(6.0f*nx*ny));
+    REQUIRE(calcNorms(b).max == Catch::Approx(3.0f));
+  }
+}
+
+TEST_CASE( "Test conjugate gradient solve of Poisson eqn", "[ocl]") {
+  const int nx = 64;
+  const int ny = nx;
+  const int ng = 1;
+
+  const real dx = 1.0f/nx;
+  const real dy = 1.0f/ny;
+
+  OpenCLArray result(nx, ny, ng);
+  OpenCLArray b(nx, ny, ng);
+
+  for(int i=0; i<b.nx; ++i) {
+    for(int j=0; j<b.ny; ++j) {
+      real x = (i+0.5f)*dx;
+      real y = (j+0.5f)*dy;
+      // Not a single eigenvector of the discrete Laplacian
+      b(i,j) = cos(M_PI*x)*cos(2.0f*M_PI*y) + 10.0f*(x-0.5f)*(y-0.5f)*(y-0.5f);
+    }
+  }
+
+  b.toDevice();
+  result.fill(0.0f, true);
+
+  real alpha = -0.5f*(dx*dx*dy*dy)/(dx*dx + dy*dy);
+  real beta = dx*dx;
+  real gamma = dy*dy;
+
+  CGSolver solver(nx, ny, ng);
+  SolverStats stats = solver.solve(result, makeJacobiOperator(alpha, beta, gamma, applyVonNeumannBC), b, SolverControl(1000, 1, 1e-5f));
+  // Jacobi would need O(nx^2) iterations
+  REQUIRE(stats.iterations < 4*nx);
+
+  applyVonNeumannBC(result);
+  result.toHost();
+
+  for(int i=0; i<nx; ++i) {
+    for(int j=0; j<ny; ++j) {
+      real lap = (result(i+1,j) + result(i-1,j) - 2.0f*result(i,j))/(dx*dx)
+               + (result(i,j+1) + result(i,j-1) - 2.0f*result(i,j))/(dy*dy);
+      REQUIRE(lap == Catch::Approx(b(i,j)).margin(0.001));
+    }
+  }
+}
+
+TEST_CASE( "Test tiled kernels match untiled kernels", "[ocl]") {
+  // Not a multiple of TILE_SIZE, so some work groups hang off the interior
+  const int nx = 37;
+  const int ny = 21;
+  const int ng = 1;
+
+  const real dx = 1.0f/nx;
+  const real dy = 1.0f/ny;
+
+  OpenCLArray vx(nx, ny, ng);
+  OpenCLArray vy(nx, ny, ng);
+  OpenCLArray p(nx+1, ny+1, ng);
+
+  for(int i=-ng; i<nx+1+ng; ++i) {
+    for(int j=-ng; j<ny+1+ng; ++j) {
+      real x = (i+0.5f)*dx;
+      real y = (j+0.5f)*dy;
+      p(i,j) = sin(3.0f*x)*cos(2.0f*y) + x*y;
+      if(i < nx+ng && j < ny+ng) {
+        vx(i,j) = cos(2.0f*M_PI*x)*y;
+        vy(i,j) = sin(M_PI*y) + x*x;
+      }
+    }
+  }
+  vx.toDevice();
+  vy.toDevice();
+  p.toDevice();
+
+  OpenCLArray diffusion(nx, ny, ng), diffusionTiled(nx, ny, ng);
+  OpenCLArray jacobi(nx, ny, ng), jacobiTiled(nx, ny, ng);
+  OpenCLArray div(nx+1, ny+1, ng), divTiled(nx+1, ny+1, ng);
+  OpenCLArray projX(nx, ny, ng), projXTiled(nx, ny, ng);
+  OpenCLArray projY(nx, ny, ng), projYTiled(nx, ny, ng);
+  // Projection updates in place
+  for(OpenCLArray* arr : {&projX, &projXTiled, &projY, &projYTiled}) {
+    arr->fill(1.0f, true);
+  }
+
+  for(bool tiled : {false, true}) {
+    setUseTiledKernels(tiled);
+    calcDiffusionTerm(tiled ? diffusionTiled : diffusion, vx, dx, dy, 100.0f);
+    applyJacobiStep(tiled ? jacobiTiled : jacobi, vx, -0.25f, 1.0f, 2.0f, vy);
+    calcDivergence(tiled ? divTiled : div, vx, vy, dx, dy);
+    applyProjectionX(tiled ? projXTiled : projX, p, dx);
+    applyProjectionY(tiled ? projYTiled : projY, p, dy);
+  }
+  setUseTiledKernels(false);
+
+  for(OpenCLArray* arr : {&diffusion, &diffusionTiled, &jacobi, &jacobiTiled, &div, &divTiled, &projX, &projXTiled, &projY, &projYTiled}) {
+    arr->toHost();
+  }
+
+  for(int i=0; i<nx; ++i) {
+    for(int j=0; j<ny; ++j) {
+      REQUIRE(diffusionTiled(i,j) == Catch::Approx(diffusion(i,j)));
+      REQUIRE(jacobiTiled(i,j) == Catch::Approx(jacobi(i,j)));
+      REQUIRE(projXTiled(i,j) == Catch::Approx(projX(i,j)));
+      REQUIRE(projYTiled(i,j) == Catch::Approx(projY(i,j)));
+    }
+  }
+  for(int i=0; i<nx+1; ++i) {
+    for(int j=0; j<ny+1; ++j) {
+      REQUIRE(divTiled(i,j) == Catch::Approx(div(i,j)));
+    }
+  }
+}
+
+TEST_CASE( "Test temporally blocked Jacobi matches single sweeps", "[ocl]") {
+  const int nx = 37;
+  const int ny = 21;
+  const int ng = 1;
+  const int sweeps = 8;
+
+  const real dx = 1.0f/nx;
+  const real dy = 1.0f/ny;
+
+  OpenCLArray reference(nx, ny, ng);
+  OpenCLArray blocked(nx, ny, ng);
+  OpenCLArray temp(nx, ny, ng);
+  OpenCLArray b(nx, ny, ng);
+
+  for(int i=0; i<nx; ++i) {
+    for(int j=0; j<ny; ++j) {
+      real x = (i+0.5f)*dx;
+      real y = (j+0.5f)*dy;
+      b(i,j) = cos(M_PI*x)*cos(2.0f*M_PI*y);
+      reference(i,j) = x*y*y;
+      blocked(i,j) = x*y*y;
+    }
+  }
+  b.toDevice();
+  reference.toDevice();
+  blocked.toDevice();
+
+  real alpha = -0.5f*(dx*dx*dy*dy)/(dx*dx + dy*dy);
+  real beta = dx*dx;
+  real gamma = dy*dy;
+
+  for(int n=0; n<sweeps; ++n) {
+    applyVonNeumannBC(reference);
+    applyJacobiStep(temp, reference, alpha, beta, gamma, b);
+    reference.swapData(temp);
+  }
+
+  for(int n=0; n<sweeps; n+=4) {
+    applyJacobiSweeps(temp, blocked, alpha, beta, gamma, b, 4);
+    blocked.swapData(temp);
+  }
+
+  reference.toHost();
+  blocked.toHost();
+
+  for(int i=0; i<nx; ++i) {
+    for(int j=0; j<ny; ++j) {
+      REQUIRE(blocked(i,j) == Catch::Approx(reference(i,j)));
+    }
+  }
+}
+
+TEST_CASE( "Test kernels specialised for a system match generic kernels", "[ocl]") {
+  const int nx = 29;
+  const int ny = 23;
+  const int ng = 1;
+  const LinearSystem system{nx, ny, ng, -0.3f, 1.5f, 2.5f};
+
+  OpenCLArray in(nx, ny, ng);
+  OpenCLArray b(nx, ny, ng);
+  OpenCLArray sor(nx, ny, ng), sorSpecialised(nx, ny, ng);
+  for(int i=-ng; i<nx+ng; ++i) {
+    for(int j=-ng; j<ny+ng; ++j) {
+      real x = (i+0.5f)/nx;
+      real y = (j+0.5f)/ny;
+      in(i,j) = sin(3.0f*x)*cos(2.0f*y) + x*y;
+      b(i,j) = cos(M_PI*x)*y;
+      sor(i,j) = in(i,j);
+      sorSpecialised(i,j) = in(i,j);
+    }
+  }
+  for(OpenCLArray* arr : {&in, &b, &sor, &sorSpecialised}) {
+    arr->toDevice();
+  }
+
+  OpenCLArray jacobi(nx, ny, ng), jacobiSpecialised(nx, ny, ng);
+  OpenCLArray op(nx, ny, ng), opSpecialised(nx, ny, ng);
+  OpenCLArray sweeps(nx, ny, ng), sweepsSpecialised(nx, ny, ng);
+  ResidualNorms norms[2];
+
+  // Registering a system applies to every later launch on it
+  REQUIRE(&linearSystemKernels(system) == &kernels());
+  for(bool specialised : {false, true}) {
+    if(specialised) {
+      specialiseLinearSystem(system);
+    }
+    applyJacobiStep(specialised ? jacobiSpecialised : jacobi, in, system.alpha, system.beta, system.gamma, b);
+    applyJacobiOperator(specialised ? opSpecialised : op, in, system.alpha, system.beta, system.gamma);
+    applyJacobiSweeps(specialised ? sweepsSpecialised : sweeps, in, system.alpha, system.beta, system.gamma, b, 3);
+    runSORIteration(specialised ? sorSpecialised : sor, system.alpha, system.beta, system.gamma, b, 1.5f, 2);
+    norms[specialised] = calcJacobiResidualNorms(in, system.alpha, system.beta, system.gamma, b);
+  }
+  REQUIRE(&linearSystemKernels(system) != &kernels());
+  REQUIRE(&linearSystemKernels({nx+1, ny, ng, system.alpha, system.beta, system.gamma}) == &kernels());
+  REQUIRE(&linearSystemKernels({nx, ny, ng, system.alpha, system.beta, 2.0f}) == &kernels());
+  // Later tests launch on the same system with the generic kernels
+  clearLinearSystemSpecialisations();
+  REQUIRE(&linearSystemKernels(system) == &kernels());
+
+  for(OpenCLArray* arr : {&jacobi, &jacobiSpecialised, &op, &opSpecialised, &sweeps, &sweepsSpecialised, &sor, &sorSpecialised}) {
+    arr->toHost();
+  }
+  for(int i=0; i<nx; ++i) {
+    for(int j=0; j<ny; ++j) {
+      REQUIRE(jacobiSpecialised(i,j) == Catch::Approx(jacobi(i,j)));
+      REQUIRE(opSpecialised(i,j) == Catch::Approx(op(i,j)));
+      REQUIRE(sweepsSpecialised(i,j) == Catch::Approx(sweeps(i,j)));
+      REQUIRE(sorSpecialised(i,j) == Catch::Approx(sor(i,j)));
+    }
+  }
+  REQUIRE(norms[1].l2 == Catch::Approx(norms[0].l2));
+  REQUIRE(norms[1].max == Catch::Approx(norms[0].max));
+}
+
+TEST_CASE( "Test solves on separate queues", "[ocl]") {
+  const int nx = 32;
+  const int ny = nx;
+  const int ng = 1;
+
+  const real dx = 1.0f/nx;
+  const real dy = 1.0f/ny;
+
+  cl::CommandQueue queue(cl::Context::getDefault(), cl::Device::getDefault());
+
+  OpenCLArray b(nx, ny, ng);
+  for(int i=0; i<nx; ++i) {
+    for(int j=0; j<ny; ++j) {
+      b(i,j) = cos(M_PI*(i+0.5f)*dx)*cos(2.0f*M_PI*(j+0.5f)*dy);
+    }
+  }
+  b.toDevice();
+
+  OpenCLArray onDefault(nx, ny, ng);
+  OpenCLArray onQueue(nx, ny, ng);
+  onQueue.setQueue(queue);
+  // b was written on the default queue
+  waitForQueues(queue, {cl::CommandQueue::getDefault()});
+
+  real alpha = -0.5f*(dx*dx*dy*dy)/(dx*dx + dy*dy);
+  real beta = dx*dx;
+  real gamma = dy*dy;
+
+  std::vector<SolverStats> stats = iterateTogetherUntilConverged(SolverControl(200, 10, 1e-3f),
+    [&](const int k, const int n) {
+      runSORIteration(k == 0 ? onDefault : onQueue, alpha, beta, gamma, b, 1.5f, n, applyVonNeumannBC);
+    },
+    [&]() {
+      std::vector<PendingNorms> pending;
+      pending.push_back(enqueueJacobiResidualNorms(onDefault, alpha, beta, gamma, b));
+      pending.push_back(enqueueJacobiResidualNorms(onQueue, alpha, beta, gamma, b));
+      return std::vector<ResidualNorms>{pending[0].get(), pending[1].get()};
+    });
+
+  REQUIRE(stats[0].iterations == stats[1].iterations);
+  REQUIRE(stats[1].residual.l2 == Catch::Approx(stats[0].residual.l2));
+
+  onDefault.toHost();
+  onQueue.toHost();
+  for(int i=0; i<nx; ++i) {
+    for(int j=0; j<ny; ++j) {
+      REQUIRE(onQueue(i,j) == Catch::Approx(onDefault(i,j)));
+    }
+  }
+}
+
+TEST_CASE( "Test Jacobi split into slabs matches the whole grid", "[ocl]") {
+  // Uneven slabs on separate queues of one device take the same halo copies
+  // and events as slabs on separate devices
+  const int nx = 23;
+  const int ny = 19;
+  const int ng = 1;
+  const int sweeps = 30;
+
+  const real dx = 1.0f/nx;
+  const real dy = 1.0f/ny;
+
+  OpenCLArray reference(nx, ny, ng);
+  OpenCLArray split(nx, ny, ng);
+  OpenCLArray temp(nx, ny, ng);
+  OpenCLArray b(nx, ny, ng);
+
+  for(int i=0; i<nx; ++i) {
+    for(int j=0; j<ny; ++j) {
+      real x = (i+0.5f)*dx;
+      real y = (j+0.5f)*dy;
+      b(i,j) = cos(M_PI*x)*cos(2.0f*M_PI*y);
+      reference(i,j) = x*y*y;
+      split(i,j) = x*y*y;
+    }
+  }
+  b.toDevice();
+  reference.toDevice();
+  split.toDevice();
+
+  real alpha = -0.5f*(dx*dx*dy*dy)/(dx*dx + dy*dy);
+  real beta = dx*dx;
+  real gamma = dy*dy;
+
+  for(int n=0; n<sweeps; ++n) {
+    applyVonNeumannBC(reference);
+    applyJacobiStep(temp, reference, alpha, beta, gamma, b);
+    reference.swapData(temp);
+  }
+  applyVonNeumannBC(reference);
+
+  const std::vector<cl::Device> devices(3, cl::Device::getDefault());
+  MultiDeviceJacobiSolver solver(devices, nx, ny, ng);
+  REQUIRE(solver.nSlabs() == 3);
+  const SolverStats stats = solver.solve(split, alpha, beta, gamma, b, SolverControl(sweeps, sweeps, 0.0f));
+  REQUIRE(stats.iterations == sweeps);
+  REQUIRE(stats.residual.l2 == Catch::Approx(calcJacobiResidualNorms(reference, alpha, beta, gamma, b).l2));
+
+  reference.toHost();
+  split.toHost();
+  for(int i=0; i<nx; ++i) {
+    for(int j=0; j<ny; ++j) {
+      REQUIRE(split(i,j) == Catch::Approx(reference(i,j)));
+    }
+  }
+}
+
+TEST_CASE( "Test program binaries are cached on disk", "[ocl]") {
+  const std::string directory = "test_kernel_cache";
+  std::filesystem::remove_all(directory);
+  setProgramCacheDirectory(directory);
+  auto cacheFiles = [&]() {
+    std::vector<std::filesystem::path> files;
+    for(const auto& entry : std::filesystem::directory_iterator(directory)) {
+      files.push_back(entry.path());
+    }
+    return files;
+  };
+  auto runTwice = [](const cl::Program& program) {
+    std::vector<float> x{1.0f, 2.0f, 3.0f};
+    cl::Buffer buffer(x.begin(), x.end(), false);
+    cl::KernelFunctor<cl::Buffer> twice(program, "twice");
+    twice(cl::EnqueueArgs(cl::NDRange(x.size())), buffer);
+    cl::copy(buffer, x.begin(), x.end());
+    return x;
+  };
+
+  const std::string source = "__kernel void twice(__global float *x) { x[get_global_id(0)] *= 2.0f; }";
+  buildProgramFromString(source);
+  REQUIRE(cacheFiles().size() == 1);
+
+  // Loaded from the cache
+  REQUIRE(runTwice(buildProgramFromString(source))[2] == 6.0f);
+  REQUIRE(cacheFiles().size() == 1);
+
+  // Different options make a different program
+  buildProgramFromString(source, "-DUNUSED");
+  REQUIRE(cacheFiles().size() == 2);
+
+  // Unreadable binaries are rebuilt from source and replaced
+  for(const std::filesystem::path& path : cacheFiles()) {
+    std::ofstream file(path, std::ios::binary);
+    file << "not a program";
+  }
+  REQUIRE(runTwice(buildProgramFromString(source))[2] == 6.0f);
+  REQUIRE(cacheFiles().size() == 2);
+
+  setProgramCacheDirectory("kernel_cache");
+  std::filesystem::remove_all(directory);
+}
+
+TEST_CASE( "Test tuned work-group sizes are saved and reloaded", "[ocl]") {
+  Constants c;
+  c.nx = 24;
+  c.ny = 20;
+  const std::string path = "test_work_groups.txt";
+  std::filesystem::remove(path);
+
+  tuneWorkGroupSizes(path, c, 2);
+  REQUIRE(std::filesystem::exists(path));
+  const cl::CommandQueue queue = cl::CommandQueue::getDefault();
+  const cl::NDRange global = layoutRange(c.nx, c.ny, c.nMembers);
+  const cl::NDRange local = tunedLocalRange(queue, global);
+  for(size_t k=0; k<local.dimensions(); ++k) {
+    REQUIRE(global.get()[k] % local.get()[k] == 0);
+  }
+
+  // Loading covers every range, so nothing is tuned or rewritten
+  const auto written = std::filesystem::last_write_time(path);
+  clearWorkGroupSizes();
+  REQUIRE(tunedLocalRange(queue, global).dimensions() == 0);
+  tuneWorkGroupSizes(path, c, 2);
+  REQUIRE(std::filesystem::last_write_time(path) == written);
+  const cl::NDRange reloaded = tunedLocalRange(queue, global);
+  REQUIRE(reloaded.dimensions() == local.dimensions());
+  for(size_t k=0; k<local.dimensions(); ++k) {
+    REQUIRE(reloaded.get()[k] == local.get()[k]);
+  }
+
+  // Arrays made now launch on the tuned ranges
+  OpenCLArray a(c.nx, c.ny, c.ng);
+  a.fill(2.0f, true);
+  a.setUpperBoundary(3.0f);
+  a.toHost();
+  for(int i=-c.ng; i<c.nx+c.ng; ++i) {
+    for(int j=-c.ng; j<c.ny+c.ng; ++j) {
+      REQUIRE(a(i,j) == (j == c.ny ? 3.0f : 2.0f));
+    }
+  }
+
+  clearWorkGroupSizes();
+  std::filesystem::remove(path);
+}
+
 TEST_CASE( "Test saving OpenCLArray", "[ocl]") {
   const int nx = 64;
   const int ny = 64;
@@ -275,3 +989,716 @@ TEST_CASE( "Test saving OpenCLArray", "[ocl]") {
     }
   }
 }
+
+TEST_CASE( "Test array layout agrees on host, device and file", "[ocl]") {
+  const int nx = 12;
+  const int ny = 7;
+  const int ng = 1;
+
+  OpenCLArray a(nx, ny, ng, "a");
+  for(int i=-ng; i<nx+ng; ++i) {
+    for(int j=-ng; j<ny+ng; ++j) {
+      a(i,j) = i + 100.0f*j;
+    }
+  }
+  a.toDevice();
+  REQUIRE(a.strideI()*a.strideJ() == a.rowStride);
+  REQUIRE(std::min(a.strideI(), a.strideJ()) == 1);
+
+  // A device kernel must see the cells the host wrote
+  OpenCLArray b(nx, ny, ng, "b");
+  advanceEuler(b, a, 1.0f);
+  b.toHost();
+  for(int i=0; i<nx; ++i) {
+    for(int j=0; j<ny; ++j) {
+      REQUIRE(b(i,j) == a(i,j));
+    }
+  }
+
+  // Files are written in memory order
+  HDFFile file("layout.hdf5", false);
+  a.saveTo(file.file);
+  file.close();
+  file.open("layout.hdf5");
+  H5::DataSet ds = file.file.openDataSet("a");
+  hsize_t dims[2];
+  ds.getSpace().getSimpleExtentDims(dims);
+  REQUIRE(dims[0] == hsize_t(a.rows()));
+  REQUIRE(dims[1] == hsize_t(a.rowLength()));
+  std::vector<real> raw(dims[0]*dims[1]);
+  ds.read(raw.data(), a.getH5Type());
+  file.close();
+  for(int i=-ng; i<nx+ng; ++i) {
+    for(int j=-ng; j<ny+ng; ++j) {
+      REQUIRE(raw[a.idx(i,j)] == a(i,j));
+    }
+  }
+}
+
+TEST_CASE( "Test asynchronous snapshot writer", "[ocl]") {
+  const int nx = 12;
+  const int ny = 7;
+  const int ng = 1;
+
+  OpenCLArray a(nx, ny, ng, "a");
+  OpenCLArray b(nx+1, ny+1, ng, "b");
+  for(int i=0; i<nx; ++i) {
+    for(int j=0; j<ny; ++j) {
+      a(i,j) = i + 2.0f*j;
+      b(i,j) = 3.0f*i - j;
+    }
+  }
+  a.toDevice();
+  b.toDevice();
+
+  {
+    SnapshotWriter writer(1);
+    // The second write has to wait for the first to finish
+    writer.write("snapshot1.hdf5", {&a, &b});
+    a.fill(-1.0f);
+    writer.write("snapshot2.hdf5", {&a});
+    writer.flush();
+  }
+
+  OpenCLArray aIn(nx, ny, ng, "a");
+  OpenCLArray bIn(nx+1, ny+1, ng, "b");
+  HDFFile file("snapshot1.hdf5");
+  aIn.load(file.file);
+  bIn.load(file.file);
+  file.close();
+
+  for(int i=0; i<nx; ++i) {
+    for(int j=0; j<ny; ++j) {
+      REQUIRE(aIn(i,j) == i + 2.0f*j);
+      REQUIRE(bIn(i,j) == 3.0f*i - j);
+    }
+  }
+
+  file.open("snapshot2.hdf5");
+  aIn.load(file.file);
+  file.close();
+  REQUIRE(aIn(0,0) == -1.0f);
+}
+
+TEST_CASE( "Test time series output", "[ocl]") {
+  const int nx = 9;
+  const int ny = 6;
+  const int ng = 1;
+  const int nFrames = 3;
+
+  OpenCLArray a(nx, ny, ng, "a");
+  {
+    TimeSeriesWriter series("series.hdf5", FileMode::Truncate);
+    SnapshotWriter writer;
+    for(int n=0; n<nFrames-1; ++n) {
+      for(int i=0; i<nx; ++i) {
+        for(int j=0; j<ny; ++j) {
+          a(i,j) = i + 2.0f*j + 100.0f*n;
+        }
+      }
+      a.toDevice();
+      writer.append(series, 0.5f*n, 10*n, {&a});
+      writer.flush();
+    }
+  }
+  {
+    // Reopening appends
+    TimeSeriesWriter series("series.hdf5");
+    REQUIRE(series.nFrames() == nFrames-1);
+    // append saves the host data
+    a.fill(-1.0f);
+    a.toHost();
+    series.append(0.5f*(nFrames-1), 10*(nFrames-1), {&a});
+    REQUIRE(series.nFrames() == nFrames);
+  }
+
+  HDFFile file("series.hdf5");
+  H5::DataSet ds = file.file.openDataSet("a");
+  H5::DataSpace filespace = ds.getSpace();
+  REQUIRE(filespace.getSimpleExtentNdims() == 3);
+  hsize_t dims[3];
+  filespace.getSimpleExtentDims(dims);
+  REQUIRE(dims[0] == nFrames);
+  REQUIRE(dims[1] == (I_CONTIGUOUS ? ny : nx) + 2*ng);
+  REQUIRE(dims[2] == (I_CONTIGUOUS ? nx : ny) + 2*ng);
+
+  H5::DSetCreatPropList props = ds.getCreatePlist();
+  REQUIRE(props.getLayout() == H5D_CHUNKED);
+  REQUIRE(props.getNfilters() == 2);
+
+  std::vector<double> times(nFrames);
+  std::vector<int> steps(nFrames);
+  file.file.openDataSet("time").read(times.data(), H5::PredType::NATIVE_DOUBLE);
+  file.file.openDataSet("step").read(steps.data(), H5::PredType::NATIVE_INT);
+
+  OpenCLArray aIn(nx, ny, ng, "a");
+  for(int n=0; n<nFrames; ++n) {
+    REQUIRE(times[n] == Catch::Approx(0.5*n));
+    REQUIRE(steps[n] == 10*n);
+
+    hsize_t start[3] = {hsize_t(n), 0, 0};
+    hsize_t count[3] = {1, dims[1], dims[2]};
+    filespace.selectHyperslab(H5S_SELECT_SET, count, start);
+    H5::DataSpace memspace(3, count);
+    std::vector<real> frame(aIn.size());
+    ds.read(frame.data(), aIn.getH5Type(), memspace, filespace);
+    for(int i=0; i<nx; ++i) {
+      for(int j=0; j<ny; ++j) {
+        const real expected = n < nFrames-1 ? i + 2.0f*j + 100.0f*n : -1.0f;
+        REQUIRE(frame[aIn.idx(i,j)] == expected);
+      }
+    }
+  }
+  file.close();
+}
+
+TEST_CASE( "Test checkpoint and restart", "[ocl]") {
+  Constants c;
+  c.nx = 10;
+  c.ny = 7;
+  c.dt = 0.005;
+  c.pressureSolver = SolverType::CG;
+  c.diffusionControl.relTolerance = 1e-6;
+
+  Variables<OpenCLArray> vars(c);
+  for(int i=0; i<c.nx; ++i) {
+    for(int j=0; j<c.ny; ++j) {
+      vars.vx(i,j) = i + 2.0f*j;
+      vars.vy(i,j) = 3.0f*i - j;
+      vars.p(i,j) = i*j;
+    }
+  }
+  vars.vx.toDevice();
+  vars.vy.toDevice();
+  vars.p.toDevice();
+  writeCheckpoint("checkpoint.hdf5", vars, {1.25f, 250}, c);
+
+  const Constants restored = readCheckpointConstants("checkpoint.hdf5");
+  REQUIRE(restored.nx == c.nx);
+  REQUIRE(restored.ny == c.ny);
+  REQUIRE(restored.dx == c.dx);
+  REQUIRE(restored.dt == c.dt);
+  REQUIRE(restored.pressureSolver == SolverType::CG);
+  REQUIRE(restored.diffusionControl.relTolerance == c.diffusionControl.relTolerance);
+  REQUIRE(restored.timeSeriesFile == c.timeSeriesFile);
+
+  Variables<OpenCLArray> restart(restored);
+  const RunState state = readCheckpoint("checkpoint.hdf5", restart);
+  REQUIRE(state.t == 1.25f);
+  REQUIRE(state.step == 250);
+
+  // Only the device copy is checked, so zero the host copy first
+  restart.vx.fillHost(0.0f);
+  restart.vy.fillHost(0.0f);
+  restart.p.fillHost(0.0f);
+  restart.vx.toHost();
+  restart.vy.toHost();
+  restart.p.toHost();
+  for(int i=0; i<c.nx; ++i) {
+    for(int j=0; j<c.ny; ++j) {
+      REQUIRE(restart.vx(i,j) == i + 2.0f*j);
+      REQUIRE(restart.vy(i,j) == 3.0f*i - j);
+      REQUIRE(restart.p(i,j) == i*j);
+    }
+  }
+}
+
+TEST_CASE( "Test ensemble members match separate arrays", "[ocl]") {
+  const int nx = 9;
+  const int ny = 6;
+  const int ng = 1;
+  const int nMembers = 3;
+  const real alpha = 0.3f, beta = 2.0f, gamma = 1.5f;
+
+  OpenCLArray in(nx, ny, ng, "", 0.0f, nMembers), out(nx, ny, ng, "", 0.0f, nMembers);
+  OpenCLArray b(nx, ny, ng, "", 0.0f, nMembers);
+  in.setBoundaryCondition(BoundarySide::Left, BoundaryType::Neumann);
+  for(int m=0; m<nMembers; ++m) {
+    in.setBoundaryValue(BoundarySide::Upper, m, 1.0f + m);
+    for(int i=0; i<nx; ++i) {
+      for(int j=0; j<ny; ++j) {
+        in(i,j,m) = std::sin(0.3f*i + m) + 0.1f*j;
+        b(i,j,m) = std::cos(0.2f*j - m);
+      }
+    }
+  }
+  in.toDevice();
+  b.toDevice();
+  applyBoundaryConditions(in);
+  applyJacobiStep(out, in, alpha, beta, gamma, b);
+  out.toHost();
+  const ResidualNorms ensembleNorms = calcNorms(in);
+
+  real sumSquares = 0.0f;
+  real maxNorm = 0.0f;
+  for(int m=0; m<nMembers; ++m) {
+    OpenCLArray singleIn(nx, ny, ng), singleOut(nx, ny, ng), singleB(nx, ny, ng);
+    singleIn.setBoundaryCondition(BoundarySide::Left, BoundaryType::Neumann);
+    singleIn.setBoundaryCondition(BoundarySide::Upper, BoundaryType::Dirichlet, 1.0f + m);
+    for(int i=0; i<nx; ++i) {
+      for(int j=0; j<ny; ++j) {
+        singleIn(i,j) = in(i,j,m);
+        singleB(i,j) = b(i,j,m);
+      }
+    }
+    singleIn.toDevice();
+    singleB.toDevice();
+    applyBoundaryConditions(singleIn);
+    applyJacobiStep(singleOut, singleIn, alpha, beta, gamma, singleB);
+    singleOut.toHost();
+
+    for(int i=0; i<nx; ++i) {
+      for(int j=0; j<ny; ++j) {
+        REQUIRE(out(i,j,m) == Catch::Approx(singleOut(i,j)));
+      }
+    }
+
+    const ResidualNorms norms = calcNorms(singleIn);
+    sumSquares += norms.l2*norms.l2;
+    maxNorm = std::max(maxNorm, norms.max);
+  }
+  REQUIRE(ensembleNorms.l2 == Catch::Approx(std::sqrt(sumSquares)));
+  REQUIRE(ensembleNorms.max == Catch::Approx(maxNorm));
+}
+
+TEST_CASE( "Test mixed-precision refinement beats working precision", "[ocl]") {
+  const int nx = 16;
+  const int ny = 16;
+  const int ng = 1;
+  const real dx = 1.0f/(nx+1), dy = 1.0f/(ny+1), dt = 0.01f, Re = 100.0f;
+  const real alpha = 1.0f/(1.0f + 2.0f*dt/Re*(1.0f/(dx*dx) + 1.0f/(dy*dy)));
+  const real beta = -Re*dx*dx/dt;
+  const real gamma = -Re*dy*dy/dt;
+
+  OpenCLArray b(nx, ny, ng);
+  for(int i=0; i<nx; ++i) {
+    for(int j=0; j<ny; ++j) {
+      b(i,j) = std::sin(0.7f*i) + std::cos(1.3f*j);
+    }
+  }
+  b.toDevice();
+
+  // Working precision only
+  OpenCLArray single(nx, ny, ng), guess(nx, ny, ng), temp(nx, ny, ng);
+  const SolverControl control(20, 1, 1e-12f);
+  const SolverControl singleControl(1000, 50, 1e-12f);
+  const SolverStats singleStats = runJacobiIteration(single, guess, temp, alpha, beta, gamma, b, singleControl);
+
+  OpenCLArray refined(nx, ny, ng);
+  IterativeRefinement refinement(nx, ny, ng);
+  const SolverStats stats = refinement.solve(refined, b, alpha, beta, gamma, false,
+      [&](OpenCLArray& e, const OpenCLArray& r) {
+        for(int n=0; n<30; ++n) {
+          applyJacobiStep(temp, e, alpha, beta, gamma, r);
+          e.swapData(temp);
+        }
+      }, control);
+
+  REQUIRE(stats.iterations < control.maxIterations);
+  REQUIRE(stats.residual.l2 < 1e-3f*singleStats.residual.l2);
+
+  single.toHost();
+  refined.toHost();
+  for(int i=0; i<nx; ++i) {
+    for(int j=0; j<ny; ++j) {
+      REQUIRE(refined(i,j) == Catch::Approx(single(i,j)));
+    }
+  }
+}
+
+TEST_CASE( "Test half storage matches real storage", "[ocl]") {
+  const int nx = 32;
+  const int ny = 24;
+  const int ng = 1;
+  const real dx = 1.0f/nx, dy = 1.0f/ny, dt = 0.01f;
+
+  OpenCLArray vx(nx, ny, ng, "", 0.8f), vy(nx, ny, ng, "", -0.5f);
+  std::array<Storage, 2> storages{Storage::Real, Storage::Half};
+  std::vector<std::vector<real>> results;
+  std::vector<ResidualNorms> residuals;
+  for(Storage storage : storages) {
+    OpenCLArray f(nx, ny, ng, "", 0.0f, 1, storage);
+    OpenCLArray advected(nx, ny, ng, "", 0.0f, 1, storage);
+    OpenCLArray guess(nx, ny, ng, "", 0.0f, 1, storage);
+    OpenCLArray temp(nx, ny, ng, "", 0.0f, 1, storage);
+    OpenCLArray solution(nx, ny, ng, "", 0.0f, 1, storage);
+    REQUIRE(f.getStorage() == storage);
+    for(int i=0; i<nx; ++i) {
+      for(int j=0; j<ny; ++j) {
+        f(i,j) = std::sin(0.3f*i)*std::cos(0.2f*j);
+      }
+    }
+    f.toDevice();
+    f.setBoundaryConditions(BoundaryType::Neumann);
+    f.applyBoundaryConditions();
+
+    advectImplicit(advected, f, vx, vy, dx, dy, dt);
+    advected.setBoundaryConditions(BoundaryType::Neumann);
+    advected.applyBoundaryConditions();
+    // Solve with the advected field as b, from a zero guess
+    runJacobiIteration(solution, guess, temp, 0.2f, -4.0f, -4.0f, advected, 10);
+    residuals.push_back(calcJacobiResidualNorms(solution, 0.2f, -4.0f, -4.0f, advected));
+    solution.toHost();
+    results.emplace_back(solution.getData(), solution.getData() + solution.size());
+  }
+
+  // fp16 keeps about three significant digits
+  for(size_t k=0; k<results[0].size(); ++k) {
+    REQUIRE(results[1][k] == Catch::Approx(results[0][k]).margin(5e-3));
+  }
+  REQUIRE(residuals[0].l2 > 0.0f);
+  REQUIRE(residuals[1].l2 == Catch::Approx(residuals[0].l2).epsilon(0.05).margin(5e-3));
+  REQUIRE(residuals[1].max == Catch::Approx(residuals[0].max).epsilon(0.05).margin(5e-3));
+
+  OpenCLArray half(nx, ny, ng, "", 0.0f, 1, Storage::Half);
+  OpenCLArray full(nx, ny, ng);
+  REQUIRE_THROWS(half.swapData(full));
+  REQUIRE_THROWS(calcNorms(half));
+}
+
+TEST_CASE( "Test interleaved velocity matches separate components", "[ocl]") {
+  const int nx = 30;
+  const int ny = 22;
+  const int ng = 1;
+  const real dx = 1.0f/nx, dy = 1.0f/ny, dt = 0.01f;
+
+  OpenCLArray vx(nx, ny, ng), vy(nx, ny, ng);
+  for(int i=0; i<nx; ++i) {
+    for(int j=0; j<ny; ++j) {
+      vx(i,j) = std::sin(0.3f*i)*std::cos(0.2f*j);
+      vy(i,j) = 0.5f*std::cos(0.4f*i) - 0.1f*j*dy;
+    }
+  }
+  vx.toDevice();
+  vy.toDevice();
+  vx.setBoundaryCondition(BoundarySide::Upper, BoundaryType::Dirichlet, 1.0f);
+  vy.setBoundaryConditions(BoundaryType::Neumann);
+  applyBoundaryConditions(vx, vy);
+
+  VectorOpenCLArray v(nx, ny, ng), advected(nx, ny, ng);
+  v.pack(vx, vy);
+  advected.copyBoundaryConditions(vx, vy);
+
+  // Split reference
+  OpenCLArray ax(nx, ny, ng), ay(nx, ny, ng);
+  ax.copyBoundaryConditions(vx);
+  ay.copyBoundaryConditions(vy);
+  advectVelocityImplicit(ax, ay, vx, vy, dx, dy, dt);
+  applyBoundaryConditions(ax, ay);
+
+  OpenCLArray bx(nx, ny, ng), by(nx, ny, ng);
+  advectVelocityImplicit(advected, v, dx, dy, dt);
+  advected.applyBoundaryConditions();
+  advected.unpack(bx, by);
+
+  ax.toHost(); ay.toHost();
+  bx.toHost(); by.toHost();
+  for(int i=-ng; i<nx+ng; ++i) {
+    for(int j=-ng; j<ny+ng; ++j) {
+      REQUIRE(bx(i,j) == Catch::Approx(ax(i,j)).margin(1e-5));
+      REQUIRE(by(i,j) == Catch::Approx(ay(i,j)).margin(1e-5));
+    }
+  }
+
+  // Divergence and pressure live on the cell-centred grid, one larger
+  OpenCLArray divSplit(nx+1, ny+1, ng), divVector(nx+1, ny+1, ng);
+  calcDivergence(divSplit, ax, ay, dx, dy);
+  calcDivergence(divVector, advected, dx, dy);
+  divSplit.toHost();
+  divVector.toHost();
+  for(int i=0; i<nx+1; ++i) {
+    for(int j=0; j<ny+1; ++j) {
+      REQUIRE(divVector(i,j) == Catch::Approx(divSplit(i,j)).margin(1e-4));
+    }
+  }
+
+  OpenCLArray p(nx+1, ny+1, ng);
+  for(int i=0; i<nx+1; ++i) {
+    for(int j=0; j<ny+1; ++j) {
+      p(i,j) = 0.01f*std::cos(0.25f*i + 0.15f*j);
+    }
+  }
+  p.toDevice();
+  p.setBoundaryConditions(BoundaryType::Neumann);
+  p.applyBoundaryConditions();
+  applyProjectionX(ax, p, dx);
+  applyProjectionY(ay, p, dy);
+  applyProjection(advected, p, dx, dy);
+  advected.unpack(bx, by);
+
+  ax.toHost(); ay.toHost();
+  bx.toHost(); by.toHost();
+  for(int i=0; i<nx; ++i) {
+    for(int j=0; j<ny; ++j) {
+      REQUIRE(bx(i,j) == Catch::Approx(ax(i,j)).margin(1e-5));
+      REQUIRE(by(i,j) == Catch::Approx(ay(i,j)).margin(1e-5));
+    }
+  }
+
+  REQUIRE_THROWS(v.pack(vx, p));
+}
+
+TEST_CASE( "Test OpenMP and OpenCL backends take the same step", "[ocl]") {
+  Constants c;
+  c.nx = 20;
+  c.ny = 16;
+  c.dx = 1.0f/(c.nx+1);
+  c.dy = 1.0f/(c.ny+1);
+  c.dt = 0.01f;
+  // Jacobi for a fixed number of sweeps, the only solver both backends have
+  c.pressureSolver = SolverType::Jacobi;
+  c.diffusionSolver = SolverType::Jacobi;
+  c.jacobiSweepsPerLaunch = 1;
+  c.pressureControl = SolverControl(40, 40, 0.0f);
+  c.diffusionControl = SolverControl(10, 10, 0.0f);
+
+  Solver<OpenMPBackend> cpu(c);
+  Solver<OpenCLBackend> ocl(c);
+  cpu.applyBoundaryConditions();
+  ocl.applyBoundaryConditions();
+  for(int step=0; step<3; ++step) {
+    cpu.step(step*c.dt);
+    ocl.step(step*c.dt);
+  }
+  ocl.finish();
+
+  Variables<Array>& a = cpu.variables();
+  Variables<OpenCLArray>& b = ocl.variables();
+  b.vx.toHost();
+  b.vy.toHost();
+  b.p.toHost();
+  for(int i=0; i<c.nx; ++i) {
+    for(int j=0; j<c.ny; ++j) {
+      REQUIRE(b.vx(i,j) == Catch::Approx(a.vx(i,j)).margin(1e-4));
+      REQUIRE(b.vy(i,j) == Catch::Approx(a.vy(i,j)).margin(1e-4));
+    }
+  }
+  for(int i=0; i<c.nx+1; ++i) {
+    for(int j=0; j<c.ny+1; ++j) {
+      REQUIRE(b.p(i,j) == Catch::Approx(a.p(i,j)).margin(1e-4));
+    }
+  }
+}
+
+TEST_CASE( "Test half storage solver takes the same step as real storage", "[ocl]") {
+  Constants c;
+  c.nx = 20;
+  c.ny = 16;
+  c.dx = 1.0f/(c.nx+1);
+  c.dy = 1.0f/(c.ny+1);
+  c.dt = 0.01f;
+  c.pressureSolver = SolverType::Jacobi;
+  c.diffusionSolver = SolverType::Jacobi;
+  c.pressureControl = SolverControl(40, 10, 0.0f);
+  c.diffusionControl = SolverControl(10, 5, 0.0f);
+
+  Solver<OpenCLBackend> full(c);
+  Constants halfConstants = c;
+  halfConstants.isHalfStorage = true;
+  Solver<OpenCLBackend> half(halfConstants);
+  Variables<OpenCLArray>& a = full.variables();
+  Variables<OpenCLArray>& b = half.variables();
+  REQUIRE(a.p.getStorage() == Storage::Real);
+  REQUIRE(b.vx.getStorage() == Storage::Half);
+  REQUIRE(b.p.getStorage() == Storage::Half);
+  REQUIRE(half.divergence().getStorage() == Storage::Half);
+
+  full.applyBoundaryConditions();
+  half.applyBoundaryConditions();
+  for(int step=0; step<3; ++step) {
+    full.step(step*c.dt);
+    half.step(step*c.dt);
+  }
+  full.finish();
+  half.finish();
+
+  a.vx.toHost();
+  a.vy.toHost();
+  b.vx.toHost();
+  b.vy.toHost();
+  // fp16 keeps about three significant digits of the unit lid velocity
+  for(int i=0; i<c.nx; ++i) {
+    for(int j=0; j<c.ny; ++j) {
+      REQUIRE(b.vx(i,j) == Catch::Approx(a.vx(i,j)).margin(5e-3));
+      REQUIRE(b.vy(i,j) == Catch::Approx(a.vy(i,j)).margin(5e-3));
+    }
+  }
+
+  // The backend makes no real-storage solver workspaces for half storage,
+  // so the device footprint of a fresh solver is about halved
+  auto deviceBytes = [](const Constants& k) {
+    OpenCLBackend backend(k);
+    Variables<OpenCLArray> vars(k);
+    return backend.deviceBytes() + vars.vx.deviceBytes() + vars.vy.deviceBytes() + vars.p.deviceBytes();
+  };
+  REQUIRE(deviceBytes(halfConstants) < 0.6*deviceBytes(c));
+
+  // Multigrid has no kernels for half arrays
+  halfConstants.pressureSolver = SolverType::Multigrid;
+  REQUIRE_THROWS(OpenCLBackend(halfConstants));
+}
+
+TEST_CASE( "Test vectorised CPU kernels match pointwise formulas", "[cpu]") {
+  // ny not a multiple of any vector width, so rows end with scalar elements
+  const int nx = 13;
+  const int ny = 37;
+  const int ng = 1;
+  const real dx = 1.0f/nx, dy = 1.0f/ny, dt = 0.02f;
+  const real alpha = 0.2f, beta = 3.0f, gamma = -7.0f;
+
+  Array f(nx, ny, ng), b(nx, ny, ng), vx(nx, ny, ng), vy(nx, ny, ng);
+  REQUIRE(f.rowStride >= f.rowOffset + f.rowLength());
+  REQUIRE(reinterpret_cast<std::uintptr_t>(f.ptr(0, 0)) % SIMD_ALIGNMENT == 0);
+  REQUIRE(reinterpret_cast<std::uintptr_t>(f.ptr(0, 0) + f.rowStride) % SIMD_ALIGNMENT == 0);
+  for(int i=-ng; i<nx+ng; ++i) {
+    for(int j=-ng; j<ny+ng; ++j) {
+      f(i,j) = std::sin(0.4f*i) + std::cos(0.3f*j);
+      b(i,j) = 0.1f*i - 0.2f*j;
+      vx(i,j) = 2.0f*std::cos(0.5f*j);
+      vy(i,j) = -3.0f*std::sin(0.7f*i);
+    }
+  }
+
+  Array out(nx, ny, ng);
+  applyJacobiStep(out, f, alpha, beta, gamma, b);
+  for(int i=0; i<nx; ++i) {
+    for(int j=0; j<ny; ++j) {
+      REQUIRE(out(i,j) == Catch::Approx(calcJacobiStep(f, alpha, beta, gamma, b, i, j)));
+    }
+  }
+
+  advectImplicit(out, f, vx, vy, dx, dy, dt, nx, ny, ng);
+  for(int i=0; i<nx; ++i) {
+    for(int j=0; j<ny; ++j) {
+      REQUIRE(out(i,j) == Catch::Approx(calcAdvection(f, i, j, dx, dy, dt, nx, ny, ng, vx, vy)));
+    }
+  }
+
+  calcDivergence(out, vx, vy, dx, dy);
+  for(int i=0; i<nx; ++i) {
+    for(int j=0; j<ny; ++j) {
+      const real dvxdx = 0.5f*((vx(i,j) - vx(i-1,j))/dx + (vx(i,j-1) - vx(i-1,j-1))/dx);
+      const real dvydy = 0.5f*((vy(i,j) - vy(i,j-1))/dy + (vy(i-1,j) - vy(i-1,j-1))/dy);
+      const real expected = dvxdx + dvydy;
+      REQUIRE(out(i,j) == Catch::Approx(expected));
+    }
+  }
+
+  Array projected(nx, ny, ng, "", 1.0f);
+  applyProjectionX(projected, f, dx);
+  applyProjectionY(projected, f, dy);
+  for(int i=0; i<nx; ++i) {
+    for(int j=0; j<ny; ++j) {
+      const real dfdx = 0.5f*((f(i+1,j) - f(i,j))/dx + (f(i+1,j+1) - f(i,j+1))/dx);
+      const real dfdy = 0.5f*((f(i,j+1) - f(i,j))/dy + (f(i+1,j+1) - f(i+1,j))/dy);
+      const real expected = 1.0f - dfdx - dfdy;
+      REQUIRE(projected(i,j) == Catch::Approx(expected));
+    }
+  }
+  // Ghost cells are not written
+  REQUIRE(projected(-1,0) == 1.0f);
+  REQUIRE(projected(0,ny) == 1.0f);
+}
+
+#ifdef FAFS_USE_MPI
+// The [mpi] tests run on however many ranks the tests are launched with, e.g.
+//   mpirun -np 4 ./tests "[mpi]"
+void initialiseMPI() {
+  int isInitialised;
+  MPI_Initialized(&isInitialised);
+  if(!isInitialised) {
+    int threadSupport;
+    MPI_Init_thread(nullptr, nullptr, MPI_THREAD_FUNNELED, &threadSupport);
+    std::atexit([]() { MPI_Finalize(); });
+  }
+}
+
+TEST_CASE( "Test decomposed grid takes the same step as the whole grid", "[mpi]") {
+  initialiseMPI();
+
+  Constants c;
+  // Not multiples of the number of blocks, so blocks differ in size
+  c.nx = 23;
+  c.ny = 18;
+  c.dx = 1.0f/(c.nx+1);
+  c.dy = 1.0f/(c.ny+1);
+  c.dt = 0.01f;
+  c.isAdvectionImplicit = true;
+  c.isDiffusionImplicit = true;
+  c.pressureSolver = SolverType::Jacobi;
+  c.diffusionSolver = SolverType::Jacobi;
+  c.pressureControl = SolverControl(40, 10, 0.0f);
+  c.diffusionControl = SolverControl(10, 5, 0.0f);
+
+  Decomposition d(MPI_COMM_WORLD, c.nx, c.ny);
+  Solver<MPIBackend> blocks(d.localConstants(c), d);
+  blocks.applyBoundaryConditions();
+  for(int step=0; step<3; ++step) {
+    blocks.step(step*c.dt);
+  }
+
+  std::unique_ptr<Variables<Array>> gathered;
+  if(d.rank == 0) {
+    gathered = std::make_unique<Variables<Array>>(c);
+  }
+  Variables<Array>& local = blocks.variables();
+  d.gather(local.vx, gathered ? &gathered->vx : nullptr);
+  d.gather(local.vy, gathered ? &gathered->vy : nullptr);
+  d.gather(local.p, gathered ? &gathered->p : nullptr);
+  if(d.rank != 0) {
+    return;
+  }
+
+  Solver<OpenMPBackend> whole(c);
+  whole.applyBoundaryConditions();
+  for(int step=0; step<3; ++step) {
+    whole.step(step*c.dt);
+  }
+  const Variables<Array>& a = whole.variables();
+  const Variables<Array>& b = *gathered;
+  for(int i=0; i<c.nx; ++i) {
+    for(int j=0; j<c.ny; ++j) {
+      REQUIRE(b.vx(i,j) == Catch::Approx(a.vx(i,j)).margin(1e-5));
+      REQUIRE(b.vy(i,j) == Catch::Approx(a.vy(i,j)).margin(1e-5));
+    }
+  }
+  for(int i=0; i<c.nx+1; ++i) {
+    for(int j=0; j<c.ny+1; ++j) {
+      REQUIRE(b.p(i,j) == Catch::Approx(a.p(i,j)).margin(1e-5));
+    }
+  }
+}
+
+TEST_CASE( "Test decomposed implicit advection rejects back-traces beyond the halo", "[mpi]") {
+  initialiseMPI();
+
+  Constants c;
+  c.nx = 23;
+  c.ny = 18;
+  c.dx = 1.0f/(c.nx+1);
+  c.dy = 1.0f/(c.ny+1);
+  c.isAdvectionImplicit = true;
+
+  Decomposition d(MPI_COMM_WORLD, c.nx, c.ny);
+  // Half a cell per step
+  c.dt = 0.5f*c.dx;
+  Constants local = d.localConstants(c);
+  MPIBackend backend(local, d);
+  Variables<Array> vars(local);
+  vars.vx.fill(1.0f);
+  vars.vy.fill(1.0f);
+  REQUIRE_NOTHROW(backend.advect(vars));
+
+  // Further than the halo per step, which only a single block may take
+  c.dt = 1.5f*c.ng*c.dx;
+  local = d.localConstants(c);
+  MPIBackend fastBackend(local, d);
+  vars.vx.fill(1.0f);
+  vars.vy.fill(1.0f);
+  if(d.size > 1) {
+    REQUIRE_THROWS_AS(fastBackend.advect(vars), std::runtime_error);
+  } else {
+    REQUIRE_NOTHROW(fastBackend.advect(vars));
+  }
+}
+#endif